@@ -0,0 +1,337 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Read and write path benchmarks.
+//!
+//! Every table workload runs against generated tables for each compression type and
+//! checksum type in the matrix below. Table sizes default to 10K and 100K keys and
+//! can be changed with `SST_BENCH_NUM_KEYS`, e.g.
+//!
+//! ```text
+//! SST_BENCH_NUM_KEYS=10000,1000000,10000000 cargo bench --bench sst_bench
+//! ```
+//!
+//! `SST_BENCH_FILES` adds existing tables, e.g. RocksDB-written corpora from
+//! `fixtures/generate_fixtures`, to the read benchmarks. Running
+//! `fixtures/baseline_bench` on the same files gives RocksDB's own numbers.
+//!
+//! Criterion stores the estimates of each run as JSON under
+//! `target/criterion/<group>/<benchmark>/new/estimates.json`. Use
+//! `--save-baseline <name>` and `--baseline <name>` to compare runs over time.
+
+use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
+use rocksdb_fileformat::{
+    ChecksumType, CompressionType, SstEntryIterator, SstFileWriter, SstIterator, SstReader,
+    SstTableIterator, WriteOptions, compress, decompress,
+};
+use std::hint::black_box;
+use std::path::{Path, PathBuf};
+use tempfile::TempDir;
+
+const COMPRESSION_TYPES: &[CompressionType] = &[
+    CompressionType::None,
+    CompressionType::Snappy,
+    CompressionType::LZ4,
+    CompressionType::ZSTD,
+];
+const CHECKSUM_TYPES: &[ChecksumType] = &[ChecksumType::CRC32c, ChecksumType::XXH3];
+const DEFAULT_NUM_KEYS: &[usize] = &[10_000, 100_000];
+const VALUE_SIZE: usize = 100;
+const SCAN_LENGTH: usize = 100;
+const LOOKUPS_PER_ITERATION: usize = 1000;
+/// Upper bound for the keys sampled from a table to look up
+const MAX_SAMPLED_KEYS: usize = 100_000;
+
+fn num_keys_matrix() -> Vec<usize> {
+    match std::env::var("SST_BENCH_NUM_KEYS") {
+        Ok(sizes) => sizes
+            .split(',')
+            .map(|size| size.trim().parse().expect("invalid SST_BENCH_NUM_KEYS"))
+            .collect(),
+        Err(_) => DEFAULT_NUM_KEYS.to_vec(),
+    }
+}
+
+fn key(n: usize) -> Vec<u8> {
+    format!("key{:012}", n).into_bytes()
+}
+
+/// Somewhat compressible value: a repeated key-specific pattern
+fn value(n: usize) -> Vec<u8> {
+    format!("value{:08}-", n)
+        .bytes()
+        .cycle()
+        .take(VALUE_SIZE)
+        .collect()
+}
+
+/// Deterministic pseudo random sequence (xorshift64) for lookup keys
+struct Lookups(u64);
+
+impl Lookups {
+    fn next_below(&mut self, bound: usize) -> usize {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        (self.0 % bound as u64) as usize
+    }
+}
+
+struct Table {
+    id: String,
+    path: PathBuf,
+    num_keys: usize,
+    checksum: ChecksumType,
+    /// Keys in the table to look up. Appending a zero byte to one gives a key
+    /// between it and its successor, for lookups that miss.
+    sampled_keys: Vec<Vec<u8>>,
+}
+
+impl Table {
+    fn iterator(&self) -> SstTableIterator {
+        let reader = SstReader::open(&self.path).unwrap();
+        // Data blocks are decoded according to their trailer, whatever the table
+        // was written with
+        SstTableIterator::new(reader, CompressionType::None).unwrap()
+    }
+
+    fn lookup_key(&self, lookups: &mut Lookups, miss: bool) -> Vec<u8> {
+        let mut key = self.sampled_keys[lookups.next_below(self.sampled_keys.len())].clone();
+        if miss {
+            key.push(0);
+        }
+        key
+    }
+}
+
+fn write_options(compression: CompressionType, checksum: ChecksumType) -> WriteOptions {
+    WriteOptions {
+        compression,
+        checksum_type: checksum,
+        ..WriteOptions::default()
+    }
+}
+
+fn write_table(path: &Path, options: &WriteOptions, num_keys: usize) {
+    let mut writer = SstFileWriter::create(options);
+    writer.open(path).unwrap();
+    for i in 0..num_keys {
+        writer.put(key(i), value(i)).unwrap();
+    }
+    writer.finish().unwrap();
+}
+
+fn build_tables(dir: &TempDir) -> Vec<Table> {
+    let mut tables = Vec::new();
+    for &num_keys in &num_keys_matrix() {
+        let stride = num_keys.div_ceil(MAX_SAMPLED_KEYS);
+        for &compression in COMPRESSION_TYPES {
+            for &checksum in CHECKSUM_TYPES {
+                let path = dir
+                    .path()
+                    .join(format!("{:?}_{:?}_{}.sst", compression, checksum, num_keys));
+                write_table(&path, &write_options(compression, checksum), num_keys);
+                tables.push(Table {
+                    id: format!("{:?}/{:?}/{}", compression, checksum, num_keys),
+                    path,
+                    num_keys,
+                    checksum,
+                    sampled_keys: (0..num_keys).step_by(stride).map(key).collect(),
+                });
+            }
+        }
+    }
+
+    if let Ok(files) = std::env::var("SST_BENCH_FILES") {
+        for path in files.split(',').map(PathBuf::from) {
+            match open_external_table(&path) {
+                Ok(table) => tables.push(table),
+                Err(e) => eprintln!("Skipping {}: {}", path.display(), e),
+            }
+        }
+    }
+    tables
+}
+
+fn open_external_table(path: &Path) -> rocksdb_fileformat::Result<Table> {
+    let reader = SstReader::open(path)?;
+    let checksum = reader.get_footer().checksum_type;
+    let mut iterator = SstEntryIterator::new(reader, CompressionType::None)?;
+
+    let mut keys = Vec::new();
+    iterator.for_each_key(|key| {
+        keys.push(key.to_vec());
+        Ok(())
+    })?;
+    let num_keys = keys.len();
+    let stride = num_keys.div_ceil(MAX_SAMPLED_KEYS).max(1);
+
+    Ok(Table {
+        id: format!("file/{}", path.file_name().unwrap().to_string_lossy()),
+        path: path.to_path_buf(),
+        num_keys,
+        checksum,
+        sampled_keys: keys.into_iter().step_by(stride).collect(),
+    })
+}
+
+fn bench_point_get(c: &mut Criterion, tables: &[Table]) {
+    let mut group = c.benchmark_group("point_get");
+    group.throughput(Throughput::Elements(LOOKUPS_PER_ITERATION as u64));
+
+    for table in tables {
+        for (name, miss) in [("hit", false), ("miss", true)] {
+            let mut iterator = table.iterator();
+            let mut lookups = Lookups(0x9e3779b97f4a7c15);
+            group.bench_function(BenchmarkId::new(name, &table.id), |b| {
+                b.iter(|| {
+                    let mut found = 0;
+                    for _ in 0..LOOKUPS_PER_ITERATION {
+                        let target = table.lookup_key(&mut lookups, miss);
+                        iterator.seek(&target).unwrap();
+                        if iterator.valid() && iterator.key() == Some(target.as_slice()) {
+                            found += 1;
+                        }
+                    }
+                    black_box(found)
+                })
+            });
+        }
+    }
+    group.finish();
+}
+
+fn bench_seek_and_scan(c: &mut Criterion, tables: &[Table]) {
+    let mut group = c.benchmark_group("seek_scan");
+    group.throughput(Throughput::Elements(SCAN_LENGTH as u64));
+
+    for table in tables {
+        let mut iterator = table.iterator();
+        let mut lookups = Lookups(0x2545f4914f6cdd1d);
+        group.bench_function(BenchmarkId::from_parameter(&table.id), |b| {
+            b.iter(|| {
+                iterator
+                    .seek(&table.lookup_key(&mut lookups, false))
+                    .unwrap();
+                let mut bytes = 0;
+                for _ in 0..SCAN_LENGTH {
+                    if !iterator.valid() {
+                        break;
+                    }
+                    bytes += iterator.value().map_or(0, |value| value.len());
+                    iterator.next().unwrap();
+                }
+                black_box(bytes)
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_full_scan(c: &mut Criterion, tables: &[Table]) {
+    let mut group = c.benchmark_group("full_scan");
+    group.sample_size(10);
+
+    for table in tables {
+        group.throughput(Throughput::Elements(table.num_keys as u64));
+        group.bench_function(BenchmarkId::from_parameter(&table.id), |b| {
+            b.iter(|| {
+                let reader = SstReader::open(&table.path).unwrap();
+                let mut iterator = SstEntryIterator::new(reader, CompressionType::None).unwrap();
+                let mut bytes = 0;
+                iterator
+                    .for_each_entry(|key, value| {
+                        bytes += key.len() + value.len();
+                        Ok(())
+                    })
+                    .unwrap();
+                black_box(bytes)
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_bulk_write(c: &mut Criterion, dir: &TempDir) {
+    let mut group = c.benchmark_group("bulk_write");
+    group.sample_size(10);
+    let path = dir.path().join("bulk_write.sst");
+
+    for &num_keys in &num_keys_matrix() {
+        group.throughput(Throughput::Elements(num_keys as u64));
+        for &compression in COMPRESSION_TYPES {
+            for &checksum in CHECKSUM_TYPES {
+                let options = write_options(compression, checksum);
+                let id = format!("{:?}/{:?}/{}", compression, checksum, num_keys);
+                group.bench_function(BenchmarkId::from_parameter(id), |b| {
+                    b.iter(|| write_table(&path, &options, num_keys))
+                });
+            }
+        }
+    }
+    group.finish();
+}
+
+/// Index and data block search on their own, without file reads
+fn bench_block_search(c: &mut Criterion, tables: &[Table]) {
+    let mut group = c.benchmark_group("block_search");
+
+    for table in tables
+        .iter()
+        .filter(|table| table.checksum == CHECKSUM_TYPES[0])
+    {
+        let mut reader = SstReader::open(&table.path).unwrap();
+        let index_block = reader.read_index_block().unwrap();
+        let handles = index_block.get_all_block_handles().unwrap();
+        let data_block = reader
+            .read_data_block(handles[handles.len() / 2].clone(), CompressionType::None)
+            .unwrap();
+
+        let mut lookups = Lookups(0x5851f42d4c957f2d);
+        group.bench_function(BenchmarkId::new("find_block_for_key", &table.id), |b| {
+            b.iter(|| {
+                let target = table.lookup_key(&mut lookups, false);
+                index_block.find_block_for_key(&target).unwrap()
+            })
+        });
+        group.bench_function(BenchmarkId::new("get_entries", &table.id), |b| {
+            b.iter(|| data_block.get_entries().unwrap())
+        });
+    }
+    group.finish();
+}
+
+/// Single block codec cost, independent of the table layout
+fn bench_block_compression(c: &mut Criterion) {
+    let mut group = c.benchmark_group("block_compression");
+    let block: Vec<u8> = (0..64).flat_map(|i| [key(i), value(i)].concat()).collect();
+    group.throughput(Throughput::Bytes(block.len() as u64));
+
+    for &compression in COMPRESSION_TYPES {
+        let compressed = compress(&block, compression).unwrap();
+        group.bench_function(
+            BenchmarkId::new("compress", format!("{:?}", compression)),
+            |b| b.iter(|| compress(black_box(&block), compression).unwrap()),
+        );
+        group.bench_function(
+            BenchmarkId::new("decompress", format!("{:?}", compression)),
+            |b| b.iter(|| decompress(black_box(&compressed), compression).unwrap()),
+        );
+    }
+    group.finish();
+}
+
+fn benches(c: &mut Criterion) {
+    let dir = tempfile::tempdir().unwrap();
+    let tables = build_tables(&dir);
+
+    bench_point_get(c, &tables);
+    bench_seek_and_scan(c, &tables);
+    bench_full_scan(c, &tables);
+    bench_block_search(c, &tables);
+    bench_bulk_write(c, &dir);
+    bench_block_compression(c);
+}
+
+criterion_group!(sst_benches, benches);
+criterion_main!(sst_benches);
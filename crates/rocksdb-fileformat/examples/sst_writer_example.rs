@@ -1,5 +1,6 @@
 use rocksdb_fileformat::{
-    ChecksumType, CompressionType, FormatVersion, SstFileWriter, SstReader, WriteOptions,
+    ChecksumType, CompressionOptions, CompressionType, FormatVersion, SstFileWriter, SstReader,
+    WriteOptions,
 };
 use tempfile::tempdir;
 
@@ -17,6 +18,9 @@ fn main() -> Result<(), Box<dyn std::error::Error>> {
         block_restart_interval: 16,
         format_version: FormatVersion::V5,
         checksum_type: ChecksumType::CRC32c,
+        use_direct_writes: false,
+        compression_opts: CompressionOptions::default(),
+        statistics: None,
     };
 
     // Create and use the writer
@@ -0,0 +1,300 @@
+// Baseline read performance of RocksDB itself on existing SST files, to compare
+// the rocksdb-fileformat reader against on identical input.
+//
+// Each file is opened with RocksDB's SstFileReader and measured for:
+//   - full scan throughput
+//   - random point gets (Seek plus key comparison, as SstFileReader has no Get),
+//     for keys present in the file and for keys just after them
+//   - Seek followed by a short scan
+// Results are printed to stdout as JSON.
+//
+// The rocksdb-fileformat reader cannot yet decode the delta-encoded index values
+// RocksDB writes from format_version 4, and its benchmarks skip such files. Each
+// file's format_version is reported, and files without a Rust counterpart are
+// flagged in the JSON and on stderr.
+
+#include <rocksdb/options.h>
+#include <rocksdb/sst_file_reader.h>
+#include <rocksdb/iterator.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_json.h"
+
+using namespace rocksdb;
+using Clock = std::chrono::steady_clock;
+
+// First format_version whose index blocks the Rust reader cannot decode
+constexpr uint64_t kFirstUnreadableFormatVersion = 4;
+
+struct BenchOptions {
+    size_t lookups = 100000;
+    size_t scan_length = 100;
+    int scan_repeats = 3;
+    bool verify_checksums = true;
+    uint64_t seed = 42;
+    std::vector<std::string> files;
+};
+
+struct LatencySummary {
+    double mean_ns = 0;
+    double p50_ns = 0;
+    double p99_ns = 0;
+    // Keys found for point gets, entries read for seek_scan
+    size_t count = 0;
+};
+
+uint64_t elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+LatencySummary summarize(std::vector<uint64_t>& latencies, size_t count) {
+    LatencySummary summary;
+    summary.count = count;
+    if (latencies.empty()) return summary;
+
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (uint64_t latency : latencies) total += latency;
+    summary.mean_ns = total / latencies.size();
+    summary.p50_ns = latencies[latencies.size() / 2];
+    summary.p99_ns = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    return summary;
+}
+
+std::string latency_json(const LatencySummary& summary) {
+    std::ostringstream oss;
+    oss << "{\"mean_ns\": " << summary.mean_ns
+        << ", \"p50_ns\": " << summary.p50_ns
+        << ", \"p99_ns\": " << summary.p99_ns
+        << ", \"count\": " << summary.count << "}";
+    return oss.str();
+}
+
+// Returns the file's entries through `sample`, every `stride`th key
+bool full_scan(Iterator* it, size_t stride, uint64_t* entries, uint64_t* bytes,
+               std::vector<std::string>* sample) {
+    *entries = 0;
+    *bytes = 0;
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (sample != nullptr && *entries % stride == 0) sample->push_back(it->key().ToString());
+        *bytes += it->key().size() + it->value().size();
+        ++*entries;
+    }
+    if (!it->status().ok()) {
+        std::cerr << "Scan failed: " << it->status().ToString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+LatencySummary point_gets(Iterator* it, const std::vector<std::string>& keys, bool miss,
+                          const BenchOptions& opts) {
+    std::mt19937_64 rng(opts.seed);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    std::vector<uint64_t> latencies;
+    latencies.reserve(opts.lookups);
+    size_t found = 0;
+
+    for (size_t i = 0; i < opts.lookups; ++i) {
+        // A trailing zero byte sorts right after the key, so the target falls
+        // between two existing keys
+        std::string target = keys[pick(rng)];
+        if (miss) target.push_back('\0');
+
+        auto start = Clock::now();
+        it->Seek(target);
+        if (it->Valid() && it->key().compare(target) == 0) {
+            std::string value = it->value().ToString();
+            ++found;
+        }
+        latencies.push_back(elapsed_ns(start));
+    }
+    return summarize(latencies, found);
+}
+
+LatencySummary seek_and_scan(Iterator* it, const std::vector<std::string>& keys,
+                             const BenchOptions& opts) {
+    std::mt19937_64 rng(opts.seed + 1);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    size_t seeks = std::max<size_t>(opts.lookups / 10, 1);
+    std::vector<uint64_t> latencies;
+    latencies.reserve(seeks);
+    size_t scanned = 0;
+
+    for (size_t i = 0; i < seeks; ++i) {
+        auto start = Clock::now();
+        it->Seek(keys[pick(rng)]);
+        for (size_t n = 0; n < opts.scan_length && it->Valid(); ++n, it->Next()) {
+            ++scanned;
+        }
+        latencies.push_back(elapsed_ns(start));
+    }
+    return summarize(latencies, scanned);
+}
+
+// The table's format_version, stored before the magic number at the end of the
+// footer. Legacy footers (format_version 0) have no such field.
+uint64_t footer_format_version(const std::string& path) {
+    constexpr uint64_t kLegacyMagicNumber = 0xdb4775248b80fb57ull;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file || file.tellg() < 12) return 0;
+    unsigned char bytes[12];
+    file.seekg(-12, std::ios::end);
+    if (!file.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) return 0;
+    auto little_endian = [&](int offset, int length) {
+        uint64_t value = 0;
+        for (int i = length - 1; i >= 0; --i) value = value << 8 | bytes[offset + i];
+        return value;
+    };
+    if (little_endian(4, 8) == kLegacyMagicNumber) return 0;
+    return little_endian(0, 4);
+}
+
+bool bench_file(const std::string& path, const BenchOptions& opts, std::ostream& out,
+                bool* rust_comparable) {
+    Options options;
+    SstFileReader reader(options);
+    Status status = reader.Open(path);
+    if (!status.ok()) {
+        std::cerr << "Failed to open " << path << ": " << status.ToString() << std::endl;
+        return false;
+    }
+
+    auto properties = reader.GetTableProperties();
+    uint64_t format_version = footer_format_version(path);
+    *rust_comparable = format_version < kFirstUnreadableFormatVersion;
+    if (!*rust_comparable) {
+        std::cerr << "Warning: " << path << " has format_version " << format_version
+                  << "; the Rust reader skips it, so there is nothing to compare against"
+                  << std::endl;
+    }
+    ReadOptions read_options;
+    read_options.verify_checksums = opts.verify_checksums;
+    std::unique_ptr<Iterator> it(reader.NewIterator(read_options));
+
+    // The first scan warms the page cache and samples the lookup keys
+    size_t stride = std::max<uint64_t>(properties->num_entries / opts.lookups, 1);
+    std::vector<std::string> keys;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+    if (!full_scan(it.get(), stride, &entries, &bytes, &keys)) return false;
+    if (keys.empty()) {
+        std::cerr << "No entries in " << path << std::endl;
+        return false;
+    }
+
+    uint64_t best_scan_ns = UINT64_MAX;
+    for (int i = 0; i < opts.scan_repeats; ++i) {
+        auto start = Clock::now();
+        if (!full_scan(it.get(), stride, &entries, &bytes, nullptr)) return false;
+        best_scan_ns = std::min(best_scan_ns, elapsed_ns(start));
+    }
+    double scan_seconds = best_scan_ns / 1e9;
+
+    LatencySummary hits = point_gets(it.get(), keys, false, opts);
+    LatencySummary misses = point_gets(it.get(), keys, true, opts);
+    LatencySummary seeks = seek_and_scan(it.get(), keys, opts);
+
+    out << "    {\n"
+        << "      \"path\": " << json_string(path) << ",\n"
+        << "      \"format_version\": " << format_version << ",\n"
+        << "      \"rust_comparable\": " << (*rust_comparable ? "true" : "false") << ",\n"
+        << "      \"num_entries\": " << entries << ",\n"
+        << "      \"num_data_blocks\": " << properties->num_data_blocks << ",\n"
+        << "      \"data_size\": " << properties->data_size << ",\n"
+        << "      \"full_scan\": {\"seconds\": " << scan_seconds
+        << ", \"entries_per_sec\": " << entries / scan_seconds
+        << ", \"mb_per_sec\": " << bytes / scan_seconds / (1024 * 1024) << "},\n"
+        << "      \"point_get_hit\": " << latency_json(hits) << ",\n"
+        << "      \"point_get_miss\": " << latency_json(misses) << ",\n"
+        << "      \"seek_scan\": " << latency_json(seeks) << "\n"
+        << "    }";
+    return true;
+}
+
+void print_usage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " [options] FILE.sst...\n";
+    std::cerr << "Options:\n";
+    std::cerr << "  --lookups N        Point gets per file, hits and misses each (default: 100000)\n";
+    std::cerr << "  --scan-length N    Entries read after each seek (default: 100)\n";
+    std::cerr << "  --scan-repeats N   Full scans per file, the fastest is reported (default: 3)\n";
+    std::cerr << "  --no-verify        Skip block checksum verification\n";
+    std::cerr << "  --seed N           Seed for the lookup keys (default: 42)\n";
+    std::cerr << "  --help             Show this help\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--lookups" && i + 1 < argc) {
+            opts.lookups = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (arg == "--scan-length" && i + 1 < argc) {
+            opts.scan_length = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--scan-repeats" && i + 1 < argc) {
+            opts.scan_repeats = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--no-verify") {
+            opts.verify_checksums = false;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            opts.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        } else {
+            opts.files.push_back(arg);
+        }
+    }
+
+    if (opts.files.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+    size_t incomparable = 0;
+    std::vector<std::string> results;
+    for (const std::string& path : opts.files) {
+        std::ostringstream result;
+        bool rust_comparable = true;
+        if (!bench_file(path, opts, result, &rust_comparable)) {
+            failed++;
+            continue;
+        }
+        if (!rust_comparable) incomparable++;
+        results.push_back(result.str());
+    }
+
+    // The caveat leads the output so that it is seen before any number
+    std::cout << "{\n";
+    if (incomparable > 0) {
+        std::string caveat = std::to_string(incomparable) + " of " +
+                             std::to_string(results.size()) +
+                             " files use format_version >= 4, whose delta-encoded index the "
+                             "Rust reader cannot decode yet; it skips them, so these files "
+                             "have no Rust numbers to compare against";
+        std::cout << "  \"caveat\": " << json_string(caveat) << ",\n";
+        std::cerr << "Warning: " << caveat << std::endl;
+    }
+    std::cout << "  \"files\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::cout << (i == 0 ? "" : ",\n") << results[i];
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+// JSON helpers shared by the benchmark harnesses.
+
+#pragma once
+
+#include <sstream>
+#include <string>
+
+// `s` as a JSON string literal. Control characters, which only show up in error
+// messages and odd file names, are replaced by spaces.
+inline std::string json_string(const std::string& s) {
+    std::ostringstream oss;
+    oss << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') oss << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20) oss << ' ';
+        else oss << c;
+    }
+    oss << '"';
+    return oss.str();
+}
@@ -3,6 +3,7 @@
 #include <rocksdb/table.h>
 #include <rocksdb/sst_file_writer.h>
 #include <rocksdb/filter_policy.h>
+#include <rocksdb/slice_transform.h>
 #include <iostream>
 #include <string>
 #include <iomanip>
@@ -11,6 +12,11 @@
 #include <map>
 #include <filesystem>
 #include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
+#include <random>
 
 using namespace rocksdb;
 
@@ -34,6 +40,155 @@ std::map<CompressionType, std::string> compression_names = {
     {CompressionType::kZSTD, "zstd"}
 };
 
+// Key distributions for benchmark corpora. Keys are always written in sorted
+// order; the distribution decides which part of the key space they cover.
+enum class KeyDistribution {
+    kSequential,    // consecutive ids
+    kUniform,       // ids spread uniformly over the 64-bit id space
+    kZipfian,       // zipfian gaps between ids: dense runs with rare large jumps
+    kSharedPrefix   // consecutive ids behind a long prefix shared by every key
+};
+
+std::map<KeyDistribution, std::string> distribution_names = {
+    {KeyDistribution::kSequential, "sequential"},
+    {KeyDistribution::kUniform, "uniform"},
+    {KeyDistribution::kZipfian, "zipfian"},
+    {KeyDistribution::kSharedPrefix, "prefix"}
+};
+
+std::map<BlockBasedTableOptions::IndexType, std::string> index_type_names = {
+    {BlockBasedTableOptions::kBinarySearch, "binary"},
+    {BlockBasedTableOptions::kBinarySearchWithFirstKey, "binary_first_key"},
+    {BlockBasedTableOptions::kTwoLevelIndexSearch, "partitioned"}
+};
+
+// Data set and table options. The defaults reproduce the checked-in fixtures:
+// 50 keys key000..key049 with descriptive values, 4 KiB blocks and a 10 bit
+// Bloom filter.
+struct GeneratorOptions {
+    // Corpus mode is enabled by any of the data set flags. It writes fixed size
+    // keys and values and defaults to a separate output directory.
+    bool corpus_mode = false;
+    uint64_t num_keys = 50;
+    size_t key_size = 16;
+    size_t value_size = 100;
+    KeyDistribution distribution = KeyDistribution::kSequential;
+    uint64_t seed = 42;
+
+    size_t block_size = 4096;
+    BlockBasedTableOptions::IndexType index_type = BlockBasedTableOptions::kBinarySearch;
+    std::string filter = "bloom";
+    double bits_per_key = 10;
+
+    // Advanced table features, all off by default
+    bool partition_filters = false;
+    uint64_t metadata_block_size = 4096;
+    bool data_block_hash_index = false;
+    uint32_t zstd_dict_bytes = 0;
+    // 0 keeps RocksDB's default of 1 and leaves the file name alone
+    int index_block_restart_interval = 0;
+    size_t prefix_len = 0;
+    uint64_t range_tombstones = 0;
+
+    std::string output_dir;
+};
+
+// YCSB's zipfian generator (Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases"), returning values in [1, n] with 1 the most frequent
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+        double zeta2 = zeta(2);
+        zetan_ = zeta(n);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+    }
+
+    uint64_t next(std::mt19937_64& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan_;
+        if (uz < 1.0) return 1;
+        if (uz < 1.0 + std::pow(0.5, theta_)) return 2;
+        return 1 + static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+    }
+
+private:
+    double zeta(uint64_t n) const {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1.0 / std::pow(static_cast<double>(i), theta_);
+        return sum;
+    }
+
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+// Produces the sorted, unique keys and the values of a corpus one at a time, so
+// multi-GB files never need the whole data set in memory
+class CorpusGenerator {
+public:
+    static constexpr uint64_t kMaxZipfianGap = 1000000;
+
+    explicit CorpusGenerator(const GeneratorOptions& opts)
+        : opts_(opts), rng_(opts.seed), zipfian_(kMaxZipfianGap, 0.99) {
+        // Uniform gaps average 2^62 / num_keys, so ids stay below 2^63
+        uniform_max_gap_ = std::max<uint64_t>(1, (uint64_t{1} << 62) / opts.num_keys * 2 - 1);
+    }
+
+    std::string next_key() {
+        switch (opts_.distribution) {
+            case KeyDistribution::kUniform:
+                id_ += std::uniform_int_distribution<uint64_t>(1, uniform_max_gap_)(rng_);
+                break;
+            case KeyDistribution::kZipfian:
+                id_ += zipfian_.next(rng_);
+                break;
+            default:
+                id_ += 1;
+                break;
+        }
+
+        // Fixed width hex keeps byte order equal to id order
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(id_));
+        size_t filler = opts_.key_size - 16;
+
+        std::string key;
+        key.reserve(opts_.key_size);
+        if (opts_.distribution == KeyDistribution::kSharedPrefix) {
+            for (size_t i = 0; i < filler; ++i) key.push_back(kPrefix[i % (sizeof(kPrefix) - 1)]);
+            key.append(hex);
+        } else {
+            key.append(hex);
+            for (size_t i = 0; i < filler; ++i) key.push_back(static_cast<char>('a' + (id_ + i) % 26));
+        }
+        return key;
+    }
+
+    // Half random, half repeated, for a compression ratio of about 0.5 like
+    // db_bench's default
+    std::string next_value() {
+        std::string value(opts_.value_size, '\0');
+        size_t random_len = (opts_.value_size + 1) / 2;
+        std::uniform_int_distribution<int> letter('a', 'z');
+        for (size_t i = 0; i < random_len; ++i) value[i] = static_cast<char>(letter(rng_));
+        for (size_t i = random_len; i < opts_.value_size; ++i) value[i] = value[i - random_len];
+        return value;
+    }
+
+private:
+    static constexpr char kPrefix[] = "tenant-0001/collection-users/shard-00/";
+
+    const GeneratorOptions& opts_;
+    std::mt19937_64 rng_;
+    ZipfianGenerator zipfian_;
+    uint64_t uniform_max_gap_;
+    uint64_t id_ = 0;
+};
+
 // Helper function to format keys and values
 std::string format_key(int i) {
     std::ostringstream oss;
@@ -50,17 +205,45 @@ std::string format_value(int format_version, const std::string& checksum_name,
 }
 
 bool generate_sst_file(int format_version, ChecksumType checksum_type, 
-                       CompressionType compression_type, const std::string& filename) {
+                       CompressionType compression_type, const std::string& filename,
+                       const GeneratorOptions& opts) {
     Options options;
     
     // Configure BlockBasedTableOptions
     BlockBasedTableOptions table_options;
     table_options.format_version = format_version;
     table_options.checksum = checksum_type;
-    table_options.filter_policy.reset(NewBloomFilterPolicy(10, false));
+    table_options.block_size = opts.block_size;
+    table_options.index_type = opts.index_type;
+    if (opts.filter == "bloom") {
+        table_options.filter_policy.reset(NewBloomFilterPolicy(opts.bits_per_key, false));
+    } else if (opts.filter == "ribbon") {
+        table_options.filter_policy.reset(NewRibbonFilterPolicy(opts.bits_per_key));
+    }
+    table_options.partition_filters = opts.partition_filters;
+    table_options.metadata_block_size = opts.metadata_block_size;
+    if (opts.data_block_hash_index) {
+        table_options.data_block_index_type = BlockBasedTableOptions::kDataBlockBinaryAndHash;
+        table_options.data_block_hash_table_util_ratio = 0.75;
+    }
+    // From format version 4 index entries drop the value length, and an entry that
+    // shares a key prefix with the one before stores its block handle as a delta.
+    // Restart points share no prefix, so with an interval of 1 every handle is
+    // stored in full and nothing is delta encoded; larger intervals delta encode
+    // all entries between restart points.
+    if (opts.index_block_restart_interval > 0) {
+        table_options.index_block_restart_interval = opts.index_block_restart_interval;
+    }
     
     // Set compression type
     options.compression = compression_type;
+    if (opts.zstd_dict_bytes > 0) {
+        options.compression_opts.max_dict_bytes = opts.zstd_dict_bytes;
+        options.compression_opts.zstd_max_train_bytes = 100 * opts.zstd_dict_bytes;
+    }
+    if (opts.prefix_len > 0) {
+        options.prefix_extractor.reset(NewFixedPrefixTransform(opts.prefix_len));
+    }
     
     options.table_factory.reset(NewBlockBasedTableFactory(table_options));
     
@@ -72,19 +255,61 @@ bool generate_sst_file(int format_version, ChecksumType checksum_type,
         return false;
     }
     
-    // Generate test data - 50 key-value pairs
     std::string checksum_name = checksum_names[checksum_type];
     std::string compression_name = compression_names[compression_type];
+    CorpusGenerator corpus(opts);
+    uint64_t progress_step = std::max<uint64_t>(opts.num_keys / 10, 1000000);
+    
+    // Range tombstones each cover one key, [key_i, key_i+1), spread evenly
+    uint64_t tombstone_stride = opts.range_tombstones > 0
+        ? std::max<uint64_t>(opts.num_keys / opts.range_tombstones, 2) : 0;
+    uint64_t tombstones_written = 0;
+    std::string tombstone_begin;
     
-    for (int i = 0; i < 50; ++i) {
-        std::string key = format_key(i);
-        std::string value = format_value(format_version, checksum_name, compression_name, i);
+    for (uint64_t i = 0; i < opts.num_keys; ++i) {
+        std::string key;
+        std::string value;
+        if (opts.corpus_mode) {
+            key = corpus.next_key();
+            value = corpus.next_value();
+        } else {
+            key = format_key(static_cast<int>(i));
+            value = format_value(format_version, checksum_name, compression_name, static_cast<int>(i));
+        }
         
         status = writer.Put(key, value);
         if (!status.ok()) {
             std::cerr << "Failed to put key-value pair: " << status.ToString() << std::endl;
             return false;
         }
+        
+        if (!tombstone_begin.empty()) {
+            status = writer.DeleteRange(tombstone_begin, key);
+            if (!status.ok()) {
+                std::cerr << "Failed to add range tombstone: " << status.ToString() << std::endl;
+                return false;
+            }
+            tombstone_begin.clear();
+            tombstones_written++;
+        }
+        if (tombstone_stride > 0 && i % tombstone_stride == 0
+            && tombstones_written < opts.range_tombstones) {
+            tombstone_begin = key;
+        }
+        
+        if ((i + 1) % progress_step == 0) {
+            std::cout << "  " << (i + 1) << "/" << opts.num_keys << " keys" << std::endl;
+        }
+    }
+    
+    // A tombstone starting at the last key has no next key to end at; the key
+    // with a zero byte appended is the smallest one after it
+    if (!tombstone_begin.empty()) {
+        status = writer.DeleteRange(tombstone_begin, tombstone_begin + std::string(1, '\0'));
+        if (!status.ok()) {
+            std::cerr << "Failed to add range tombstone: " << status.ToString() << std::endl;
+            return false;
+        }
     }
     
     status = writer.Finish();
@@ -108,31 +333,78 @@ void print_usage(const char* program_name) {
     std::cout << "  --version V    Generate only for format version V (5,6,7)\n";
     std::cout << "  --checksum C   Generate only for checksum type C (nocsum,crc32c,xxhash,xxhash64,xxh3)\n";
     std::cout << "  --compression C Generate only for compression type C (none,snappy,lz4,zstd)\n";
+    std::cout << "  --output-dir D Write files below D (default: sst_files, or corpus in corpus mode)\n";
     std::cout << "  --help         Show this help\n";
     std::cout << "\n";
+    std::cout << "Corpus mode (enabled by any of these):\n";
+    std::cout << "  --num-keys N      Number of keys (default: 50)\n";
+    std::cout << "  --key-size N      Key size in bytes, at least 16 (default: 16)\n";
+    std::cout << "  --value-size N    Value size in bytes (default: 100)\n";
+    std::cout << "  --distribution D  Key distribution: sequential, uniform, zipfian, prefix (default: sequential)\n";
+    std::cout << "  --seed N          Seed for keys and values (default: 42)\n";
+    std::cout << "\n";
+    std::cout << "Table options:\n";
+    std::cout << "  --block-size N    Data block size in bytes (default: 4096)\n";
+    std::cout << "  --index-type T    binary, binary_first_key or partitioned (default: binary)\n";
+    std::cout << "  --filter F        none, bloom or ribbon (default: bloom)\n";
+    std::cout << "  --bits-per-key N  Filter bits per key, Bloom equivalent for ribbon (default: 10)\n";
+    std::cout << "  --partition-filters       Partition the filter, needs --index-type partitioned\n";
+    std::cout << "  --metadata-block-size N   Index and filter partition size (default: 4096)\n";
+    std::cout << "  --data-block-hash-index   Add a hash index to data blocks\n";
+    std::cout << "  --zstd-dict-bytes N       Compression dictionary size, 0 for none (default: 0)\n";
+    std::cout << "  --index-restart-interval N  Index block restart interval (default: RocksDB's, 1)\n";
+    std::cout << "  --prefix-len N            Fixed prefix extractor, for prefix filters (default: none)\n";
+    std::cout << "  --range-tombstones N      Number of range tombstones, each covering one key (default: 0)\n";
+    std::cout << "\n";
     std::cout << "Default: Generates 60 files (3 versions × 5 checksums × 4 compressions)\n";
 }
 
-std::string build_filename(int version, ChecksumType checksum, CompressionType compression) {
+// Non-default data set and table options, appended to file names so corpora
+// never overwrite the fixtures or each other
+std::string options_suffix(const GeneratorOptions& opts) {
+    std::ostringstream oss;
+    if (opts.corpus_mode) {
+        oss << "_" << distribution_names[opts.distribution] << "_" << opts.num_keys
+            << "_k" << opts.key_size << "_v" << opts.value_size;
+    }
+    if (opts.block_size != 4096) oss << "_bs" << opts.block_size;
+    if (opts.index_type != BlockBasedTableOptions::kBinarySearch) {
+        oss << "_" << index_type_names[opts.index_type];
+    }
+    if (opts.filter != "bloom") oss << "_" << opts.filter << "filter";
+    if (opts.filter != "none" && opts.bits_per_key != 10) oss << "_bits" << opts.bits_per_key;
+    if (opts.partition_filters) oss << "_partfilter";
+    if (opts.metadata_block_size != 4096) oss << "_meta" << opts.metadata_block_size;
+    if (opts.data_block_hash_index) oss << "_hashindex";
+    if (opts.zstd_dict_bytes > 0) oss << "_dict" << opts.zstd_dict_bytes;
+    if (opts.index_block_restart_interval > 0) oss << "_irestart" << opts.index_block_restart_interval;
+    if (opts.prefix_len > 0) oss << "_prefix" << opts.prefix_len;
+    if (opts.range_tombstones > 0) oss << "_rangedel" << opts.range_tombstones;
+    return oss.str();
+}
+
+std::string build_filename(int version, ChecksumType checksum, CompressionType compression,
+                           const GeneratorOptions& opts) {
     std::ostringstream oss;
-    oss << "sst_files/v" << version << "/" 
+    oss << opts.output_dir << "/v" << version << "/" 
         << "v" << version << "_" 
         << checksum_names[checksum] << "_" 
-        << compression_names[compression] << ".sst";
+        << compression_names[compression] << options_suffix(opts) << ".sst";
     return oss.str();
 }
 
-void create_directories() {
-    std::filesystem::create_directories("sst_files/v5");
-    std::filesystem::create_directories("sst_files/v6");
-    std::filesystem::create_directories("sst_files/v7");
+void create_directories(const std::vector<int>& versions, const GeneratorOptions& opts) {
+    for (int version : versions) {
+        std::filesystem::create_directories(opts.output_dir + "/v" + std::to_string(version));
+    }
 }
 
 bool generate_matrix(const std::vector<int>& versions,
                      const std::vector<ChecksumType>& checksums,
-                     const std::vector<CompressionType>& compressions) {
+                     const std::vector<CompressionType>& compressions,
+                     const GeneratorOptions& opts) {
     
-    create_directories();
+    create_directories(versions, opts);
     
     int total = versions.size() * checksums.size() * compressions.size();
     int current = 0;
@@ -145,10 +417,10 @@ bool generate_matrix(const std::vector<int>& versions,
             for (CompressionType compression : compressions) {
                 current++;
                 
-                std::string filename = build_filename(version, checksum, compression);
+                std::string filename = build_filename(version, checksum, compression, opts);
                 std::cout << "[" << current << "/" << total << "] ";
                 
-                if (!generate_sst_file(version, checksum, compression, filename)) {
+                if (!generate_sst_file(version, checksum, compression, filename, opts)) {
                     std::cerr << "FAILED: " << filename << std::endl;
                     failed++;
                 } 
@@ -170,6 +442,7 @@ int main(int argc, char* argv[]) {
     std::vector<int> versions = {5, 6, 7};
     std::vector<ChecksumType> checksums = {ChecksumType::kNoChecksum, ChecksumType::kCRC32c, ChecksumType::kxxHash, ChecksumType::kxxHash64, ChecksumType::kXXH3};
     std::vector<CompressionType> compressions = {CompressionType::kNoCompression, CompressionType::kSnappyCompression, CompressionType::kLZ4Compression, CompressionType::kZSTD};
+    GeneratorOptions opts;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -210,11 +483,91 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Unknown compression type: " << compression << std::endl;
                 return 1;
             }
+        } else if (arg == "--output-dir" && i + 1 < argc) {
+            opts.output_dir = argv[++i];
+        } else if (arg == "--num-keys" && i + 1 < argc) {
+            opts.num_keys = std::strtoull(argv[++i], nullptr, 10);
+            opts.corpus_mode = true;
+        } else if (arg == "--key-size" && i + 1 < argc) {
+            opts.key_size = std::strtoull(argv[++i], nullptr, 10);
+            opts.corpus_mode = true;
+        } else if (arg == "--value-size" && i + 1 < argc) {
+            opts.value_size = std::strtoull(argv[++i], nullptr, 10);
+            opts.corpus_mode = true;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            opts.seed = std::strtoull(argv[++i], nullptr, 10);
+            opts.corpus_mode = true;
+        } else if (arg == "--distribution" && i + 1 < argc) {
+            std::string distribution = argv[++i];
+            if (distribution == "sequential") opts.distribution = KeyDistribution::kSequential;
+            else if (distribution == "uniform") opts.distribution = KeyDistribution::kUniform;
+            else if (distribution == "zipfian") opts.distribution = KeyDistribution::kZipfian;
+            else if (distribution == "prefix") opts.distribution = KeyDistribution::kSharedPrefix;
+            else {
+                std::cerr << "Unknown key distribution: " << distribution << std::endl;
+                return 1;
+            }
+            opts.corpus_mode = true;
+        } else if (arg == "--block-size" && i + 1 < argc) {
+            opts.block_size = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--index-type" && i + 1 < argc) {
+            std::string index_type = argv[++i];
+            if (index_type == "binary") opts.index_type = BlockBasedTableOptions::kBinarySearch;
+            else if (index_type == "binary_first_key") opts.index_type = BlockBasedTableOptions::kBinarySearchWithFirstKey;
+            else if (index_type == "partitioned") opts.index_type = BlockBasedTableOptions::kTwoLevelIndexSearch;
+            else {
+                std::cerr << "Unknown index type: " << index_type << std::endl;
+                return 1;
+            }
+        } else if (arg == "--filter" && i + 1 < argc) {
+            opts.filter = argv[++i];
+            if (opts.filter != "none" && opts.filter != "bloom" && opts.filter != "ribbon") {
+                std::cerr << "Unknown filter: " << opts.filter << std::endl;
+                return 1;
+            }
+        } else if (arg == "--bits-per-key" && i + 1 < argc) {
+            opts.bits_per_key = std::atof(argv[++i]);
+        } else if (arg == "--partition-filters") {
+            opts.partition_filters = true;
+        } else if (arg == "--metadata-block-size" && i + 1 < argc) {
+            opts.metadata_block_size = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--data-block-hash-index") {
+            opts.data_block_hash_index = true;
+        } else if (arg == "--zstd-dict-bytes" && i + 1 < argc) {
+            opts.zstd_dict_bytes = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--index-restart-interval" && i + 1 < argc) {
+            opts.index_block_restart_interval = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--prefix-len" && i + 1 < argc) {
+            opts.prefix_len = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--range-tombstones" && i + 1 < argc) {
+            opts.range_tombstones = std::strtoull(argv[++i], nullptr, 10);
+        }
+    }
+    
+    if (opts.output_dir.empty()) {
+        opts.output_dir = opts.corpus_mode ? "corpus" : "sst_files";
+    }
+    if (opts.partition_filters && opts.index_type != BlockBasedTableOptions::kTwoLevelIndexSearch) {
+        std::cerr << "--partition-filters needs --index-type partitioned" << std::endl;
+        return 1;
+    }
+    if (opts.corpus_mode) {
+        if (opts.num_keys == 0) {
+            std::cerr << "--num-keys must be positive" << std::endl;
+            return 1;
+        }
+        if (opts.key_size < 16) {
+            std::cerr << "--key-size must be at least 16" << std::endl;
+            return 1;
+        }
+        if (opts.distribution == KeyDistribution::kSharedPrefix && opts.key_size < 32) {
+            std::cerr << "--distribution prefix needs --key-size of at least 32" << std::endl;
+            return 1;
         }
     }
     
     std::cout << "Generating RocksDB SST fixture matrix..." << std::endl;
     
-    bool success = generate_matrix(versions, checksums, compressions);
+    bool success = generate_matrix(versions, checksums, compressions, opts);
     return success ? 0 : 1;
-}
\ No newline at end of file
+}
@@ -0,0 +1,279 @@
+// Ingestion gate for SST files written by the rocksdb-fileformat crate.
+//
+// Each file is checked with RocksDB's own checksum verification, ingested into a
+// scratch database with IngestExternalFile, and read back. The harness reports
+// per-file ingest latency, the latency of the first seek and point gets after
+// ingestion, and a final whole-database checksum verification, as JSON on
+// stdout. Any file RocksDB refuses fails the run, so it doubles as a
+// compatibility check for the writer's filters, properties and index.
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+#include <rocksdb/sst_file_reader.h>
+#include <rocksdb/iterator.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_json.h"
+
+using namespace rocksdb;
+using Clock = std::chrono::steady_clock;
+
+struct IngestOptions {
+    std::string db_path;
+    bool keep_db = false;
+    bool move_files = false;
+    std::vector<std::string> files;
+};
+
+uint64_t elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+struct FileResult {
+    std::string path;
+    uint64_t file_size = 0;
+    uint64_t num_entries = 0;
+    uint64_t index_size = 0;
+    uint64_t filter_size = 0;
+    uint64_t verify_ns = 0;
+    uint64_t ingest_ns = 0;
+    uint64_t first_seek_ns = 0;
+    uint64_t first_get_ns = 0;
+    uint64_t miss_get_ns = 0;
+    std::string error;
+
+    std::string to_json() const {
+        std::ostringstream oss;
+        oss << "    {\"path\": " << json_string(path)
+            << ", \"file_size\": " << file_size
+            << ", \"num_entries\": " << num_entries
+            << ", \"index_size\": " << index_size
+            << ", \"filter_size\": " << filter_size
+            << ", \"verify_ns\": " << verify_ns
+            << ", \"ingest_ns\": " << ingest_ns
+            << ", \"first_seek_ns\": " << first_seek_ns
+            << ", \"first_get_ns\": " << first_get_ns
+            << ", \"miss_get_ns\": " << miss_get_ns
+            << ", \"ok\": " << (error.empty() ? "true" : "false");
+        if (!error.empty()) oss << ", \"error\": " << json_string(error);
+        oss << "}";
+        return oss.str();
+    }
+};
+
+// Checksums and properties as RocksDB reads them, before the file is ingested.
+// Also returns the file's first key, the one read back after ingestion.
+bool inspect_file(const Options& options, FileResult* result, std::string* first_key) {
+    SstFileReader reader(options);
+    Status status = reader.Open(result->path);
+    if (!status.ok()) {
+        result->error = "open: " + status.ToString();
+        return false;
+    }
+
+    auto start = Clock::now();
+    status = reader.VerifyChecksum();
+    result->verify_ns = elapsed_ns(start);
+    if (!status.ok()) {
+        result->error = "verify: " + status.ToString();
+        return false;
+    }
+
+    auto properties = reader.GetTableProperties();
+    result->num_entries = properties->num_entries;
+    result->index_size = properties->index_size;
+    result->filter_size = properties->filter_size;
+
+    std::unique_ptr<Iterator> it(reader.NewIterator(ReadOptions()));
+    it->SeekToFirst();
+    if (!it->Valid()) {
+        result->error = it->status().ok() ? "file has no entries" : "scan: " + it->status().ToString();
+        return false;
+    }
+    *first_key = it->key().ToString();
+    return true;
+}
+
+bool ingest_and_read(DB* db, FileResult* result, const std::string& first_key,
+                     const IngestOptions& opts) {
+    IngestExternalFileOptions ingest_options;
+    ingest_options.move_files = opts.move_files;
+    ingest_options.verify_checksums_before_ingest = true;
+
+    auto start = Clock::now();
+    Status status = db->IngestExternalFile({result->path}, ingest_options);
+    result->ingest_ns = elapsed_ns(start);
+    if (!status.ok()) {
+        result->error = "ingest: " + status.ToString();
+        return false;
+    }
+
+    // Cold reads: the first ones after ingestion open the table and load its
+    // index and filter
+    ReadOptions read_options;
+    start = Clock::now();
+    std::unique_ptr<Iterator> it(db->NewIterator(read_options));
+    it->Seek(first_key);
+    bool found = it->Valid() && it->key().compare(first_key) == 0;
+    result->first_seek_ns = elapsed_ns(start);
+    if (!found) {
+        result->error = "first key not found after ingestion";
+        return false;
+    }
+
+    std::string value;
+    start = Clock::now();
+    status = db->Get(read_options, first_key, &value);
+    result->first_get_ns = elapsed_ns(start);
+    if (!status.ok()) {
+        result->error = "get: " + status.ToString();
+        return false;
+    }
+
+    // A zero byte suffix sorts right after the first key, so this is a miss
+    // that the filter may answer
+    start = Clock::now();
+    status = db->Get(read_options, first_key + std::string(1, '\0'), &value);
+    result->miss_get_ns = elapsed_ns(start);
+    if (!status.ok() && !status.IsNotFound()) {
+        result->error = "get: " + status.ToString();
+        return false;
+    }
+    return true;
+}
+
+void print_usage(const char* program_name) {
+    std::cerr << "Usage: " << program_name << " [options] FILE.sst...\n";
+    std::cerr << "Options:\n";
+    std::cerr << "  --db DIR       Empty or missing directory to create the database in\n";
+    std::cerr << "                 (default: a new temporary directory)\n";
+    std::cerr << "  --keep-db      Keep the database afterwards\n";
+    std::cerr << "  --move-files   Move instead of copy the files into the database\n";
+    std::cerr << "                 (requires --keep-db, which then holds the only copies)\n";
+    std::cerr << "  --help         Show this help\n";
+    std::cerr << "\n";
+    std::cerr << "Files are ingested one at a time, in the given order.\n";
+}
+
+int main(int argc, char* argv[]) {
+    IngestOptions opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--db" && i + 1 < argc) {
+            opts.db_path = argv[++i];
+        } else if (arg == "--keep-db") {
+            opts.keep_db = true;
+        } else if (arg == "--move-files") {
+            opts.move_files = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        } else {
+            opts.files.push_back(arg);
+        }
+    }
+
+    if (opts.files.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    // Moved files are unlinked from their original paths, so destroying the
+    // database at exit would delete the only copies
+    if (opts.move_files && !opts.keep_db) {
+        std::cerr << "--move-files requires --keep-db" << std::endl;
+        return 1;
+    }
+    // Only a directory the harness created is ever destroyed. A --db directory
+    // must be empty or missing, so an existing database is never touched.
+    bool created_db = false;
+    if (opts.db_path.empty()) {
+        std::string pattern =
+            (std::filesystem::temp_directory_path() / "ingest_bench_XXXXXX").string();
+        std::vector<char> path(pattern.begin(), pattern.end());
+        path.push_back('\0');
+        if (mkdtemp(path.data()) == nullptr) {
+            std::cerr << "Failed to create a temporary directory from " << pattern << std::endl;
+            return 1;
+        }
+        opts.db_path = path.data();
+        created_db = true;
+    } else {
+        std::error_code ec;
+        if (std::filesystem::exists(opts.db_path, ec)) {
+            if (!std::filesystem::is_directory(opts.db_path, ec)
+                || !std::filesystem::is_empty(opts.db_path, ec)) {
+                std::cerr << "Refusing to use " << opts.db_path
+                          << ": --db must be an empty or missing directory" << std::endl;
+                return 1;
+            }
+        } else {
+            created_db = true;
+        }
+    }
+
+    Options options;
+    options.create_if_missing = true;
+    auto destroy_db = [&]() {
+        if (!created_db || opts.keep_db) return;
+        DestroyDB(opts.db_path, options);
+        std::error_code ec;
+        std::filesystem::remove_all(opts.db_path, ec);
+    };
+
+    DB* raw_db = nullptr;
+    Status status = DB::Open(options, opts.db_path, &raw_db);
+    if (!status.ok()) {
+        std::cerr << "Failed to open " << opts.db_path << ": " << status.ToString() << std::endl;
+        destroy_db();
+        return 1;
+    }
+    std::unique_ptr<DB> db(raw_db);
+
+    int failed = 0;
+    std::cout << "{\n  \"files\": [\n";
+    for (size_t i = 0; i < opts.files.size(); ++i) {
+        FileResult result;
+        result.path = opts.files[i];
+        std::error_code ec;
+        result.file_size = std::filesystem::file_size(result.path, ec);
+
+        std::string first_key;
+        if (!inspect_file(options, &result, &first_key)
+            || !ingest_and_read(db.get(), &result, first_key, opts)) {
+            failed++;
+        }
+        std::cout << result.to_json() << (i + 1 < opts.files.size() ? ",\n" : "\n");
+    }
+
+    auto start = Clock::now();
+    status = db->VerifyChecksum();
+    uint64_t db_verify_ns = elapsed_ns(start);
+    if (!status.ok()) failed++;
+
+    std::cout << "  ],\n"
+              << "  \"db_verify\": {\"ok\": " << (status.ok() ? "true" : "false")
+              << ", \"ns\": " << db_verify_ns;
+    if (!status.ok()) std::cout << ", \"error\": " << json_string(status.ToString());
+    std::cout << "},\n"
+              << "  \"failed\": " << failed << "\n}" << std::endl;
+
+    db->Close();
+    db.reset();
+    destroy_db();
+    if (opts.keep_db) std::cerr << "Database kept in " << opts.db_path << std::endl;
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,737 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Asynchronous block reads.
+//!
+//! Block reads are handed to a dedicated I/O thread which submits them through
+//! io_uring on Linux, so many reads can be in flight at once without blocking the
+//! caller. Where io_uring is unavailable the same thread serves reads with
+//! positional reads instead. The returned futures are runtime agnostic: they are
+//! completed by the I/O thread and wake whichever executor polled them.
+
+use crate::block_handle::BlockHandle;
+use crate::compression::DecompressionDict;
+use crate::data_block::{DataBlock, DataBlockCursor};
+use crate::direct_io;
+use crate::error::{Error, Result};
+use crate::index_block::DecodedIndex;
+use crate::iterator::{group_keys_by_block, lookup_in_block};
+use crate::perf_context::perf_count;
+use crate::sst_reader::SstReader;
+use crate::statistics::{Histogram, Statistics, StopWatch, Ticker};
+use crate::types::{CompressionType, ReadOptions};
+use std::collections::VecDeque;
+use std::fs::File;
+use std::future::Future;
+use std::io;
+use std::path::Path;
+use std::pin::Pin;
+use std::sync::mpsc::{Receiver, Sender, channel};
+use std::sync::{Arc, Mutex};
+use std::task::{Context, Poll, Waker};
+use std::thread::JoinHandle;
+
+/// How block reads are issued by an [`AsyncSstReader`]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum IoBackend {
+    /// Reads are submitted through an io_uring instance
+    IoUring,
+    /// Reads are served one at a time with positional reads
+    Blocking,
+}
+
+#[derive(Debug, Clone)]
+pub struct AsyncReadOptions {
+    /// Maximum number of reads the I/O thread keeps in flight
+    pub queue_depth: u32,
+    /// Use io_uring when the platform supports it
+    pub use_io_uring: bool,
+    /// Shared tickers and histograms to record into, if any
+    pub statistics: Option<Arc<Statistics>>,
+}
+
+impl Default for AsyncReadOptions {
+    fn default() -> Self {
+        AsyncReadOptions {
+            queue_depth: 64,
+            use_io_uring: true,
+            statistics: None,
+        }
+    }
+}
+
+#[derive(Default)]
+struct ReadState {
+    result: Option<Result<Vec<u8>>>,
+    waker: Option<Waker>,
+}
+
+type SharedReadState = Arc<Mutex<ReadState>>;
+
+fn complete(state: &SharedReadState, result: Result<Vec<u8>>) {
+    let waker = {
+        let mut state = state.lock().unwrap();
+        state.result = Some(result);
+        state.waker.take()
+    };
+    if let Some(waker) = waker {
+        waker.wake();
+    }
+}
+
+/// A queued block read. A request dropped before it is completed, e.g. while still
+/// in the channel when the I/O thread exits, fails its future rather than leaving
+/// it pending forever.
+struct ReadRequest {
+    offset: u64,
+    len: usize,
+    state: Option<SharedReadState>,
+}
+
+impl ReadRequest {
+    fn complete(mut self, result: Result<Vec<u8>>) {
+        if let Some(state) = self.state.take() {
+            complete(&state, result);
+        }
+    }
+
+    /// The read's state, for the caller to complete instead
+    fn into_state(mut self) -> SharedReadState {
+        self.state.take().expect("read request completed twice")
+    }
+}
+
+impl Drop for ReadRequest {
+    fn drop(&mut self) {
+        if let Some(state) = self.state.take() {
+            complete(&state, Err(io_thread_exited()));
+        }
+    }
+}
+
+fn io_thread_exited() -> Error {
+    Error::Io(io::Error::new(
+        io::ErrorKind::BrokenPipe,
+        "I/O thread has exited",
+    ))
+}
+
+/// Fail every read still waiting in the channel with `error`
+fn fail_queued(error: &io::Error, receiver: &Receiver<ReadRequest>) {
+    for request in receiver.try_iter() {
+        request.complete(Err(Error::Io(io::Error::new(
+            error.kind(),
+            error.to_string(),
+        ))));
+    }
+}
+
+/// A block read that has already been submitted. Dropping it does not cancel the read.
+pub struct BlockReadFuture {
+    state: SharedReadState,
+}
+
+impl BlockReadFuture {
+    fn ready(result: Result<Vec<u8>>) -> Self {
+        BlockReadFuture {
+            state: Arc::new(Mutex::new(ReadState {
+                result: Some(result),
+                waker: None,
+            })),
+        }
+    }
+}
+
+impl Future for BlockReadFuture {
+    type Output = Result<Vec<u8>>;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        let mut state = self.state.lock().unwrap();
+        match state.result.take() {
+            Some(result) => Poll::Ready(result),
+            None => {
+                state.waker = Some(cx.waker().clone());
+                Poll::Pending
+            }
+        }
+    }
+}
+
+/// Owns the I/O thread; dropping it waits for outstanding reads to finish
+struct BlockIo {
+    sender: Option<Sender<ReadRequest>>,
+    worker: Option<JoinHandle<()>>,
+    backend: IoBackend,
+}
+
+impl BlockIo {
+    fn start(file: File, options: &AsyncReadOptions) -> Result<Self> {
+        let (sender, receiver) = channel();
+
+        if options.use_io_uring {
+            #[cfg(target_os = "linux")]
+            if let Ok(ring) = io_uring::IoUring::new(options.queue_depth.max(1)) {
+                let worker = std::thread::Builder::new()
+                    .name("sst-io-uring".to_string())
+                    .spawn(move || run_io_uring(ring, file, receiver))?;
+                return Ok(BlockIo {
+                    sender: Some(sender),
+                    worker: Some(worker),
+                    backend: IoBackend::IoUring,
+                });
+            }
+        }
+
+        let worker = std::thread::Builder::new()
+            .name("sst-io".to_string())
+            .spawn(move || run_blocking(file, receiver))?;
+        Ok(BlockIo {
+            sender: Some(sender),
+            worker: Some(worker),
+            backend: IoBackend::Blocking,
+        })
+    }
+
+    fn read(&self, offset: u64, len: usize) -> BlockReadFuture {
+        let state = SharedReadState::default();
+        let request = ReadRequest {
+            offset,
+            len,
+            state: Some(state.clone()),
+        };
+
+        let sent = self
+            .sender
+            .as_ref()
+            .is_some_and(|sender| sender.send(request).is_ok());
+        if !sent {
+            return BlockReadFuture::ready(Err(io_thread_exited()));
+        }
+
+        BlockReadFuture { state }
+    }
+}
+
+impl Drop for BlockIo {
+    fn drop(&mut self) {
+        self.sender.take();
+        if let Some(worker) = self.worker.take() {
+            let _ = worker.join();
+        }
+    }
+}
+
+fn run_blocking(file: File, receiver: Receiver<ReadRequest>) {
+    for request in receiver {
+        let mut buffer = vec![0u8; request.len];
+        let result = direct_io::pread_exact(&file, &mut buffer, request.offset)
+            .map(|()| buffer)
+            .map_err(Error::from);
+        request.complete(result);
+    }
+}
+
+#[cfg(target_os = "linux")]
+fn run_io_uring(mut ring: io_uring::IoUring, file: File, receiver: Receiver<ReadRequest>) {
+    use std::collections::HashMap;
+    use std::os::fd::{AsRawFd, RawFd};
+    use std::sync::mpsc::TryRecvError;
+
+    struct InFlight {
+        buffer: Vec<u8>,
+        filled: usize,
+        offset: u64,
+        state: SharedReadState,
+    }
+
+    /// Queue a read of the unfilled part of `read`, returning false if the
+    /// submission queue is full
+    fn push_read(ring: &mut io_uring::IoUring, fd: RawFd, read: &mut InFlight, id: u64) -> bool {
+        let remaining = &mut read.buffer[read.filled..];
+        let entry = io_uring::opcode::Read::new(
+            io_uring::types::Fd(fd),
+            remaining.as_mut_ptr(),
+            remaining.len() as u32,
+        )
+        .offset(read.offset + read.filled as u64)
+        .build()
+        .user_data(id);
+        // SAFETY: the buffer's heap allocation is owned by `in_flight` and left
+        // untouched until its completion is reaped
+        unsafe { ring.submission().push(&entry).is_ok() }
+    }
+
+    /// Fail the reads in flight, those waiting for a free slot and those still in
+    /// the channel
+    fn fail_all(
+        error: &io::Error,
+        in_flight: &mut HashMap<u64, InFlight>,
+        pending: &mut VecDeque<ReadRequest>,
+        receiver: &Receiver<ReadRequest>,
+    ) {
+        // The kernel may still own the buffers, so leak rather than free them
+        for (_, read) in in_flight.drain() {
+            std::mem::forget(read.buffer);
+            complete(
+                &read.state,
+                Err(Error::Io(io::Error::new(error.kind(), error.to_string()))),
+            );
+        }
+        for request in pending.drain(..) {
+            request.complete(Err(Error::Io(io::Error::new(
+                error.kind(),
+                error.to_string(),
+            ))));
+        }
+        fail_queued(error, receiver);
+    }
+
+    let fd = file.as_raw_fd();
+    let capacity = ring.params().sq_entries() as usize;
+    let mut pending: VecDeque<ReadRequest> = VecDeque::new();
+    let mut in_flight: HashMap<u64, InFlight> = HashMap::new();
+    // Reads in `in_flight` that still have to be queued, such as the remainder of a
+    // short read
+    let mut unqueued: VecDeque<u64> = VecDeque::new();
+    // Reads the kernel has accepted and not yet completed
+    let mut in_kernel = 0usize;
+    let mut next_id = 0u64;
+    let mut disconnected = false;
+
+    loop {
+        if in_flight.is_empty() && pending.is_empty() {
+            if disconnected {
+                break;
+            }
+            match receiver.recv() {
+                Ok(request) => pending.push_back(request),
+                Err(_) => break,
+            }
+        }
+        loop {
+            match receiver.try_recv() {
+                Ok(request) => pending.push_back(request),
+                Err(TryRecvError::Empty) => break,
+                Err(TryRecvError::Disconnected) => {
+                    disconnected = true;
+                    break;
+                }
+            }
+        }
+
+        // Reads already in flight go first; they count against the capacity already
+        while let Some(&id) = unqueued.front() {
+            let read = in_flight.get_mut(&id).expect("unqueued read is in flight");
+            if !push_read(&mut ring, fd, read, id) {
+                break;
+            }
+            unqueued.pop_front();
+        }
+        while unqueued.is_empty() && in_flight.len() < capacity {
+            let Some(request) = pending.pop_front() else {
+                break;
+            };
+            let mut read = InFlight {
+                buffer: vec![0u8; request.len],
+                filled: 0,
+                offset: request.offset,
+                state: request.into_state(),
+            };
+            if read.buffer.is_empty() {
+                complete(&read.state, Ok(read.buffer));
+                continue;
+            }
+
+            let id = next_id;
+            next_id += 1;
+            if !push_read(&mut ring, fd, &mut read, id) {
+                unqueued.push_back(id);
+            }
+            in_flight.insert(id, read);
+        }
+
+        // Hand the queued reads to the kernel, and wait for a completion only when
+        // the kernel holds a read that will produce one. Entries the kernel does not
+        // accept stay queued and go with the next submit.
+        let queued = ring.submission().len();
+        let want = usize::from(in_kernel > 0);
+        if queued > 0 || want > 0 {
+            let submitted = loop {
+                match ring.submit_and_wait(want) {
+                    Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+                    result => break result,
+                }
+            };
+            match submitted {
+                Ok(submitted) => {
+                    in_kernel += submitted;
+                    if in_kernel == 0 {
+                        let error =
+                            io::Error::other("io_uring accepted none of the queued block reads");
+                        fail_all(&error, &mut in_flight, &mut pending, &receiver);
+                        break;
+                    }
+                }
+                // The completion queue is full or the kernel is short of resources:
+                // reap what has completed and retry
+                Err(e)
+                    if in_kernel > 0
+                        && matches!(e.raw_os_error(), Some(libc::EBUSY | libc::EAGAIN)) => {}
+                Err(e) => {
+                    fail_all(&e, &mut in_flight, &mut pending, &receiver);
+                    break;
+                }
+            }
+        }
+
+        for completion in ring.completion() {
+            in_kernel -= 1;
+            let Some(read) = in_flight.get_mut(&completion.user_data()) else {
+                continue;
+            };
+
+            let result = completion.result();
+            if result <= 0 {
+                let err = if result < 0 {
+                    io::Error::from_raw_os_error(-result)
+                } else {
+                    io::Error::new(io::ErrorKind::UnexpectedEof, "Block read past end of file")
+                };
+                let read = in_flight.remove(&completion.user_data()).unwrap();
+                complete(&read.state, Err(Error::Io(err)));
+                continue;
+            }
+
+            read.filled += result as usize;
+            if read.filled == read.buffer.len() {
+                let read = in_flight.remove(&completion.user_data()).unwrap();
+                complete(&read.state, Ok(read.buffer));
+            } else {
+                // Short read: queue the remainder under the same id
+                unqueued.push_back(completion.user_data());
+            }
+        }
+    }
+}
+
+/// SST reader whose block reads are asynchronous.
+///
+/// The footer and index block are loaded with blocking reads in `open`; every data
+/// block read afterwards goes through the I/O thread.
+pub struct AsyncSstReader {
+    index: DecodedIndex,
+    compression_type: CompressionType,
+    compression_dict: Option<Arc<DecompressionDict>>,
+    file_size: u64,
+    io: BlockIo,
+    statistics: Option<Arc<Statistics>>,
+}
+
+impl AsyncSstReader {
+    pub fn open<P: AsRef<Path>>(path: P, compression_type: CompressionType) -> Result<Self> {
+        Self::open_with_options(path, compression_type, &AsyncReadOptions::default())
+    }
+
+    pub fn open_with_options<P: AsRef<Path>>(
+        path: P,
+        compression_type: CompressionType,
+        options: &AsyncReadOptions,
+    ) -> Result<Self> {
+        let read_options = ReadOptions {
+            statistics: options.statistics.clone(),
+            ..ReadOptions::default()
+        };
+        let mut sst_reader = SstReader::open_with_options(&path, &read_options)?;
+        let index = sst_reader.read_index_block()?.decode_entries()?;
+        let io = BlockIo::start(File::open(&path)?, options)?;
+
+        Ok(AsyncSstReader {
+            index,
+            compression_type,
+            compression_dict: sst_reader.compression_dict().cloned(),
+            file_size: sst_reader.file_size(),
+            io,
+            statistics: options.statistics.clone(),
+        })
+    }
+
+    pub fn backend(&self) -> IoBackend {
+        self.io.backend
+    }
+
+    pub fn block_count(&self) -> usize {
+        self.index.len()
+    }
+
+    /// Memory held by the decoded index and the compression dictionary
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>()
+            + self.index.approximate_memory_usage()
+            + self
+                .compression_dict
+                .as_ref()
+                .map_or(0, |dict| dict.approximate_memory_usage())
+    }
+
+    /// Submit a read of the raw block at `handle`. The read is in flight once this
+    /// returns, whether or not the future is polled.
+    pub fn read_block(&self, handle: &BlockHandle) -> BlockReadFuture {
+        if handle.offset + handle.size > self.file_size {
+            return BlockReadFuture::ready(Err(Error::InvalidBlockHandle(format!(
+                "Block handle {}+{} extends beyond file of {} bytes",
+                handle.offset, handle.size, self.file_size
+            ))));
+        }
+        self.io.read(handle.offset, handle.size as usize)
+    }
+
+    fn decode_block(&self, block: &[u8]) -> Result<DataBlock> {
+        // Reads complete on the I/O thread, so blocks are counted where they are
+        // consumed to land in the caller's perf context
+        perf_count(|context| {
+            context.block_read_count += 1;
+            context.block_read_byte += block.len() as u64;
+        });
+        if let Some(statistics) = self.statistics.as_deref() {
+            statistics.record_tick(Ticker::SstReadBytes, block.len() as u64);
+            statistics.record_in_histogram(Histogram::BlockReadSize, block.len() as u64);
+        }
+        DataBlock::decode(
+            block,
+            self.compression_type,
+            self.compression_dict.as_deref(),
+            self.statistics.as_deref(),
+        )
+    }
+
+    pub async fn get(&self, key: &[u8]) -> Result<Option<Vec<u8>>> {
+        let _stop_watch = StopWatch::start(self.statistics.as_deref(), Histogram::TableGetNanos);
+        self.get_impl(key).await
+    }
+
+    async fn get_impl(&self, key: &[u8]) -> Result<Option<Vec<u8>>> {
+        let block_index = self.index.block_index_for_key(key);
+        let Some(handle) = self.index.handles().get(block_index) else {
+            return Ok(None);
+        };
+
+        let block = self.read_block(handle).await?;
+        let mut results = [None];
+        lookup_in_block(self.decode_block(&block)?, &[key], &[0], &mut results)?;
+        let [result] = results;
+        Ok(result)
+    }
+
+    /// Look up a batch of keys, returning their values in input order. Reads for
+    /// every block involved are submitted together before any of them is awaited.
+    pub async fn multi_get(&self, keys: &[&[u8]]) -> Result<Vec<Option<Vec<u8>>>> {
+        let mut results = vec![None; keys.len()];
+        let groups = group_keys_by_block(&self.index, keys);
+
+        let reads: Vec<BlockReadFuture> = groups
+            .iter()
+            .map(|(block_index, _)| self.read_block(&self.index.handles()[*block_index]))
+            .collect();
+
+        for ((_, key_indexes), read) in groups.iter().zip(reads) {
+            let block = read.await?;
+            lookup_in_block(self.decode_block(&block)?, keys, key_indexes, &mut results)?;
+        }
+
+        Ok(results)
+    }
+
+    /// Iterate the table in order, keeping up to `readahead` block reads in flight
+    pub fn iter(&self, readahead: usize) -> AsyncSstIterator<'_> {
+        AsyncSstIterator {
+            reader: self,
+            readahead: readahead.max(1),
+            next_block_index: 0,
+            in_flight: VecDeque::new(),
+            current_block: None,
+        }
+    }
+}
+
+pub struct AsyncSstIterator<'a> {
+    reader: &'a AsyncSstReader,
+    readahead: usize,
+    next_block_index: usize,
+    in_flight: VecDeque<BlockReadFuture>,
+    current_block: Option<DataBlockCursor>,
+}
+
+impl AsyncSstIterator<'_> {
+    fn fill_readahead(&mut self) {
+        while self.in_flight.len() < self.readahead
+            && self.next_block_index < self.reader.index.len()
+        {
+            let handle = &self.reader.index.handles()[self.next_block_index];
+            self.in_flight.push_back(self.reader.read_block(handle));
+            self.next_block_index += 1;
+        }
+    }
+
+    pub async fn next_entry(&mut self) -> Option<Result<(Vec<u8>, Vec<u8>)>> {
+        loop {
+            if let Some(cursor) = self.current_block.as_mut() {
+                match cursor.next() {
+                    Ok(true) => {
+                        return cursor
+                            .key()
+                            .zip(cursor.value())
+                            .map(|(key, value)| Ok((key.to_vec(), value.to_vec())));
+                    }
+                    Ok(false) => self.current_block = None,
+                    Err(e) => {
+                        self.current_block = None;
+                        return Some(Err(e));
+                    }
+                }
+            }
+
+            self.fill_readahead();
+            let read = self.in_flight.pop_front()?;
+            self.fill_readahead();
+
+            let block = match read.await {
+                Ok(block) => block,
+                Err(e) => return Some(Err(e)),
+            };
+            match self.reader.decode_block(&block) {
+                Ok(data_block) => self.current_block = Some(DataBlockCursor::new(data_block)),
+                Err(e) => return Some(Err(e)),
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::iterator::SstEntryIterator;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::types::WriteOptions;
+    use std::task::Wake;
+    use tempfile::tempdir;
+
+    fn block_on<F: Future>(future: F) -> F::Output {
+        struct ThreadWaker(std::thread::Thread);
+        impl Wake for ThreadWaker {
+            fn wake(self: Arc<Self>) {
+                self.0.unpark();
+            }
+        }
+
+        let waker = Waker::from(Arc::new(ThreadWaker(std::thread::current())));
+        let mut cx = Context::from_waker(&waker);
+        let mut future = std::pin::pin!(future);
+        loop {
+            if let Poll::Ready(output) = future.as_mut().poll(&mut cx) {
+                return output;
+            }
+            std::thread::park();
+        }
+    }
+
+    #[test]
+    fn test_async_reader_matches_sync_reader() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("async.sst");
+
+        let opts = WriteOptions {
+            block_size: 256,
+            ..Default::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+        for i in 0..500 {
+            writer.put(
+                format!("key{:05}", i).as_bytes(),
+                format!("value{}", i).as_bytes(),
+            )?;
+        }
+        writer.finish()?;
+
+        let expected =
+            SstEntryIterator::new(SstReader::open(&path)?, CompressionType::None)?.collect_all()?;
+
+        // io_uring can be missing from the kernel or disabled by policy; only then
+        // is the blocking fallback expected
+        #[cfg(target_os = "linux")]
+        let io_uring_available = io_uring::IoUring::new(1).is_ok();
+        #[cfg(not(target_os = "linux"))]
+        let io_uring_available = false;
+
+        for use_io_uring in [true, false] {
+            // A queue shallower than the readahead keeps reads waiting for free slots
+            let options = AsyncReadOptions {
+                queue_depth: 2,
+                use_io_uring,
+                ..AsyncReadOptions::default()
+            };
+            let reader = AsyncSstReader::open_with_options(&path, CompressionType::None, &options)?;
+            assert!(reader.block_count() > 8);
+            if use_io_uring && io_uring_available {
+                assert_eq!(reader.backend(), IoBackend::IoUring);
+            } else {
+                assert_eq!(reader.backend(), IoBackend::Blocking);
+            }
+
+            let mut entries = Vec::new();
+            let mut iter = reader.iter(4);
+            while let Some(entry) = block_on(iter.next_entry()) {
+                entries.push(entry?);
+            }
+            assert_eq!(entries, expected);
+
+            assert_eq!(
+                block_on(reader.get(b"key00123"))?,
+                Some(expected[123].1.clone())
+            );
+            assert_eq!(block_on(reader.get(b"key99999"))?, None);
+
+            let keys: [&[u8]; 4] = [b"key00499", b"missing", b"key00000", b"key00250"];
+            let values = block_on(reader.multi_get(&keys))?;
+            assert_eq!(values[0], Some(expected[499].1.clone()));
+            assert_eq!(values[1], None);
+            assert_eq!(values[2], Some(expected[0].1.clone()));
+            assert_eq!(values[3], Some(expected[250].1.clone()));
+        }
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_queued_reads_fail_when_io_stops() {
+        let (sender, receiver) = channel();
+        let queue_read = |offset| {
+            let state = SharedReadState::default();
+            let request = ReadRequest {
+                offset,
+                len: 16,
+                state: Some(state.clone()),
+            };
+            sender.send(request).unwrap();
+            BlockReadFuture { state }
+        };
+
+        // A failed submit fails the reads queued behind it with its error
+        let drained: Vec<_> = (0..3).map(|i| queue_read(i * 16)).collect();
+        fail_queued(&io::Error::other("submit failed"), &receiver);
+        for read in drained {
+            let error = block_on(read).unwrap_err();
+            assert!(error.to_string().contains("submit failed"));
+        }
+
+        // Reads still in the channel when the I/O thread exits fail as well
+        let dropped: Vec<_> = (0..3).map(|i| queue_read(i * 16)).collect();
+        drop(receiver);
+        for read in dropped {
+            assert!(
+                matches!(block_on(read), Err(Error::Io(e)) if e.kind() == io::ErrorKind::BrokenPipe)
+            );
+        }
+    }
+}
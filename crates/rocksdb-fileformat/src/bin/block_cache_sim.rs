@@ -0,0 +1,85 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Replay a block access trace against simulated caches and print the miss ratio
+//! of every policy at every capacity.
+//!
+//! Usage: block_cache_sim <trace> [--capacities 1M,4M,16M] [--policies lru,clock,fifo]
+//!
+//! Capacities accept K, M and G suffixes. The output has one line per policy and
+//! capacity, which plotted per policy gives its miss-ratio curve.
+
+use rocksdb_fileformat::cache_simulator::{CachePolicy, simulate};
+use rocksdb_fileformat::{Error, Result, read_block_trace};
+use std::fs::File;
+use std::io::BufReader;
+
+const DEFAULT_CAPACITIES: &str = "64K,256K,1M,4M,16M,64M,256M,1G";
+
+fn parse_capacity(text: &str) -> Result<u64> {
+    let invalid = || Error::InvalidArgument(format!("Invalid capacity: {}", text));
+    let (digits, multiplier) = match text.char_indices().last() {
+        Some((i, 'K' | 'k')) => (&text[..i], 1 << 10),
+        Some((i, 'M' | 'm')) => (&text[..i], 1 << 20),
+        Some((i, 'G' | 'g')) => (&text[..i], 1 << 30),
+        _ => (text, 1),
+    };
+    let value: u64 = digits.parse().map_err(|_| invalid())?;
+    value.checked_mul(multiplier).ok_or_else(invalid)
+}
+
+fn main() -> Result<()> {
+    let mut trace_path = None;
+    let mut capacities = DEFAULT_CAPACITIES.to_string();
+    let mut policies = "lru,clock,fifo".to_string();
+
+    let mut args = std::env::args().skip(1);
+    while let Some(arg) = args.next() {
+        let mut value = || {
+            args.next()
+                .ok_or_else(|| Error::InvalidArgument(format!("{} needs a value", arg)))
+        };
+        match arg.as_str() {
+            "--capacities" => capacities = value()?,
+            "--policies" => policies = value()?,
+            _ if trace_path.is_none() && !arg.starts_with("--") => trace_path = Some(arg),
+            _ => return Err(Error::InvalidArgument(format!("Unknown argument: {}", arg))),
+        }
+    }
+    let Some(trace_path) = trace_path else {
+        return Err(Error::InvalidArgument(
+            "Usage: block_cache_sim <trace> [--capacities 1M,4M] [--policies lru,clock,fifo]"
+                .to_string(),
+        ));
+    };
+
+    let capacities = capacities
+        .split(',')
+        .map(parse_capacity)
+        .collect::<Result<Vec<_>>>()?;
+    let policies = policies
+        .split(',')
+        .map(str::parse)
+        .collect::<Result<Vec<CachePolicy>>>()?;
+
+    let records =
+        read_block_trace(BufReader::new(File::open(&trace_path)?)).collect::<Result<Vec<_>>>()?;
+    let served_from_buffers = records.iter().filter(|record| record.hit).count();
+    println!(
+        "# {} block accesses, {} served without a file read",
+        records.len(),
+        served_from_buffers
+    );
+    println!("policy,capacity_bytes,accesses,misses,miss_ratio");
+    for result in simulate(&records, &policies, &capacities) {
+        println!(
+            "{},{},{},{},{:.4}",
+            result.policy.name(),
+            result.capacity,
+            result.accesses,
+            result.misses,
+            result.miss_ratio()
+        );
+    }
+    Ok(())
+}
@@ -1,7 +1,10 @@
 use crate::block_handle::BlockHandle;
-use crate::compression::compress;
+use crate::compression::Compressor;
 use crate::error::Result;
-use crate::types::{ChecksumType, CompressionType, checksum_modifier_for_context};
+use crate::types::{
+    BLOCK_TRAILER_SIZE, ChecksumType, CompressionType, DEFAULT_MAX_COMPRESSED_BYTES_PER_KB,
+    checksum_modifier_for_context,
+};
 use byteorder::{LittleEndian, WriteBytesExt};
 
 /// Configuration options for DataBlockBuilder
@@ -53,6 +56,8 @@ pub struct DataBlockBuilder {
     options: DataBlockBuilderOptions,
     last_key: Vec<u8>,
     finished: bool,
+    /// Kept across [`DataBlockBuilder::finish_into`] calls, created on first use
+    compressor: Option<Compressor>,
 }
 
 impl DataBlockBuilder {
@@ -65,6 +70,7 @@ impl DataBlockBuilder {
             options,
             last_key: Vec::new(),
             finished: false,
+            compressor: None,
         };
 
         // Add first restart point
@@ -109,6 +115,8 @@ impl DataBlockBuilder {
         self.counter += 1;
     }
 
+    /// Finish the block, compress it and append the trailer. Blocks that compress
+    /// poorly are stored uncompressed.
     pub fn finish(
         &mut self,
         compression_type: CompressionType,
@@ -116,6 +124,56 @@ impl DataBlockBuilder {
         file_offset: Option<u64>,
         base_context_checksum: Option<u32>,
     ) -> Result<Vec<u8>> {
+        let mut output = Vec::new();
+        self.finish_into(
+            compression_type,
+            checksum_type,
+            file_offset,
+            base_context_checksum,
+            &mut output,
+        )?;
+        Ok(output)
+    }
+
+    /// Like [`DataBlockBuilder::finish`], but replaces the contents of `output`
+    /// instead of allocating, reusing its allocation
+    pub fn finish_into(
+        &mut self,
+        compression_type: CompressionType,
+        checksum_type: ChecksumType,
+        file_offset: Option<u64>,
+        base_context_checksum: Option<u32>,
+        output: &mut Vec<u8>,
+    ) -> Result<()> {
+        self.finish_contents();
+        let stored_type = self
+            .compressor
+            .get_or_insert_with(Compressor::new)
+            .compress_block_into(
+                &self.buffer,
+                compression_type,
+                None,
+                DEFAULT_MAX_COMPRESSED_BYTES_PER_KB,
+                output,
+            )?;
+        if stored_type == CompressionType::None {
+            output.extend_from_slice(&self.buffer);
+        }
+
+        let trailer = block_trailer(
+            output,
+            stored_type,
+            checksum_type,
+            file_offset,
+            base_context_checksum,
+        );
+        output.extend_from_slice(&trailer);
+        Ok(())
+    }
+
+    /// Finish the block and return its uncompressed contents (entries and restart
+    /// array), leaving compression and the trailer to the caller
+    pub fn finish_contents(&mut self) -> &[u8] {
         if self.finished {
             panic!("DataBlockBuilder already finished");
         }
@@ -131,47 +189,22 @@ impl DataBlockBuilder {
             .write_u32::<LittleEndian>(self.restarts.len() as u32)
             .unwrap();
 
-        // Calculate checksum over the block data + compression type
-        let mut checksum_data = self.buffer.clone();
-        checksum_data.push(compression_type as u8);
-        let mut checksum = checksum_type.calculate(&checksum_data);
-
-        // Apply context-based checksum modification if needed
-        if let (Some(offset), Some(base_checksum)) = (file_offset, base_context_checksum) {
-            let modifier = checksum_modifier_for_context(base_checksum, offset);
-            checksum = checksum.wrapping_add(modifier);
-        }
-
-        // For uncompressed blocks
-        if compression_type == CompressionType::None {
-            let mut result = self.buffer.clone();
-            result.push(compression_type as u8);
-            result.write_u32::<LittleEndian>(checksum).unwrap();
-            Ok(result)
-        } else {
-            // Compress the data (without the trailer)
-            let compressed_data = compress(&self.buffer, compression_type)?;
-
-            // Recalculate checksum over compressed data + compression type
-            let mut compressed_checksum_data = compressed_data.clone();
-            compressed_checksum_data.push(compression_type as u8);
-            let mut compressed_checksum = checksum_type.calculate(&compressed_checksum_data);
-
-            // Apply context-based checksum modification if needed
-            if let (Some(offset), Some(base_checksum)) = (file_offset, base_context_checksum) {
-                let modifier = checksum_modifier_for_context(base_checksum, offset);
-                compressed_checksum = compressed_checksum.wrapping_add(modifier);
-            }
+        &self.buffer
+    }
 
-            // Add the trailer after compression
-            let mut result = compressed_data;
-            result.push(compression_type as u8);
-            result
-                .write_u32::<LittleEndian>(compressed_checksum)
-                .unwrap();
+    /// Finish the block and take its uncompressed contents, leaving the builder
+    /// empty. Hand the buffer back with [`DataBlockBuilder::reset_with_buffer`] to
+    /// reuse its allocation for the next block.
+    pub fn take_contents(&mut self) -> Vec<u8> {
+        self.finish_contents();
+        std::mem::take(&mut self.buffer)
+    }
 
-            Ok(result)
-        }
+    /// Reset the builder, building the next block in `buffer`
+    pub fn reset_with_buffer(&mut self, mut buffer: Vec<u8>) {
+        buffer.clear();
+        self.buffer = buffer;
+        self.reset();
     }
 
     pub fn reset(&mut self) {
@@ -200,6 +233,29 @@ impl DataBlockBuilder {
     }
 }
 
+/// The block trailer, the compression type byte and a checksum over the (possibly
+/// compressed) `block` plus that byte. It is written right after the block.
+pub fn block_trailer(
+    block: &[u8],
+    compression_type: CompressionType,
+    checksum_type: ChecksumType,
+    file_offset: Option<u64>,
+    base_context_checksum: Option<u32>,
+) -> [u8; BLOCK_TRAILER_SIZE] {
+    let mut checksum = checksum_type.calculate_with_last_byte(block, compression_type as u8);
+
+    // Apply context-based checksum modification if needed
+    if let (Some(offset), Some(base_checksum)) = (file_offset, base_context_checksum) {
+        let modifier = checksum_modifier_for_context(base_checksum, offset);
+        checksum = checksum.wrapping_add(modifier);
+    }
+
+    let mut trailer = [0u8; BLOCK_TRAILER_SIZE];
+    trailer[0] = compression_type as u8;
+    trailer[1..].copy_from_slice(&checksum.to_le_bytes());
+    trailer
+}
+
 /// Builder for index blocks that track data block locations
 pub struct IndexBlockBuilder {
     buffer: Vec<u8>,
@@ -208,6 +264,8 @@ pub struct IndexBlockBuilder {
     restart_interval: usize,
     last_key: Vec<u8>,
     finished: bool,
+    /// Kept across [`IndexBlockBuilder::finish_into`] calls, created on first use
+    compressor: Option<Compressor>,
 }
 
 impl IndexBlockBuilder {
@@ -219,6 +277,7 @@ impl IndexBlockBuilder {
             restart_interval,
             last_key: Vec::new(),
             finished: false,
+            compressor: None,
         };
 
         // Add first restart point
@@ -275,6 +334,46 @@ impl IndexBlockBuilder {
         file_offset: Option<u64>,
         base_context_checksum: Option<u32>,
     ) -> Result<Vec<u8>> {
+        let mut output = Vec::new();
+        self.finish_into(
+            compression_type,
+            checksum_type,
+            file_offset,
+            base_context_checksum,
+            &mut output,
+        )?;
+        Ok(output)
+    }
+
+    /// Like [`IndexBlockBuilder::finish`], but replaces the contents of `output`
+    /// instead of allocating, reusing its allocation
+    pub fn finish_into(
+        &mut self,
+        compression_type: CompressionType,
+        checksum_type: ChecksumType,
+        file_offset: Option<u64>,
+        base_context_checksum: Option<u32>,
+        output: &mut Vec<u8>,
+    ) -> Result<()> {
+        self.finish_contents();
+        self.compressor
+            .get_or_insert_with(Compressor::new)
+            .compress_into(&self.buffer, compression_type, None, output)?;
+
+        let trailer = block_trailer(
+            output,
+            compression_type,
+            checksum_type,
+            file_offset,
+            base_context_checksum,
+        );
+        output.extend_from_slice(&trailer);
+        Ok(())
+    }
+
+    /// Finish the block and return its uncompressed contents (entries and restart
+    /// array), leaving compression and the trailer to the caller
+    pub fn finish_contents(&mut self) -> &[u8] {
         if self.finished {
             panic!("IndexBlockBuilder already finished");
         }
@@ -290,47 +389,7 @@ impl IndexBlockBuilder {
             .write_u32::<LittleEndian>(self.restarts.len() as u32)
             .unwrap();
 
-        // Calculate checksum over the block data + compression type
-        let mut checksum_data = self.buffer.clone();
-        checksum_data.push(compression_type as u8);
-        let mut checksum = checksum_type.calculate(&checksum_data);
-
-        // Apply context-based checksum modification if needed
-        if let (Some(offset), Some(base_checksum)) = (file_offset, base_context_checksum) {
-            let modifier = checksum_modifier_for_context(base_checksum, offset);
-            checksum = checksum.wrapping_add(modifier);
-        }
-
-        // For uncompressed blocks
-        if compression_type == CompressionType::None {
-            let mut result = self.buffer.clone();
-            result.push(compression_type as u8);
-            result.write_u32::<LittleEndian>(checksum).unwrap();
-            Ok(result)
-        } else {
-            // Compress the data (without the trailer)
-            let compressed_data = compress(&self.buffer, compression_type)?;
-
-            // Recalculate checksum over compressed data + compression type
-            let mut compressed_checksum_data = compressed_data.clone();
-            compressed_checksum_data.push(compression_type as u8);
-            let mut compressed_checksum = checksum_type.calculate(&compressed_checksum_data);
-
-            // Apply context-based checksum modification if needed
-            if let (Some(offset), Some(base_checksum)) = (file_offset, base_context_checksum) {
-                let modifier = checksum_modifier_for_context(base_checksum, offset);
-                compressed_checksum = compressed_checksum.wrapping_add(modifier);
-            }
-
-            // Add the trailer after compression
-            let mut result = compressed_data;
-            result.push(compression_type as u8);
-            result
-                .write_u32::<LittleEndian>(compressed_checksum)
-                .unwrap();
-
-            Ok(result)
-        }
+        &self.buffer
     }
 
     pub fn empty(&self) -> bool {
@@ -430,4 +489,64 @@ mod tests {
         assert!(builder.empty());
         Ok(())
     }
+
+    #[test]
+    fn test_finish_into_reuses_output_buffer() -> Result<()> {
+        let mut output = Vec::with_capacity(4096);
+        let capacity = output.capacity();
+
+        for checksum_type in [ChecksumType::CRC32c, ChecksumType::XXH3] {
+            let mut builder = DataBlockBuilder::new(DataBlockBuilderOptions::default());
+            builder.add(b"key1", b"value1");
+            builder.add(b"key2", b"value2");
+            builder.finish_into(
+                CompressionType::None,
+                checksum_type,
+                Some(4096),
+                Some(0x1234),
+                &mut output,
+            )?;
+            assert_eq!(output.capacity(), capacity);
+
+            let mut builder = DataBlockBuilder::new(DataBlockBuilderOptions::default());
+            builder.add(b"key1", b"value1");
+            builder.add(b"key2", b"value2");
+            let mut expected = builder.finish_contents().to_vec();
+            let trailer = block_trailer(
+                &expected,
+                CompressionType::None,
+                checksum_type,
+                Some(4096),
+                Some(0x1234),
+            );
+            expected.extend_from_slice(&trailer);
+            assert_eq!(output, expected);
+
+            // The trailer checksums the block plus its type byte
+            let block_len = output.len() - BLOCK_TRAILER_SIZE;
+            let checksum = u32::from_le_bytes(output[block_len + 1..].try_into().unwrap());
+            let expected = checksum_type
+                .calculate(&output[..block_len + 1])
+                .wrapping_add(checksum_modifier_for_context(0x1234, 4096));
+            assert_eq!(checksum, expected);
+        }
+
+        // Compressed blocks are written into the caller's buffer as well
+        let mut builder = DataBlockBuilder::new(DataBlockBuilderOptions::default());
+        for i in 0..100 {
+            builder.add(format!("key{:03}", i).as_bytes(), b"a repetitive value");
+        }
+        let allocation = output.as_ptr();
+        builder.finish_into(
+            CompressionType::ZSTD,
+            ChecksumType::CRC32c,
+            None,
+            None,
+            &mut output,
+        )?;
+        let block_len = output.len() - BLOCK_TRAILER_SIZE;
+        assert_eq!(output[block_len], CompressionType::ZSTD as u8);
+        assert_eq!(output.as_ptr(), allocation);
+        Ok(())
+    }
 }
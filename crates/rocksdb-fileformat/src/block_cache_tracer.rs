@@ -0,0 +1,275 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Block access tracing, modelled on RocksDB's `BlockCacheTracer`.
+//!
+//! When a tracer is attached through
+//! [`ReadOptions::block_cache_tracer`](crate::types::ReadOptions::block_cache_tracer),
+//! every block an [`SstReader`](crate::SstReader) reads is appended to the trace
+//! with the file, offset, size, block type, the operation that needed it, and
+//! whether it was served without a file read. Traces are replayed offline by
+//! [`crate::cache_simulator`] to size block caches.
+//!
+//! Each record is one line of comma separated fields:
+//! `timestamp_micros,block_type,caller,hit,offset,size,file`. The file path comes
+//! last so it may itself contain commas.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/trace_replay/block_cache_tracer.h
+
+use crate::error::{Error, Result};
+use std::fs::File;
+use std::io::{BufRead, BufWriter, Write};
+use std::path::Path;
+use std::sync::Mutex;
+use std::time::{SystemTime, UNIX_EPOCH};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum TraceBlockType {
+    Data,
+    Index,
+    MetaIndex,
+    CompressionDictionary,
+}
+
+impl TraceBlockType {
+    pub fn name(self) -> &'static str {
+        match self {
+            TraceBlockType::Data => "data",
+            TraceBlockType::Index => "index",
+            TraceBlockType::MetaIndex => "metaindex",
+            TraceBlockType::CompressionDictionary => "compression_dict",
+        }
+    }
+
+    fn from_name(name: &str) -> Option<Self> {
+        Some(match name {
+            "data" => TraceBlockType::Data,
+            "index" => TraceBlockType::Index,
+            "metaindex" => TraceBlockType::MetaIndex,
+            "compression_dict" => TraceBlockType::CompressionDictionary,
+            _ => return None,
+        })
+    }
+}
+
+/// The operation a block was read for
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum TableReaderCaller {
+    UserGet,
+    UserMultiGet,
+    UserIterator,
+    /// Metadata blocks read while opening a table
+    Prefetch,
+}
+
+impl TableReaderCaller {
+    pub fn name(self) -> &'static str {
+        match self {
+            TableReaderCaller::UserGet => "get",
+            TableReaderCaller::UserMultiGet => "multi_get",
+            TableReaderCaller::UserIterator => "iterator",
+            TableReaderCaller::Prefetch => "prefetch",
+        }
+    }
+
+    fn from_name(name: &str) -> Option<Self> {
+        Some(match name {
+            "get" => TableReaderCaller::UserGet,
+            "multi_get" => TableReaderCaller::UserMultiGet,
+            "iterator" => TableReaderCaller::UserIterator,
+            "prefetch" => TableReaderCaller::Prefetch,
+            _ => return None,
+        })
+    }
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct BlockAccessRecord {
+    pub timestamp_micros: u64,
+    pub block_type: TraceBlockType,
+    pub caller: TableReaderCaller,
+    /// Served from the prefetched tail or a readahead buffer rather than a file read
+    pub hit: bool,
+    pub offset: u64,
+    /// Block size including its trailer
+    pub size: u64,
+    pub file: String,
+}
+
+impl BlockAccessRecord {
+    fn parse(line: &str) -> Result<Self> {
+        let invalid = || Error::InvalidArgument(format!("Invalid block trace record: {}", line));
+        let mut fields = line.splitn(7, ',');
+        let mut next = || fields.next().ok_or_else(invalid);
+        Ok(BlockAccessRecord {
+            timestamp_micros: next()?.parse().map_err(|_| invalid())?,
+            block_type: TraceBlockType::from_name(next()?).ok_or_else(invalid)?,
+            caller: TableReaderCaller::from_name(next()?).ok_or_else(invalid)?,
+            hit: match next()? {
+                "1" => true,
+                "0" => false,
+                _ => return Err(invalid()),
+            },
+            offset: next()?.parse().map_err(|_| invalid())?,
+            size: next()?.parse().map_err(|_| invalid())?,
+            file: next()?.to_string(),
+        })
+    }
+}
+
+struct TraceOutput {
+    writer: BufWriter<Box<dyn Write + Send>>,
+    /// First write error, reported by [`BlockCacheTracer::flush`] since reads do
+    /// not fail because their trace could not be written
+    error: Option<std::io::Error>,
+}
+
+pub struct BlockCacheTracer {
+    output: Mutex<TraceOutput>,
+}
+
+impl BlockCacheTracer {
+    pub fn new<W: Write + Send + 'static>(writer: W) -> Self {
+        BlockCacheTracer {
+            output: Mutex::new(TraceOutput {
+                writer: BufWriter::new(Box::new(writer)),
+                error: None,
+            }),
+        }
+    }
+
+    /// Trace into a new file at `path`
+    pub fn create<P: AsRef<Path>>(path: P) -> Result<Self> {
+        Ok(Self::new(File::create(path)?))
+    }
+
+    pub(crate) fn record(
+        &self,
+        file: &Path,
+        offset: u64,
+        size: u64,
+        block_type: TraceBlockType,
+        caller: TableReaderCaller,
+        hit: bool,
+    ) {
+        let timestamp_micros = SystemTime::now()
+            .duration_since(UNIX_EPOCH)
+            .map_or(0, |elapsed| elapsed.as_micros() as u64);
+        let mut output = self.output.lock().unwrap();
+        if output.error.is_some() {
+            return;
+        }
+        if let Err(e) = writeln!(
+            output.writer,
+            "{},{},{},{},{},{},{}",
+            timestamp_micros,
+            block_type.name(),
+            caller.name(),
+            hit as u8,
+            offset,
+            size,
+            file.display()
+        ) {
+            output.error = Some(e);
+        }
+    }
+
+    /// Flush buffered records, returning the first error hit while tracing
+    pub fn flush(&self) -> Result<()> {
+        let mut output = self.output.lock().unwrap();
+        if let Some(e) = output.error.take() {
+            return Err(e.into());
+        }
+        Ok(output.writer.flush()?)
+    }
+}
+
+impl std::fmt::Debug for BlockCacheTracer {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("BlockCacheTracer").finish_non_exhaustive()
+    }
+}
+
+/// Read the records of a trace in order
+pub fn read_block_trace<R: BufRead>(reader: R) -> impl Iterator<Item = Result<BlockAccessRecord>> {
+    reader
+        .lines()
+        .filter(|line| !matches!(line, Ok(line) if line.is_empty()))
+        .map(|line| BlockAccessRecord::parse(&line?))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::iterator::SstEntryIterator;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::sst_reader::SstReader;
+    use crate::types::{CompressionType, ReadOptions, WriteOptions};
+    use std::io::BufReader;
+    use std::sync::Arc;
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_trace_records_block_reads() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("traced.sst");
+        let trace_path = dir.path().join("blocks.trace");
+
+        let mut writer = SstFileWriter::create(&WriteOptions {
+            block_size: 512,
+            ..WriteOptions::default()
+        });
+        writer.open(&path)?;
+        for i in 0..500 {
+            writer.put(format!("key{:05}", i), format!("value{}", i))?;
+        }
+        writer.finish()?;
+
+        let tracer = Arc::new(BlockCacheTracer::create(&trace_path)?);
+        let read_options = ReadOptions {
+            block_cache_tracer: Some(tracer.clone()),
+            ..ReadOptions::default()
+        };
+        let reader = SstReader::open_with_options(&path, &read_options)?;
+        let mut iter =
+            SstEntryIterator::with_options(reader, CompressionType::None, &read_options)?;
+        assert!(iter.find(b"key00250")?.is_some());
+        iter.multi_get(&[b"key00001".as_slice(), b"key00499".as_slice()])?;
+        tracer.flush()?;
+
+        let records = read_block_trace(BufReader::new(File::open(&trace_path)?))
+            .collect::<Result<Vec<_>>>()?;
+        let callers = |block_type: TraceBlockType| {
+            records
+                .iter()
+                .filter(|record| record.block_type == block_type)
+                .map(|record| record.caller)
+                .collect::<Vec<_>>()
+        };
+        assert_eq!(
+            callers(TraceBlockType::MetaIndex),
+            [TableReaderCaller::Prefetch]
+        );
+        assert_eq!(
+            callers(TraceBlockType::Index),
+            [TableReaderCaller::Prefetch]
+        );
+        assert_eq!(
+            callers(TraceBlockType::Data),
+            [
+                TableReaderCaller::UserGet,
+                TableReaderCaller::UserMultiGet,
+                TableReaderCaller::UserMultiGet
+            ]
+        );
+        // Metadata is served from the tail read at open
+        assert!(records[0].hit);
+        assert!(
+            records
+                .iter()
+                .all(|record| record.file == path.display().to_string())
+        );
+        Ok(())
+    }
+}
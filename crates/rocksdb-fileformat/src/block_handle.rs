@@ -51,7 +51,7 @@ impl BlockHandle {
     }
 }
 
-fn read_varint64<R: Read>(reader: &mut R) -> Result<u64> {
+pub(crate) fn read_varint64<R: Read>(reader: &mut R) -> Result<u64> {
     let mut result = 0u64;
     let mut shift = 0;
 
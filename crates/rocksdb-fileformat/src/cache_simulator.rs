@@ -0,0 +1,248 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Offline block cache simulation over a block access trace, modelled on RocksDB's
+//! `CacheSimulator`.
+//!
+//! A trace written by [`BlockCacheTracer`](crate::BlockCacheTracer) is replayed
+//! against caches of several policies and byte capacities, and the miss ratio of
+//! each is reported. Plotting miss ratio against capacity for a policy gives its
+//! miss-ratio curve, which shows how much cache a workload needs.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/utilities/simulator_cache/cache_simulator.h
+
+use crate::block_cache_tracer::BlockAccessRecord;
+use crate::error::{Error, Result};
+use std::collections::{BTreeMap, HashMap, VecDeque};
+use std::str::FromStr;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum CachePolicy {
+    /// Evict the least recently used block
+    Lru,
+    /// Second chance FIFO: a block used since it was inserted or last passed over
+    /// is moved to the back of the queue instead of being evicted
+    Clock,
+    /// Evict the oldest inserted block, regardless of use
+    Fifo,
+}
+
+impl CachePolicy {
+    pub const ALL: [CachePolicy; 3] = [CachePolicy::Lru, CachePolicy::Clock, CachePolicy::Fifo];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            CachePolicy::Lru => "lru",
+            CachePolicy::Clock => "clock",
+            CachePolicy::Fifo => "fifo",
+        }
+    }
+}
+
+impl FromStr for CachePolicy {
+    type Err = Error;
+
+    fn from_str(name: &str) -> Result<Self> {
+        CachePolicy::ALL
+            .into_iter()
+            .find(|policy| policy.name() == name)
+            .ok_or_else(|| Error::InvalidArgument(format!("Unknown cache policy: {}", name)))
+    }
+}
+
+/// A block within a trace: the interned file and the block's offset
+type BlockKey = (u32, u64);
+
+/// Block cache state holding at most `capacity` bytes of blocks
+struct SimCache {
+    policy: CachePolicy,
+    capacity: u64,
+    usage: u64,
+    /// Size of each cached block and, for LRU, its last use, or, for clock, whether
+    /// it was used since it was last considered for eviction
+    blocks: HashMap<BlockKey, (u64, u64)>,
+    /// LRU order, oldest first, keyed by use sequence number
+    lru: BTreeMap<u64, BlockKey>,
+    /// Insertion order for clock and FIFO
+    queue: VecDeque<BlockKey>,
+    sequence: u64,
+}
+
+impl SimCache {
+    fn new(policy: CachePolicy, capacity: u64) -> Self {
+        SimCache {
+            policy,
+            capacity,
+            usage: 0,
+            blocks: HashMap::new(),
+            lru: BTreeMap::new(),
+            queue: VecDeque::new(),
+            sequence: 0,
+        }
+    }
+
+    /// Look the block up, inserting it on a miss. Returns whether it was cached.
+    fn access(&mut self, key: BlockKey, size: u64) -> bool {
+        self.sequence += 1;
+        if let Some((_, state)) = self.blocks.get_mut(&key) {
+            match self.policy {
+                CachePolicy::Lru => {
+                    self.lru.remove(state);
+                    *state = self.sequence;
+                    self.lru.insert(self.sequence, key);
+                }
+                CachePolicy::Clock => *state = 1,
+                CachePolicy::Fifo => {}
+            }
+            return true;
+        }
+
+        // Blocks larger than the whole cache are never admitted
+        if size > self.capacity {
+            return false;
+        }
+        while self.usage + size > self.capacity {
+            self.evict_one();
+        }
+        self.usage += size;
+        match self.policy {
+            CachePolicy::Lru => {
+                self.blocks.insert(key, (size, self.sequence));
+                self.lru.insert(self.sequence, key);
+            }
+            CachePolicy::Clock | CachePolicy::Fifo => {
+                self.blocks.insert(key, (size, 0));
+                self.queue.push_back(key);
+            }
+        }
+        false
+    }
+
+    fn evict_one(&mut self) {
+        let victim = match self.policy {
+            CachePolicy::Lru => self.lru.pop_first().map(|(_, key)| key),
+            CachePolicy::Clock => loop {
+                let Some(key) = self.queue.pop_front() else {
+                    break None;
+                };
+                let (_, referenced) = self.blocks.get_mut(&key).unwrap();
+                if *referenced == 0 {
+                    break Some(key);
+                }
+                *referenced = 0;
+                self.queue.push_back(key);
+            },
+            CachePolicy::Fifo => self.queue.pop_front(),
+        };
+        if let Some((size, _)) = victim.and_then(|key| self.blocks.remove(&key)) {
+            self.usage -= size;
+        }
+    }
+}
+
+#[derive(Debug, Clone, PartialEq)]
+pub struct SimulationResult {
+    pub policy: CachePolicy,
+    /// Cache capacity in bytes
+    pub capacity: u64,
+    pub accesses: u64,
+    pub misses: u64,
+}
+
+impl SimulationResult {
+    pub fn miss_ratio(&self) -> f64 {
+        if self.accesses == 0 {
+            0.0
+        } else {
+            self.misses as f64 / self.accesses as f64
+        }
+    }
+}
+
+/// Replay `records` against a cache for every combination of `policies` and
+/// `capacities`, returning one result per combination in that order
+pub fn simulate(
+    records: &[BlockAccessRecord],
+    policies: &[CachePolicy],
+    capacities: &[u64],
+) -> Vec<SimulationResult> {
+    let mut file_ids: HashMap<&str, u32> = HashMap::new();
+    let accesses: Vec<(BlockKey, u64)> = records
+        .iter()
+        .map(|record| {
+            let next_id = file_ids.len() as u32;
+            let file_id = *file_ids.entry(record.file.as_str()).or_insert(next_id);
+            ((file_id, record.offset), record.size)
+        })
+        .collect();
+
+    let mut results = Vec::with_capacity(policies.len() * capacities.len());
+    for &policy in policies {
+        for &capacity in capacities {
+            let mut cache = SimCache::new(policy, capacity);
+            let misses = accesses
+                .iter()
+                .filter(|&&(key, size)| !cache.access(key, size))
+                .count();
+            results.push(SimulationResult {
+                policy,
+                capacity,
+                accesses: accesses.len() as u64,
+                misses: misses as u64,
+            });
+        }
+    }
+    results
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::block_cache_tracer::{TableReaderCaller, TraceBlockType};
+
+    fn record(file: &str, offset: u64) -> BlockAccessRecord {
+        BlockAccessRecord {
+            timestamp_micros: 0,
+            block_type: TraceBlockType::Data,
+            caller: TableReaderCaller::UserGet,
+            hit: false,
+            offset,
+            size: 100,
+            file: file.to_string(),
+        }
+    }
+
+    #[test]
+    fn test_simulate_policies() {
+        // A hot block accessed between a scan over four cold ones
+        let mut records = Vec::new();
+        for round in 0..3 {
+            for offset in [100, 200, 300, 400] {
+                records.push(record("a.sst", 0));
+                records.push(record("a.sst", offset + round));
+            }
+        }
+        // The same offset in another file is a different block
+        records.push(record("b.sst", 0));
+
+        let results = simulate(&records, &CachePolicy::ALL, &[50, 200, 10_000]);
+        let misses = |policy, capacity| {
+            results
+                .iter()
+                .find(|result| result.policy == policy && result.capacity == capacity)
+                .unwrap()
+                .misses
+        };
+
+        for policy in CachePolicy::ALL {
+            // Nothing fits, and everything fits after the first access
+            assert_eq!(misses(policy, 50), 25);
+            assert_eq!(misses(policy, 10_000), 14);
+        }
+        // Two blocks of room: recency keeps the hot block, FIFO keeps evicting it
+        assert_eq!(misses(CachePolicy::Lru, 200), 14);
+        assert_eq!(misses(CachePolicy::Clock, 200), 14);
+        assert!(misses(CachePolicy::Fifo, 200) > 14);
+        assert!(results[0].miss_ratio() == 1.0);
+    }
+}
@@ -1,101 +1,750 @@
 use crate::error::{Error, Result};
-use crate::types::CompressionType;
+use crate::statistics::{Histogram, Statistics};
+use crate::types::{CompressionOptions, CompressionType, DEFAULT_COMPRESSION_LEVEL};
+use std::cell::RefCell;
+use std::sync::Arc;
+use std::time::Instant;
 
-/// Decompress data according to the specified compression type
+/// LZ4HC level used for `DEFAULT_COMPRESSION_LEVEL`, LZ4's own `LZ4HC_CLEVEL_DEFAULT`
+const LZ4HC_DEFAULT_LEVEL: i32 = 9;
+
+/// Largest decompressed block accepted. Sizes declared by a block (the snappy,
+/// LZ4 and zstd headers) are checked against it before anything is allocated, and
+/// codecs that do not declare a size stop growing their output past it, so a
+/// corrupt block cannot demand gigabytes of memory. Real blocks are far smaller.
+pub const MAX_DECOMPRESSED_BLOCK_SIZE: usize = 256 << 20;
+
+/// Reject a decompressed size beyond [`MAX_DECOMPRESSED_BLOCK_SIZE`]
+fn check_decompressed_size(codec: &str, size: u64) -> Result<usize> {
+    if size > MAX_DECOMPRESSED_BLOCK_SIZE as u64 {
+        return Err(Error::DataCorruption(format!(
+            "{} block decompresses to {} bytes, more than the {} byte limit",
+            codec, size, MAX_DECOMPRESSED_BLOCK_SIZE
+        )));
+    }
+    Ok(size as usize)
+}
+
+/// Grow `output` for a codec that does not declare its decompressed size, up to
+/// [`MAX_DECOMPRESSED_BLOCK_SIZE`]
+fn grow_output(codec: &str, output: &mut Vec<u8>) -> Result<()> {
+    let capacity = output.capacity();
+    check_decompressed_size(codec, capacity as u64 + 1)?;
+    output.reserve((capacity.max(64)).min(MAX_DECOMPRESSED_BLOCK_SIZE - capacity));
+    Ok(())
+}
+
+/// Decompress data according to the specified compression type.
+///
+/// Uses a per-thread [`Decompressor`], so codec contexts are reused across calls.
 pub fn decompress(data: &[u8], compression_type: CompressionType) -> Result<Vec<u8>> {
-    match compression_type {
-        CompressionType::None => Ok(data.to_vec()),
-        CompressionType::Snappy => decompress_snappy(data),
-        CompressionType::Zlib => decompress_zlib(data),
-        CompressionType::LZ4 => decompress_lz4(data),
-        CompressionType::ZSTD => decompress_zstd(data),
-        _ => Err(Error::UnsupportedCompressionType(compression_type as u8)),
+    decompress_with_dict(data, compression_type, None)
+}
+
+/// Decompress data that may have been compressed with the table's dictionary
+pub fn decompress_with_dict(
+    data: &[u8],
+    compression_type: CompressionType,
+    dict: Option<&DecompressionDict>,
+) -> Result<Vec<u8>> {
+    let mut output = Vec::new();
+    decompress_with_dict_into(data, compression_type, dict, &mut output)?;
+    Ok(output)
+}
+
+/// Like [`decompress_with_dict`], writing into `output` so that its allocation is
+/// reused from block to block
+pub fn decompress_with_dict_into(
+    data: &[u8],
+    compression_type: CompressionType,
+    dict: Option<&DecompressionDict>,
+    output: &mut Vec<u8>,
+) -> Result<()> {
+    THREAD_DECOMPRESSOR.with(|decompressor| match decompressor.try_borrow_mut() {
+        Ok(mut decompressor) => {
+            decompressor.decompress_into_with_dict(data, compression_type, dict, output)
+        }
+        // Only reachable if a codec re-entered decompress on this thread
+        Err(_) => {
+            Decompressor::new().decompress_into_with_dict(data, compression_type, dict, output)
+        }
+    })
+}
+
+thread_local! {
+    static THREAD_DECOMPRESSOR: RefCell<Decompressor> = RefCell::new(Decompressor::new());
+}
+
+/// Reusable decompression state.
+///
+/// Holds the zlib inflate state and the zstd decompression context across calls,
+/// so decoding a block does not set up a codec from scratch. Output is written into
+/// a caller supplied buffer, sized up front from the uncompressed length whenever
+/// the format records it (snappy, LZ4 and zstd frames with a content size).
+pub struct Decompressor {
+    snappy: snap::raw::Decoder,
+    zlib: flate2::Decompress,
+    zstd: Option<zstd::zstd_safe::DCtx<'static>>,
+}
+
+impl Decompressor {
+    pub fn new() -> Self {
+        Decompressor {
+            snappy: snap::raw::Decoder::new(),
+            zlib: flate2::Decompress::new(true),
+            zstd: None,
+        }
+    }
+
+    pub fn decompress(
+        &mut self,
+        data: &[u8],
+        compression_type: CompressionType,
+    ) -> Result<Vec<u8>> {
+        let mut output = Vec::new();
+        self.decompress_into(data, compression_type, &mut output)?;
+        Ok(output)
+    }
+
+    /// Decompress `data` into `output`, replacing its contents but keeping its allocation
+    pub fn decompress_into(
+        &mut self,
+        data: &[u8],
+        compression_type: CompressionType,
+        output: &mut Vec<u8>,
+    ) -> Result<()> {
+        self.decompress_into_with_dict(data, compression_type, None, output)
+    }
+
+    /// Like [`Decompressor::decompress_into`], using `dict` for zstd blocks
+    pub fn decompress_into_with_dict(
+        &mut self,
+        data: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&DecompressionDict>,
+        output: &mut Vec<u8>,
+    ) -> Result<()> {
+        output.clear();
+        match compression_type {
+            CompressionType::None => output.extend_from_slice(data),
+            CompressionType::Snappy => self.decompress_snappy(data, output)?,
+            CompressionType::Zlib => self.decompress_zlib(data, output)?,
+            CompressionType::LZ4 | CompressionType::LZ4HC => decompress_lz4(data, output)?,
+            CompressionType::BZip2 => decompress_bzip2(data, output)?,
+            CompressionType::ZSTD => self.decompress_zstd(data, dict, output)?,
+            _ => return Err(Error::UnsupportedCompressionType(compression_type as u8)),
+        }
+        Ok(())
+    }
+
+    fn decompress_snappy(&mut self, data: &[u8], output: &mut Vec<u8>) -> Result<()> {
+        let len = snap::raw::decompress_len(data)
+            .map_err(|e| Error::Decompression(format!("Snappy decompression failed: {}", e)))?;
+        let len = check_decompressed_size("Snappy", len as u64)?;
+        output.resize(len, 0);
+        let written = self
+            .snappy
+            .decompress(data, output)
+            .map_err(|e| Error::Decompression(format!("Snappy decompression failed: {}", e)))?;
+        output.truncate(written);
+        Ok(())
+    }
+
+    fn decompress_zlib(&mut self, data: &[u8], output: &mut Vec<u8>) -> Result<()> {
+        use flate2::{FlushDecompress, Status};
+
+        // The zlib stream does not record its decompressed size
+        self.zlib.reset(true);
+        output.reserve(
+            data.len()
+                .saturating_mul(4)
+                .clamp(64, MAX_DECOMPRESSED_BLOCK_SIZE),
+        );
+        loop {
+            let consumed = self.zlib.total_in() as usize;
+            let produced = self.zlib.total_out();
+            let status = self
+                .zlib
+                // `Finish` would demand room for the whole output in one call
+                .decompress_vec(&data[consumed..], output, FlushDecompress::None)
+                .map_err(|e| Error::Decompression(format!("Zlib decompression failed: {}", e)))?;
+
+            if status == Status::StreamEnd {
+                return Ok(());
+            }
+            if output.len() == output.capacity() {
+                grow_output("Zlib", output)?;
+            } else if self.zlib.total_in() as usize == consumed && self.zlib.total_out() == produced
+            {
+                return Err(Error::Decompression(
+                    "Zlib decompression failed: truncated input".to_string(),
+                ));
+            }
+        }
+    }
+
+    fn decompress_zstd(
+        &mut self,
+        data: &[u8],
+        dict: Option<&DecompressionDict>,
+        output: &mut Vec<u8>,
+    ) -> Result<()> {
+        use zstd::zstd_safe::{DCtx, InBuffer, OutBuffer, ResetDirective, get_error_name};
+
+        let dctx = self.zstd.get_or_insert_with(DCtx::create);
+        let zstd_error = |code| {
+            Error::Decompression(format!(
+                "ZSTD decompression failed: {}",
+                get_error_name(code)
+            ))
+        };
+
+        if let Ok(Some(content_size)) = zstd::zstd_safe::get_frame_content_size(data) {
+            output.reserve(check_decompressed_size("ZSTD", content_size)?);
+            match dict {
+                Some(dict) => dctx.decompress_using_ddict(output, data, &dict.ddict),
+                None => dctx.decompress(output, data),
+            }
+            .map_err(zstd_error)?;
+            return Ok(());
+        }
+
+        // Unknown content size: stream into the buffer, growing it as needed.
+        // Resetting parameters also drops a dictionary referenced by an earlier call.
+        dctx.reset(ResetDirective::SessionAndParameters)
+            .map_err(zstd_error)?;
+        if let Some(dict) = dict {
+            dctx.ref_ddict(&dict.ddict).map_err(zstd_error)?;
+        }
+        output.reserve(
+            data.len()
+                .saturating_mul(4)
+                .clamp(64, MAX_DECOMPRESSED_BLOCK_SIZE),
+        );
+        let mut input = InBuffer::around(data);
+        loop {
+            let pos = output.len();
+            let remaining = {
+                let mut out = OutBuffer::around_pos(output, pos);
+                dctx.decompress_stream(&mut out, &mut input)
+                    .map_err(zstd_error)?
+            };
+
+            if remaining == 0 {
+                return Ok(());
+            }
+            if output.len() == output.capacity() {
+                grow_output("ZSTD", output)?;
+            } else if input.pos() == data.len() {
+                return Err(Error::Decompression(
+                    "ZSTD decompression failed: truncated input".to_string(),
+                ));
+            }
+        }
     }
 }
 
-/// Compress data according to the specified compression type
-pub fn compress(data: &[u8], compression_type: CompressionType) -> Result<Vec<u8>> {
-    match compression_type {
-        CompressionType::None => Ok(data.to_vec()),
-        CompressionType::Snappy => compress_snappy(data),
-        CompressionType::Zlib => compress_zlib(data),
-        CompressionType::LZ4 => compress_lz4(data),
-        CompressionType::ZSTD => compress_zstd(data),
-        _ => Err(Error::UnsupportedCompressionType(compression_type as u8)),
+impl Default for Decompressor {
+    fn default() -> Self {
+        Self::new()
     }
 }
 
-fn compress_snappy(data: &[u8]) -> Result<Vec<u8>> {
-    snap::raw::Encoder::new()
-        .compress_vec(data)
-        .map_err(|e| Error::Decompression(format!("Snappy compression failed: {}", e)))
+/// Compress data according to the specified compression type, with default options
+pub fn compress(data: &[u8], compression_type: CompressionType) -> Result<Vec<u8>> {
+    Compressor::new().compress(data, compression_type, None)
 }
 
-fn compress_zlib(data: &[u8]) -> Result<Vec<u8>> {
+fn compress_zlib(data: &[u8], level: i32, output: &mut Vec<u8>) -> Result<()> {
     use flate2::Compression;
     use flate2::write::ZlibEncoder;
     use std::io::Write;
 
-    let mut encoder = ZlibEncoder::new(Vec::new(), Compression::default());
+    let compression = if level == DEFAULT_COMPRESSION_LEVEL {
+        Compression::default()
+    } else {
+        Compression::new(level.clamp(0, 9) as u32)
+    };
+    output.clear();
+    let mut encoder = ZlibEncoder::new(output, compression);
     encoder
         .write_all(data)
         .map_err(|e| Error::Decompression(format!("Zlib compression failed: {}", e)))?;
     encoder
         .finish()
-        .map_err(|e| Error::Decompression(format!("Zlib compression failed: {}", e)))
+        .map_err(|e| Error::Decompression(format!("Zlib compression failed: {}", e)))?;
+    Ok(())
 }
 
-fn compress_lz4(data: &[u8]) -> Result<Vec<u8>> {
+fn compress_lz4(
+    data: &[u8],
+    mode: Option<lz4::block::CompressionMode>,
+    output: &mut Vec<u8>,
+) -> Result<()> {
+    let lz4_error = |e| Error::Decompression(format!("LZ4 compression failed: {}", e));
+
     // LZ4 in RocksDB includes a 4-byte uncompressed size header
-    let compressed_block = lz4::block::compress(data, None, false)
-        .map_err(|e| Error::Decompression(format!("LZ4 compression failed: {}", e)))?;
+    let bound = lz4::block::compress_bound(data.len()).map_err(lz4_error)?;
+    output.clear();
+    output.extend_from_slice(&(data.len() as u32).to_le_bytes());
+    output.resize(4 + bound, 0);
+    let compressed_len =
+        lz4::block::compress_to_buffer(data, mode, false, &mut output[4..]).map_err(lz4_error)?;
+    output.truncate(4 + compressed_len);
+    Ok(())
+}
 
-    let mut result = Vec::new();
-    result.extend_from_slice(&(data.len() as u32).to_le_bytes());
-    result.extend_from_slice(&compressed_block);
-    Ok(result)
+/// A zstd dictionary prepared for compressing the data blocks of one table.
+///
+/// The raw dictionary is stored in the table's `rocksdb.compression_dict` meta block;
+/// the digested form is built once and can be shared by several [`Compressor`]s.
+pub struct CompressionDict {
+    raw: Vec<u8>,
+    cdict: zstd::zstd_safe::CDict<'static>,
 }
 
-fn compress_zstd(data: &[u8]) -> Result<Vec<u8>> {
-    zstd::stream::encode_all(data, 0)
-        .map_err(|e| Error::Decompression(format!("ZSTD compression failed: {}", e)))
+impl CompressionDict {
+    /// Digest `raw` for compression at `level` (see [`CompressionOptions::level`])
+    pub fn new(raw: Vec<u8>, level: i32) -> Self {
+        CompressionDict {
+            cdict: zstd::zstd_safe::CDict::create(&raw, zstd_level(level)),
+            raw,
+        }
+    }
+
+    /// Train a dictionary of at most `max_dict_bytes` from sample block contents
+    pub fn train<S: AsRef<[u8]>>(samples: &[S], max_dict_bytes: usize, level: i32) -> Result<Self> {
+        let raw = zstd::dict::from_samples(samples, max_dict_bytes)
+            .map_err(|e| Error::Compression(format!("ZSTD dictionary training failed: {}", e)))?;
+        Ok(Self::new(raw, level))
+    }
+
+    pub fn raw(&self) -> &[u8] {
+        &self.raw
+    }
 }
 
-fn decompress_snappy(data: &[u8]) -> Result<Vec<u8>> {
-    snap::raw::Decoder::new()
-        .decompress_vec(data)
-        .map_err(|e| Error::Decompression(format!("Snappy decompression failed: {}", e)))
+/// Reusable compression state, the counterpart of [`Decompressor`].
+///
+/// Keeps the codec settings from [`CompressionOptions`] and the zstd compression
+/// context across blocks. A `Compressor` is not shared between threads; parallel
+/// writers give each worker its own.
+pub struct Compressor {
+    level: i32,
+    zstd_window_log: u32,
+    zstd_strategy: i32,
+    candidate_codecs: Vec<CompressionType>,
+    decode_cost_weight: f64,
+    zstd: Option<zstd::zstd_safe::CCtx<'static>>,
+    snappy: snap::raw::Encoder,
+    /// Output of the candidate codec being tried while another one's is the best
+    scratch: Vec<u8>,
+    statistics: Option<Arc<Statistics>>,
+}
+
+impl Compressor {
+    pub fn new() -> Self {
+        Self::with_options(&CompressionOptions::default())
+    }
+
+    pub fn with_options(options: &CompressionOptions) -> Self {
+        Compressor {
+            level: options.level,
+            zstd_window_log: options.zstd_window_log,
+            zstd_strategy: options.zstd_strategy,
+            candidate_codecs: options.candidate_codecs.clone(),
+            decode_cost_weight: options.decode_cost_weight,
+            zstd: None,
+            snappy: snap::raw::Encoder::new(),
+            scratch: Vec::new(),
+            statistics: None,
+        }
+    }
+
+    /// Record the time spent in [`Compressor::compress_block`] into `statistics`
+    pub(crate) fn with_statistics(mut self, statistics: Option<Arc<Statistics>>) -> Self {
+        self.statistics = statistics;
+        self
+    }
+
+    /// Compress `data`, using `dict` for zstd when one is given
+    pub fn compress(
+        &mut self,
+        data: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&CompressionDict>,
+    ) -> Result<Vec<u8>> {
+        let mut output = Vec::new();
+        self.compress_into(data, compression_type, dict, &mut output)?;
+        Ok(output)
+    }
+
+    /// Like [`Compressor::compress`], but replaces the contents of `output`,
+    /// keeping its allocation
+    pub fn compress_into(
+        &mut self,
+        data: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&CompressionDict>,
+        output: &mut Vec<u8>,
+    ) -> Result<()> {
+        use lz4::block::CompressionMode;
+
+        match compression_type {
+            CompressionType::None => {
+                output.clear();
+                output.extend_from_slice(data);
+                Ok(())
+            }
+            CompressionType::Snappy => {
+                output.clear();
+                output.resize(snap::raw::max_compress_len(data.len()), 0);
+                let compressed_len = self.snappy.compress(data, output).map_err(|e| {
+                    Error::Decompression(format!("Snappy compression failed: {}", e))
+                })?;
+                output.truncate(compressed_len);
+                Ok(())
+            }
+            CompressionType::Zlib => compress_zlib(data, self.level, output),
+            // As in RocksDB, a negative level selects LZ4's acceleration factor
+            CompressionType::LZ4 if self.level < 0 => {
+                compress_lz4(data, Some(CompressionMode::FAST(-self.level)), output)
+            }
+            CompressionType::LZ4 => compress_lz4(data, None, output),
+            CompressionType::LZ4HC => {
+                let level = if self.level == DEFAULT_COMPRESSION_LEVEL {
+                    LZ4HC_DEFAULT_LEVEL
+                } else {
+                    self.level
+                };
+                compress_lz4(data, Some(CompressionMode::HIGHCOMPRESSION(level)), output)
+            }
+            CompressionType::ZSTD => self.compress_zstd(data, dict, output),
+            _ => Err(Error::UnsupportedCompressionType(compression_type as u8)),
+        }
+    }
+
+    fn compress_zstd(
+        &mut self,
+        data: &[u8],
+        dict: Option<&CompressionDict>,
+        output: &mut Vec<u8>,
+    ) -> Result<()> {
+        use zstd::zstd_safe::{CCtx, CParameter, get_error_name};
+
+        let zstd_error =
+            |code| Error::Compression(format!("ZSTD compression failed: {}", get_error_name(code)));
+
+        if self.zstd.is_none() {
+            let mut cctx = CCtx::create();
+            cctx.set_parameter(CParameter::CompressionLevel(zstd_level(self.level)))
+                .map_err(zstd_error)?;
+            if self.zstd_window_log > 0 {
+                cctx.set_parameter(CParameter::WindowLog(zstd_window_log(
+                    self.zstd_window_log,
+                )?))
+                .map_err(zstd_error)?;
+            }
+            if self.zstd_strategy > 0 {
+                cctx.set_parameter(CParameter::Strategy(zstd_strategy(self.zstd_strategy)?))
+                    .map_err(zstd_error)?;
+            }
+            self.zstd = Some(cctx);
+        }
+        let cctx = self.zstd.as_mut().unwrap();
+
+        // Single-shot compression records the content size in the frame header,
+        // which lets the reader size its output buffer exactly
+        // zstd writes from the start of the buffer, up to its capacity
+        output.clear();
+        output.reserve(zstd::zstd_safe::compress_bound(data.len()));
+        match dict {
+            Some(dict) => cctx.compress_using_cdict(output, data, &dict.cdict),
+            None => cctx.compress2(output, data),
+        }
+        .map_err(zstd_error)?;
+        Ok(())
+    }
+
+    /// Compress block contents, falling back to storing them uncompressed when the
+    /// result exceeds `max_compressed_bytes_per_kb` bytes per KiB of input.
+    ///
+    /// With candidate codecs configured, `compression_type` is ignored and the
+    /// block is compressed with each candidate instead, keeping the output with the
+    /// lowest size plus weighted decode cost.
+    pub fn compress_block(
+        &mut self,
+        contents: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&CompressionDict>,
+        max_compressed_bytes_per_kb: usize,
+    ) -> Result<CompressedBlock> {
+        let mut data = Vec::new();
+        let compression_type = self.compress_block_into(
+            contents,
+            compression_type,
+            dict,
+            max_compressed_bytes_per_kb,
+            &mut data,
+        )?;
+        if compression_type == CompressionType::None {
+            data.extend_from_slice(contents);
+        }
+        Ok(CompressedBlock {
+            data,
+            compression_type,
+            uncompressed_len: contents.len(),
+        })
+    }
+
+    /// Like [`Compressor::compress_block`], but compresses into `output`, keeping
+    /// its allocation, and returns the codec used. When that is
+    /// `CompressionType::None`, `output` is left empty and the block is to be
+    /// stored as `contents`, which saves copying it.
+    pub fn compress_block_into(
+        &mut self,
+        contents: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&CompressionDict>,
+        max_compressed_bytes_per_kb: usize,
+        output: &mut Vec<u8>,
+    ) -> Result<CompressionType> {
+        let uncompressed_len = contents.len();
+        let num_candidates = self.candidate_codecs.len().max(1);
+        let start = self.statistics.as_ref().map(|_| Instant::now());
+        let mut attempted = false;
+        let mut scratch = std::mem::take(&mut self.scratch);
+
+        let mut best: Option<(f64, CompressionType)> = None;
+        for i in 0..num_candidates {
+            let candidate = self
+                .candidate_codecs
+                .get(i)
+                .copied()
+                .unwrap_or(compression_type);
+            if candidate == CompressionType::None {
+                continue;
+            }
+            attempted = true;
+
+            // Later candidates go to the scratch buffer until they beat the best
+            let target = if best.is_none() {
+                &mut *output
+            } else {
+                &mut scratch
+            };
+            self.compress_into(contents, candidate, dict, target)?;
+            if exceeds_ratio(target.len(), uncompressed_len, max_compressed_bytes_per_kb) {
+                continue;
+            }
+            let score = target.len() as f64
+                + self.decode_cost_weight * decode_cost(candidate) * uncompressed_len as f64;
+            if best.is_none_or(|(best_score, _)| score < best_score) {
+                if best.is_some() {
+                    std::mem::swap(output, &mut scratch);
+                }
+                best = Some((score, candidate));
+            }
+        }
+        self.scratch = scratch;
+
+        if let (Some(statistics), Some(start), true) = (&self.statistics, start, attempted) {
+            statistics.record_in_histogram(
+                Histogram::CompressionTimesNanos,
+                start.elapsed().as_nanos() as u64,
+            );
+        }
+
+        Ok(match best {
+            Some((_, compression_type)) => compression_type,
+            None => {
+                output.clear();
+                CompressionType::None
+            }
+        })
+    }
 }
 
-fn decompress_zlib(data: &[u8]) -> Result<Vec<u8>> {
-    use flate2::read::ZlibDecoder;
+/// Rough cost of decompressing a byte with each codec relative to LZ4, from their
+/// typical single core decode throughput
+fn decode_cost(compression_type: CompressionType) -> f64 {
+    match compression_type {
+        CompressionType::None => 0.0,
+        CompressionType::LZ4 | CompressionType::LZ4HC => 1.0,
+        CompressionType::Snappy => 1.5,
+        CompressionType::ZSTD => 3.0,
+        CompressionType::Zlib => 8.0,
+        CompressionType::BZip2 | CompressionType::XPRESS => 30.0,
+    }
+}
+
+impl Default for Compressor {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Block contents ready for the trailer, as stored in the file
+pub struct CompressedBlock {
+    pub data: Vec<u8>,
+    /// `CompressionType::None` if compression was rejected
+    pub compression_type: CompressionType,
+    pub uncompressed_len: usize,
+}
+
+fn exceeds_ratio(
+    compressed_len: usize,
+    uncompressed_len: usize,
+    max_compressed_bytes_per_kb: usize,
+) -> bool {
+    compressed_len as u64 * 1024 > uncompressed_len as u64 * max_compressed_bytes_per_kb as u64
+}
+
+/// Counters for the data blocks a writer compressed, mirroring RocksDB's
+/// `NUMBER_BLOCK_COMPRESSED` / `NUMBER_BLOCK_COMPRESSION_REJECTED` tickers
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct CompressionStats {
+    /// Blocks stored compressed
+    pub blocks_compressed: u64,
+    /// Uncompressed and stored sizes of the blocks stored compressed
+    pub bytes_compressed_from: u64,
+    pub bytes_compressed_to: u64,
+    /// Blocks stored uncompressed because compression did not save enough
+    pub blocks_compression_rejected: u64,
+    pub bytes_compression_rejected: u64,
+    /// Whether training the zstd dictionary failed, typically on too little sample
+    /// data, so that the file was written without one
+    pub dictionary_training_failed: bool,
+}
+
+impl CompressionStats {
+    /// Count a block of `uncompressed_len` bytes stored as `stored_len` bytes
+    /// with `compression_type`
+    pub(crate) fn record(
+        &mut self,
+        compression_type: CompressionType,
+        uncompressed_len: usize,
+        stored_len: usize,
+    ) {
+        if compression_type == CompressionType::None {
+            self.blocks_compression_rejected += 1;
+            self.bytes_compression_rejected += uncompressed_len as u64;
+        } else {
+            self.blocks_compressed += 1;
+            self.bytes_compressed_from += uncompressed_len as u64;
+            self.bytes_compressed_to += stored_len as u64;
+        }
+    }
+}
+
+/// Level zstd uses for `DEFAULT_COMPRESSION_LEVEL`, where 0 means its own default
+fn zstd_level(level: i32) -> i32 {
+    if level == DEFAULT_COMPRESSION_LEVEL {
+        0
+    } else {
+        level
+    }
+}
+
+/// Smallest zstd window log, `ZSTD_WINDOWLOG_MIN`
+const ZSTD_MIN_WINDOW_LOG: u32 = 10;
+/// Largest window log decoders accept by default, `ZSTD_WINDOWLOG_LIMIT_DEFAULT`
+const ZSTD_MAX_WINDOW_LOG: u32 = 27;
+
+fn zstd_window_log(window_log: u32) -> Result<u32> {
+    if !(ZSTD_MIN_WINDOW_LOG..=ZSTD_MAX_WINDOW_LOG).contains(&window_log) {
+        return Err(Error::InvalidArgument(format!(
+            "Invalid ZSTD window log: {}, expected {} to {}",
+            window_log, ZSTD_MIN_WINDOW_LOG, ZSTD_MAX_WINDOW_LOG
+        )));
+    }
+    Ok(window_log)
+}
+
+fn zstd_strategy(strategy: i32) -> Result<zstd::zstd_safe::Strategy> {
+    use zstd::zstd_safe::Strategy;
+
+    Ok(match strategy {
+        1 => Strategy::ZSTD_fast,
+        2 => Strategy::ZSTD_dfast,
+        3 => Strategy::ZSTD_greedy,
+        4 => Strategy::ZSTD_lazy,
+        5 => Strategy::ZSTD_lazy2,
+        6 => Strategy::ZSTD_btlazy2,
+        7 => Strategy::ZSTD_btopt,
+        8 => Strategy::ZSTD_btultra,
+        9 => Strategy::ZSTD_btultra2,
+        _ => {
+            return Err(Error::InvalidArgument(format!(
+                "Invalid ZSTD strategy: {}",
+                strategy
+            )));
+        }
+    })
+}
+
+/// The decompression side of a table's dictionary, loaded once when the table is
+/// opened and shared by everything reading from it.
+pub struct DecompressionDict {
+    ddict: zstd::zstd_safe::DDict<'static>,
+}
+
+impl DecompressionDict {
+    pub fn new(raw: &[u8]) -> Self {
+        DecompressionDict {
+            ddict: zstd::zstd_safe::DDict::create(raw),
+        }
+    }
+
+    /// Memory held by the digested dictionary
+    pub fn approximate_memory_usage(&self) -> usize {
+        self.ddict.sizeof()
+    }
+}
+
+fn decompress_bzip2(data: &[u8], output: &mut Vec<u8>) -> Result<()> {
     use std::io::Read;
 
-    let mut decoder = ZlibDecoder::new(data);
-    let mut decompressed = Vec::new();
-    decoder
-        .read_to_end(&mut decompressed)
-        .map_err(|e| Error::Decompression(format!("Zlib decompression failed: {}", e)))?;
+    // From format_version 2, RocksDB prefixes the bzip2 stream with its
+    // decompressed size as a varint32
+    let mut input = std::io::Cursor::new(data);
+    let declared = crate::block_handle::read_varint64(&mut input)
+        .ok()
+        .filter(|&size| size <= u64::from(u32::MAX))
+        .ok_or_else(|| {
+            Error::Decompression("BZip2 block lacks its decompressed size".to_string())
+        })?;
+    let declared = check_decompressed_size("BZip2", declared)?;
 
-    Ok(decompressed)
+    output.reserve(declared);
+    bzip2::read::BzDecoder::new(&data[input.position() as usize..])
+        .take(declared as u64 + 1)
+        .read_to_end(output)
+        .map_err(|e| Error::Decompression(format!("BZip2 decompression failed: {}", e)))?;
+    if output.len() != declared {
+        return Err(Error::DataCorruption(format!(
+            "BZip2 block decompressed to {} bytes, but declares {}",
+            output.len(),
+            declared
+        )));
+    }
+    Ok(())
 }
 
-fn decompress_lz4(data: &[u8]) -> Result<Vec<u8>> {
+fn decompress_lz4(data: &[u8], output: &mut Vec<u8>) -> Result<()> {
     // LZ4 in RocksDB includes a 4-byte uncompressed size header
     if data.len() < 4 {
         return Err(Error::Decompression("LZ4 data too short".to_string()));
     }
 
-    let uncompressed_size = u32::from_le_bytes([data[0], data[1], data[2], data[3]]) as usize;
-    let compressed_data = &data[4..];
-
-    lz4::block::decompress(compressed_data, Some(uncompressed_size as i32))
-        .map_err(|e| Error::Decompression(format!("LZ4 decompression failed: {}", e)))
-}
-
-fn decompress_zstd(data: &[u8]) -> Result<Vec<u8>> {
-    zstd::stream::decode_all(data)
-        .map_err(|e| Error::Decompression(format!("ZSTD decompression failed: {}", e)))
+    let uncompressed_size = u32::from_le_bytes([data[0], data[1], data[2], data[3]]);
+    let uncompressed_size = check_decompressed_size("LZ4", uncompressed_size.into())?;
+    output.resize(uncompressed_size, 0);
+    let written =
+        lz4::block::decompress_to_buffer(&data[4..], Some(uncompressed_size as i32), output)
+            .map_err(|e| Error::Decompression(format!("LZ4 decompression failed: {}", e)))?;
+    output.truncate(written);
+    Ok(())
 }
 
 #[cfg(test)]
@@ -171,7 +820,7 @@ mod tests {
     #[test]
     fn test_unsupported_compression() -> Result<()> {
         let data = b"hello world";
-        let result = decompress(data, CompressionType::BZip2);
+        let result = decompress(data, CompressionType::XPRESS);
         assert!(matches!(result, Err(Error::UnsupportedCompressionType(_))));
         Ok(())
     }
@@ -224,4 +873,187 @@ mod tests {
         assert!(compressed.len() < original.len());
         Ok(())
     }
+
+    #[test]
+    fn test_decompressor_reuses_output_buffer() -> Result<()> {
+        let original: Vec<u8> = (0..100_000u32)
+            .flat_map(|i| (i % 1000).to_le_bytes())
+            .collect();
+        let mut decompressor = Decompressor::new();
+        let mut output = Vec::new();
+
+        for compression_type in [
+            CompressionType::None,
+            CompressionType::Snappy,
+            CompressionType::Zlib,
+            CompressionType::LZ4,
+            CompressionType::ZSTD,
+        ] {
+            let compressed = compress(&original, compression_type)?;
+            decompressor.decompress_into(&compressed, compression_type, &mut output)?;
+            assert_eq!(output, original, "{:?}", compression_type);
+        }
+
+        // Streamed zstd frames carry no content size and take the growing path
+        let streamed = zstd::stream::encode_all(&original[..], 0)
+            .map_err(|e| Error::Compression(format!("ZSTD compression failed: {}", e)))?;
+        let capacity = output.capacity();
+        decompressor.decompress_into(&streamed, CompressionType::ZSTD, &mut output)?;
+        assert_eq!(output, original);
+        assert_eq!(output.capacity(), capacity);
+
+        let truncated = &streamed[..streamed.len() / 2];
+        assert!(
+            decompressor
+                .decompress_into(truncated, CompressionType::ZSTD, &mut output)
+                .is_err()
+        );
+        Ok(())
+    }
+
+    #[test]
+    fn test_declared_size_is_bounded() {
+        let is_corruption =
+            |result: Result<Vec<u8>>| matches!(result, Err(Error::DataCorruption(_)));
+
+        // LZ4 size header of 4 GiB - 1
+        let lz4 = [0xff, 0xff, 0xff, 0xff, 0x00];
+        assert!(is_corruption(decompress(&lz4, CompressionType::LZ4)));
+
+        // Snappy varint length of 4 GiB - 1
+        let snappy = [0xff, 0xff, 0xff, 0xff, 0x0f, 0x00];
+        assert!(is_corruption(decompress(&snappy, CompressionType::Snappy)));
+
+        // zstd single segment frame header declaring a 1 TiB content size
+        let mut zstd = vec![0x28, 0xb5, 0x2f, 0xfd, 0xe0];
+        zstd.extend_from_slice(&(1u64 << 40).to_le_bytes());
+        assert!(is_corruption(decompress(&zstd, CompressionType::ZSTD)));
+    }
+
+    #[test]
+    fn test_zstd_dictionary_round_trip() -> Result<()> {
+        let samples: Vec<Vec<u8>> = (0..200)
+            .map(|i| {
+                format!("user{:05}:{{\"name\":\"n{}\",\"active\":true}}", i, i * 7).into_bytes()
+            })
+            .collect();
+        let dict = CompressionDict::train(&samples, 1024, DEFAULT_COMPRESSION_LEVEL)?;
+        assert!(!dict.raw().is_empty());
+
+        let original = b"user00042:{\"name\":\"n294\",\"active\":true}";
+        let with_dict = Compressor::new().compress(original, CompressionType::ZSTD, Some(&dict))?;
+        assert!(with_dict.len() < compress(original, CompressionType::ZSTD)?.len());
+
+        let ddict = DecompressionDict::new(dict.raw());
+        let decompressed = decompress_with_dict(&with_dict, CompressionType::ZSTD, Some(&ddict))?;
+        assert_eq!(decompressed, original);
+
+        // The frame cannot be decoded without its dictionary
+        assert!(decompress(&with_dict, CompressionType::ZSTD).is_err());
+        Ok(())
+    }
+
+    #[test]
+    fn test_round_trip_lz4hc_and_bzip2() -> Result<()> {
+        use std::io::Write;
+
+        let original = b"hello world hello world hello world";
+        let compressed = compress(original, CompressionType::LZ4HC)?;
+        assert_eq!(decompress(&compressed, CompressionType::LZ4HC)?, original);
+
+        // BZip2 is only read. RocksDB stores the bzip2 stream after a varint32 of
+        // the decompressed size, here a single byte.
+        let mut encoder = bzip2::write::BzEncoder::new(Vec::new(), bzip2::Compression::best());
+        encoder.write_all(original)?;
+        let stream = encoder.finish()?;
+        let mut compressed = vec![original.len() as u8];
+        compressed.extend_from_slice(&stream);
+        assert_eq!(decompress(&compressed, CompressionType::BZip2)?, original);
+        assert!(decompress(&stream, CompressionType::BZip2).is_err());
+        compressed[0] += 1;
+        assert!(decompress(&compressed, CompressionType::BZip2).is_err());
+        Ok(())
+    }
+
+    #[test]
+    fn test_compressor_options() -> Result<()> {
+        let original: Vec<u8> = (0..50_000u32)
+            .flat_map(|i| format!("{} ", i % 1777).into_bytes())
+            .collect();
+
+        let mut sizes = Vec::new();
+        for level in [1, 19] {
+            let options = CompressionOptions {
+                level,
+                zstd_window_log: 20,
+                zstd_strategy: if level == 1 { 1 } else { 9 },
+                ..CompressionOptions::default()
+            };
+            let mut compressor = Compressor::with_options(&options);
+            for compression_type in [
+                CompressionType::Zlib,
+                CompressionType::LZ4,
+                CompressionType::LZ4HC,
+                CompressionType::ZSTD,
+            ] {
+                let compressed = compressor.compress(&original, compression_type, None)?;
+                assert_eq!(decompress(&compressed, compression_type)?, original);
+                if compression_type == CompressionType::ZSTD {
+                    sizes.push(compressed.len());
+                }
+            }
+        }
+        assert!(sizes[1] < sizes[0]);
+
+        for invalid in [
+            CompressionOptions {
+                zstd_strategy: 10,
+                ..CompressionOptions::default()
+            },
+            // Frames with a window past 2^27 need a raised decoder limit
+            CompressionOptions {
+                zstd_window_log: 28,
+                ..CompressionOptions::default()
+            },
+        ] {
+            assert!(matches!(
+                Compressor::with_options(&invalid).compress(&original, CompressionType::ZSTD, None),
+                Err(Error::InvalidArgument(_))
+            ));
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn test_candidate_codec_selection() -> Result<()> {
+        use crate::types::DEFAULT_MAX_COMPRESSED_BYTES_PER_KB;
+
+        let original: Vec<u8> = (0..1000u32)
+            .flat_map(|i| {
+                format!("{:x}:{} ", i.wrapping_mul(2654435761), i % 37)
+                    .repeat(4)
+                    .into_bytes()
+            })
+            .collect();
+        let pick = |decode_cost_weight| -> Result<CompressionType> {
+            let options = CompressionOptions {
+                candidate_codecs: vec![CompressionType::LZ4, CompressionType::ZSTD],
+                decode_cost_weight,
+                ..CompressionOptions::default()
+            };
+            let block = Compressor::with_options(&options).compress_block(
+                &original,
+                CompressionType::None,
+                None,
+                DEFAULT_MAX_COMPRESSED_BYTES_PER_KB,
+            )?;
+            assert_eq!(decompress(&block.data, block.compression_type)?, original);
+            Ok(block.compression_type)
+        };
+
+        // Size alone favors zstd; a high decode cost weight favors LZ4
+        assert_eq!(pick(0.0)?, CompressionType::ZSTD);
+        assert_eq!(pick(1.0)?, CompressionType::LZ4);
+        Ok(())
+    }
 }
@@ -1,8 +1,11 @@
-use crate::compression::decompress;
+use crate::compression::{DecompressionDict, decompress_with_dict_into};
 use crate::error::{Error, Result};
+use crate::perf_context::PerfTimer;
+use crate::statistics::{Histogram, Statistics, StopWatch, Ticker};
 use crate::types::CompressionType;
 use byteorder::{LittleEndian, ReadBytesExt};
 use std::io::Cursor;
+use std::ops::Range;
 
 pub struct DataBlock {
     data: Vec<u8>,
@@ -18,14 +21,73 @@ pub struct KeyValue {
 
 impl DataBlock {
     pub fn new(compressed_data: &[u8], compression_type: CompressionType) -> Result<Self> {
-        let raw_data = decompress(compressed_data, compression_type)?;
+        Self::new_with_dict(compressed_data, compression_type, None)
+    }
+
+    /// Decode a block of a table written with a compression dictionary
+    pub fn new_with_dict(
+        compressed_data: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&DecompressionDict>,
+    ) -> Result<Self> {
+        Self::decode(compressed_data, compression_type, dict, None)
+    }
+
+    /// Decode a block, recording its decompression into `statistics`
+    pub(crate) fn decode(
+        compressed_data: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&DecompressionDict>,
+        statistics: Option<&Statistics>,
+    ) -> Result<Self> {
+        Self::decode_into(
+            compressed_data,
+            compression_type,
+            dict,
+            statistics,
+            Vec::new(),
+        )
+    }
 
-        // RocksDB blocks have a 5-byte trailer: compression_type (1) + checksum (4)
-        let data = if raw_data.len() >= 5 {
-            raw_data[..raw_data.len() - 5].to_vec()
+    /// Like [`DataBlock::decode`], decompressing into `buffer`, typically the
+    /// contents of a block no longer needed (see [`DataBlock::into_data`]), so that
+    /// its allocation is reused
+    pub(crate) fn decode_into(
+        compressed_data: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&DecompressionDict>,
+        statistics: Option<&Statistics>,
+        mut data: Vec<u8>,
+    ) -> Result<Self> {
+        // RocksDB blocks have a 5-byte trailer: compression_type (1) + checksum (4).
+        // The trailer is appended after compression, so strip it first. Its type
+        // byte is authoritative, since writers store blocks that compress poorly
+        // uncompressed even in a compressed table.
+        let (contents, compression_type) = if compressed_data.len() >= 5 {
+            let trailer_start = compressed_data.len() - 5;
+            (
+                &compressed_data[..trailer_start],
+                CompressionType::try_from(compressed_data[trailer_start])?,
+            )
         } else {
-            raw_data
+            (compressed_data, compression_type)
         };
+        let timer = PerfTimer::start();
+        // Only blocks that are actually decompressed count towards the histogram
+        let stop_watch = StopWatch::start(
+            statistics.filter(|_| compression_type != CompressionType::None),
+            Histogram::DecompressionTimesNanos,
+        );
+        decompress_with_dict_into(contents, compression_type, dict, &mut data)?;
+        if compression_type != CompressionType::None {
+            timer.stop(|context| &mut context.block_decompress_nanos);
+            stop_watch.stop();
+            if let Some(statistics) = statistics {
+                statistics.record_tick(Ticker::NumberBlockDecompressed, 1);
+                statistics.record_tick(Ticker::BytesDecompressedFrom, contents.len() as u64);
+                statistics.record_tick(Ticker::BytesDecompressedTo, data.len() as u64);
+            }
+        }
 
         if data.len() < 4 {
             return Err(Error::InvalidBlockFormat(
@@ -69,61 +131,115 @@ impl DataBlock {
         })
     }
 
+    /// The decompressed contents, to be reused by the next [`DataBlock::decode_into`]
+    pub(crate) fn into_data(self) -> Vec<u8> {
+        self.data
+    }
+
+    /// Memory held by the decoded block
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>() + self.data.capacity() + self.restart_points.capacity() * size_of::<u32>()
+    }
+
     pub fn get_entries(&self) -> Result<Vec<KeyValue>> {
         let mut entries = Vec::new();
-        let mut cursor = Cursor::new(&self.data);
-        let mut last_key = Vec::new();
+        self.for_each_entry(|key, value| {
+            entries.push(KeyValue {
+                key: key.to_vec(),
+                value: value.to_vec(),
+            });
+            Ok(())
+        })?;
 
-        while (cursor.position() as usize) < self.restart_offset {
-            let entry_start = cursor.position();
+        Ok(entries)
+    }
 
-            // Check if this is a restart point BEFORE processing
-            // At restart points, we should have no shared prefix
-            if self.is_restart_point(entry_start as u32) {
-                last_key.clear();
-            }
+    /// Visit every entry in order without allocating per entry.
+    /// The key slice points into a reused buffer, the value slice into the block data.
+    pub fn for_each_entry<F>(&self, mut f: F) -> Result<()>
+    where
+        F: FnMut(&[u8], &[u8]) -> Result<()>,
+    {
+        let mut key = Vec::new();
+        let mut offset = 0;
+
+        while offset < self.restart_offset {
+            let (value, next_offset) = self.decode_entry(offset, &mut key)?;
+            f(&key, &self.data[value])?;
+            offset = next_offset;
+        }
 
-            let shared_key_len = self.read_varint(&mut cursor)?;
-            let unshared_key_len = self.read_varint(&mut cursor)?;
-            let value_len = self.read_varint(&mut cursor)?;
+        Ok(())
+    }
 
-            if shared_key_len > last_key.len() as u32 {
-                return Err(Error::InvalidBlockFormat(
-                    "Shared key length exceeds previous key length".to_string(),
-                ));
-            }
+    /// Visit every key in order, skipping over values without copying them
+    pub fn for_each_key<F>(&self, mut f: F) -> Result<()>
+    where
+        F: FnMut(&[u8]) -> Result<()>,
+    {
+        let mut key = Vec::new();
+        let mut offset = 0;
+
+        while offset < self.restart_offset {
+            let (_, next_offset) = self.decode_entry(offset, &mut key)?;
+            f(&key)?;
+            offset = next_offset;
+        }
 
-            let mut key = Vec::new();
-            key.extend_from_slice(&last_key[..shared_key_len as usize]);
-
-            if unshared_key_len > 0 {
-                let pos = cursor.position() as usize;
-                if pos + unshared_key_len as usize > self.data.len() {
-                    return Err(Error::InvalidBlockFormat(
-                        "Key extends beyond block".to_string(),
-                    ));
-                }
-                key.extend_from_slice(&self.data[pos..pos + unshared_key_len as usize]);
-                cursor.set_position((pos + unshared_key_len as usize) as u64);
-            }
+        Ok(())
+    }
 
-            let mut value = Vec::new();
-            if value_len > 0 {
-                let pos = cursor.position() as usize;
-                if pos + value_len as usize > self.data.len() {
-                    return Err(Error::InvalidBlockFormat(
-                        "Value extends beyond block".to_string(),
-                    ));
-                }
-                value.extend_from_slice(&self.data[pos..pos + value_len as usize]);
-                cursor.set_position((pos + value_len as usize) as u64);
-            }
+    pub fn get_keys(&self) -> Result<Vec<Vec<u8>>> {
+        let mut keys = Vec::new();
+        self.for_each_key(|key| {
+            keys.push(key.to_vec());
+            Ok(())
+        })?;
+
+        Ok(keys)
+    }
 
-            last_key = key.clone();
-            entries.push(KeyValue { key, value });
+    /// Decode the entry starting at `offset`, rebuilding its key in `key` from the
+    /// previous key. Returns the value's range in the block and the next entry offset.
+    fn decode_entry(&self, offset: usize, key: &mut Vec<u8>) -> Result<(Range<usize>, usize)> {
+        // At restart points, we should have no shared prefix
+        if self.is_restart_point(offset as u32) {
+            key.clear();
         }
 
-        Ok(entries)
+        let mut cursor = Cursor::new(&self.data);
+        cursor.set_position(offset as u64);
+
+        let shared_key_len = self.read_varint(&mut cursor)? as usize;
+        let unshared_key_len = self.read_varint(&mut cursor)? as usize;
+        let value_len = self.read_varint(&mut cursor)? as usize;
+
+        if shared_key_len > key.len() {
+            return Err(Error::InvalidBlockFormat(
+                "Shared key length exceeds previous key length".to_string(),
+            ));
+        }
+
+        let key_start = cursor.position() as usize;
+        if key_start + unshared_key_len > self.data.len() {
+            return Err(Error::InvalidBlockFormat(
+                "Key extends beyond block".to_string(),
+            ));
+        }
+        key.truncate(shared_key_len);
+        key.extend_from_slice(&self.data[key_start..key_start + unshared_key_len]);
+
+        let value_start = key_start + unshared_key_len;
+        if value_start + value_len > self.data.len() {
+            return Err(Error::InvalidBlockFormat(
+                "Value extends beyond block".to_string(),
+            ));
+        }
+
+        Ok((
+            value_start..value_start + value_len,
+            value_start + value_len,
+        ))
     }
 
     fn read_varint(&self, cursor: &mut Cursor<&Vec<u8>>) -> Result<u32> {
@@ -154,12 +270,17 @@ impl DataBlock {
     }
 
     fn is_restart_point(&self, offset: u32) -> bool {
-        self.restart_points.contains(&offset)
+        // Restart points are written in increasing offset order
+        self.restart_points.binary_search(&offset).is_ok()
     }
 
     pub fn num_entries(&self) -> usize {
-        match self.get_entries() {
-            Ok(entries) => entries.len(),
+        let mut count = 0;
+        match self.for_each_key(|_| {
+            count += 1;
+            Ok(())
+        }) {
+            Ok(()) => count,
             Err(_) => 0,
         }
     }
@@ -169,6 +290,72 @@ impl DataBlock {
     }
 }
 
+/// Zero-copy cursor over a data block.
+///
+/// Unlike [`DataBlockReader`], entries are decoded on demand: the current key lives in
+/// a buffer reused across entries and the value borrows the decoded block.
+pub struct DataBlockCursor {
+    block: DataBlock,
+    next_offset: usize,
+    key: Vec<u8>,
+    value: Range<usize>,
+    valid: bool,
+}
+
+impl DataBlockCursor {
+    pub fn new(block: DataBlock) -> Self {
+        DataBlockCursor {
+            block,
+            next_offset: 0,
+            key: Vec::new(),
+            value: 0..0,
+            valid: false,
+        }
+    }
+
+    /// Position on the first entry, returning whether the block has one
+    pub fn seek_to_first(&mut self) -> Result<bool> {
+        self.next_offset = 0;
+        self.key.clear();
+        self.next()
+    }
+
+    /// Advance to the next entry, returning whether the cursor is still valid
+    pub fn next(&mut self) -> Result<bool> {
+        if self.next_offset >= self.block.restart_offset {
+            self.valid = false;
+            return Ok(false);
+        }
+
+        let (value, next_offset) = self.block.decode_entry(self.next_offset, &mut self.key)?;
+        self.value = value;
+        self.next_offset = next_offset;
+        self.valid = true;
+        Ok(true)
+    }
+
+    pub fn valid(&self) -> bool {
+        self.valid
+    }
+
+    /// Memory held by the block and the current key
+    pub fn approximate_memory_usage(&self) -> usize {
+        self.block.approximate_memory_usage() + self.key.capacity()
+    }
+
+    pub(crate) fn into_block(self) -> DataBlock {
+        self.block
+    }
+
+    pub fn key(&self) -> Option<&[u8]> {
+        self.valid.then_some(self.key.as_slice())
+    }
+
+    pub fn value(&self) -> Option<&[u8]> {
+        self.valid.then(|| &self.block.data[self.value.clone()])
+    }
+}
+
 pub struct DataBlockReader {
     block: DataBlock,
     current_entry: usize,
@@ -177,7 +364,22 @@ pub struct DataBlockReader {
 
 impl DataBlockReader {
     pub fn new(compressed_data: &[u8], compression_type: CompressionType) -> Result<Self> {
-        let block = DataBlock::new(compressed_data, compression_type)?;
+        Self::new_with_dict(compressed_data, compression_type, None)
+    }
+
+    pub fn new_with_dict(
+        compressed_data: &[u8],
+        compression_type: CompressionType,
+        dict: Option<&DecompressionDict>,
+    ) -> Result<Self> {
+        Self::from_block(DataBlock::new_with_dict(
+            compressed_data,
+            compression_type,
+            dict,
+        )?)
+    }
+
+    pub(crate) fn from_block(block: DataBlock) -> Result<Self> {
         let entries = block.get_entries()?;
 
         Ok(DataBlockReader {
@@ -206,35 +408,46 @@ impl DataBlockReader {
     }
 
     pub fn key(&self) -> Option<&[u8]> {
-        if self.current_entry > 0 && self.current_entry <= self.entries.len() {
-            Some(&self.entries[self.current_entry - 1].key)
-        } else {
-            None
-        }
+        self.entries
+            .get(self.current_entry)
+            .map(|entry| entry.key.as_slice())
     }
 
     pub fn value(&self) -> Option<&[u8]> {
-        if self.current_entry > 0 && self.current_entry <= self.entries.len() {
-            Some(&self.entries[self.current_entry - 1].value)
-        } else {
-            None
-        }
+        self.entries
+            .get(self.current_entry)
+            .map(|entry| entry.value.as_slice())
     }
 
     pub fn seek(&mut self, target_key: &[u8]) -> bool {
-        for (i, entry) in self.entries.iter().enumerate() {
-            if entry.key.as_slice() >= target_key {
-                self.current_entry = i;
-                return true;
-            }
-        }
-        self.current_entry = self.entries.len();
-        false
+        let timer = PerfTimer::start();
+        self.current_entry = self
+            .entries
+            .iter()
+            .position(|entry| entry.key.as_slice() >= target_key)
+            .unwrap_or(self.entries.len());
+        timer.stop(|context| &mut context.data_block_seek_nanos);
+        self.current_entry < self.entries.len()
     }
 
     pub fn entries(&self) -> &[KeyValue] {
         &self.entries
     }
+
+    pub(crate) fn into_block(self) -> DataBlock {
+        self.block
+    }
+
+    /// Memory held by the block and the entries materialized from it
+    pub fn approximate_memory_usage(&self) -> usize {
+        self.block.approximate_memory_usage()
+            + self.entries.capacity() * size_of::<KeyValue>()
+            + self
+                .entries
+                .iter()
+                .map(|entry| entry.key.capacity() + entry.value.capacity())
+                .sum::<usize>()
+    }
 }
 
 #[cfg(test)]
@@ -374,4 +587,79 @@ mod tests {
 
         Ok(())
     }
+
+    #[test]
+    fn test_data_block_borrowed_entries() -> Result<()> {
+        let mut builder =
+            DataBlockBuilder::new(DataBlockBuilderOptions::default().with_restart_interval(3));
+
+        let test_data: Vec<(Vec<u8>, Vec<u8>)> = (0..10)
+            .map(|i| {
+                (
+                    format!("prefix_key{:02}", i).into_bytes(),
+                    format!("v{}", i).into_bytes(),
+                )
+            })
+            .collect();
+
+        for (key, value) in &test_data {
+            builder.add(key, value);
+        }
+
+        let block_bytes = builder.finish(
+            CompressionType::None,
+            crate::types::ChecksumType::CRC32c,
+            None,
+            None,
+        )?;
+
+        // Visitor
+        let mut visited = Vec::new();
+        let block = DataBlock::new(&block_bytes, CompressionType::None)?;
+        block.for_each_entry(|key, value| {
+            visited.push((key.to_vec(), value.to_vec()));
+            Ok(())
+        })?;
+        assert_eq!(visited, test_data);
+
+        // Cursor
+        let mut cursor = DataBlockCursor::new(block);
+        assert!(cursor.seek_to_first()?);
+        for (key, value) in &test_data {
+            assert!(cursor.valid());
+            assert_eq!(cursor.key(), Some(key.as_slice()));
+            assert_eq!(cursor.value(), Some(value.as_slice()));
+            cursor.next()?;
+        }
+        assert!(!cursor.valid());
+        assert_eq!(cursor.key(), None);
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_data_block_keys_only() -> Result<()> {
+        let mut builder =
+            DataBlockBuilder::new(DataBlockBuilderOptions::default().with_restart_interval(4));
+
+        let keys: Vec<Vec<u8>> = (0..9)
+            .map(|i| format!("key{:03}", i).into_bytes())
+            .collect();
+        let wide_value = vec![b'x'; 1000];
+        for key in &keys {
+            builder.add(key, &wide_value);
+        }
+
+        let block_bytes = builder.finish(
+            CompressionType::Snappy,
+            crate::types::ChecksumType::CRC32c,
+            None,
+            None,
+        )?;
+
+        let block = DataBlock::new(&block_bytes, CompressionType::Snappy)?;
+        assert_eq!(block.get_keys()?, keys);
+        assert_eq!(block.num_entries(), keys.len());
+        Ok(())
+    }
 }
@@ -0,0 +1,452 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Direct I/O: files opened so that reads and writes bypass the OS page cache.
+//!
+//! Direct I/O requires the buffer address, length and file offset of every request
+//! to be sector aligned. Reads are therefore widened to aligned boundaries and issued
+//! into [`AlignedBuffer`]s taken from a process-wide pool, so the memory used for
+//! direct reads stays bounded. Writes are staged in an aligned buffer and the file
+//! is trimmed to its logical size once the final, zero-padded sector is written.
+//!
+//! The mechanism is O_DIRECT on Linux, F_NOCACHE on macOS and
+//! FILE_FLAG_NO_BUFFERING on Windows.
+
+use std::alloc::{Layout, alloc_zeroed, dealloc};
+use std::fs::{File, OpenOptions};
+use std::io::{self, Write};
+use std::ops::Deref;
+use std::path::Path;
+use std::ptr::NonNull;
+use std::sync::Mutex;
+
+/// Alignment of buffers, offsets and lengths for direct I/O.
+/// 4 KiB satisfies the logical block size of practically all devices.
+pub const DIRECT_IO_ALIGNMENT: usize = 4096;
+
+/// Number of idle buffers kept by the shared pool
+const MAX_POOLED_BUFFERS: usize = 16;
+/// Buffers larger than this are freed instead of pooled
+const MAX_POOLED_BUFFER_SIZE: usize = 4 << 20;
+/// Staging buffer size of [`DirectFileWriter`]
+const DIRECT_WRITE_BUFFER_SIZE: usize = 1 << 20;
+
+static DIRECT_IO_BUFFER_POOL: AlignedBufferPool = AlignedBufferPool::new();
+
+fn align_down(value: u64) -> u64 {
+    value & !(DIRECT_IO_ALIGNMENT as u64 - 1)
+}
+
+fn align_up(value: u64) -> u64 {
+    align_down(value + DIRECT_IO_ALIGNMENT as u64 - 1)
+}
+
+/// Zero-initialized heap buffer aligned to [`DIRECT_IO_ALIGNMENT`]
+pub struct AlignedBuffer {
+    ptr: NonNull<u8>,
+    capacity: usize,
+    len: usize,
+}
+
+// The buffer exclusively owns its allocation
+unsafe impl Send for AlignedBuffer {}
+unsafe impl Sync for AlignedBuffer {}
+
+impl AlignedBuffer {
+    /// Allocate a buffer holding at least `capacity` bytes, rounded up to the alignment
+    pub fn with_capacity(capacity: usize) -> Self {
+        let capacity = align_up(capacity.max(1) as u64) as usize;
+        let layout = Self::layout(capacity);
+        let ptr = unsafe { alloc_zeroed(layout) };
+        let ptr = NonNull::new(ptr).unwrap_or_else(|| std::alloc::handle_alloc_error(layout));
+
+        AlignedBuffer {
+            ptr,
+            capacity,
+            len: 0,
+        }
+    }
+
+    fn layout(capacity: usize) -> Layout {
+        Layout::from_size_align(capacity, DIRECT_IO_ALIGNMENT).expect("valid aligned layout")
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.capacity
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Set the length. The memory is always initialized, so any length up to the
+    /// capacity is valid; bytes past the old length keep whatever they held before.
+    pub fn set_len(&mut self, len: usize) {
+        assert!(
+            len <= self.capacity,
+            "length exceeds aligned buffer capacity"
+        );
+        self.len = len;
+    }
+
+    pub fn clear(&mut self) {
+        self.len = 0;
+    }
+
+    /// Append as much of `data` as fits, returning the number of bytes copied
+    pub fn extend_from_slice(&mut self, data: &[u8]) -> usize {
+        let n = data.len().min(self.capacity - self.len);
+        let start = self.len;
+        self.len += n;
+        self.as_mut_slice()[start..].copy_from_slice(&data[..n]);
+        n
+    }
+
+    pub fn as_slice(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.ptr.as_ptr(), self.len) }
+    }
+
+    pub fn as_mut_slice(&mut self) -> &mut [u8] {
+        unsafe { std::slice::from_raw_parts_mut(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl Drop for AlignedBuffer {
+    fn drop(&mut self) {
+        unsafe { dealloc(self.ptr.as_ptr(), Self::layout(self.capacity)) }
+    }
+}
+
+/// Pool of reusable aligned buffers
+pub struct AlignedBufferPool {
+    buffers: Mutex<Vec<AlignedBuffer>>,
+}
+
+impl AlignedBufferPool {
+    pub const fn new() -> Self {
+        AlignedBufferPool {
+            buffers: Mutex::new(Vec::new()),
+        }
+    }
+
+    /// The pool used for all direct reads in the process
+    pub fn global() -> &'static AlignedBufferPool {
+        &DIRECT_IO_BUFFER_POOL
+    }
+
+    /// Take an empty buffer with room for at least `capacity` bytes
+    pub fn get(&self, capacity: usize) -> AlignedBuffer {
+        let mut buffers = self.buffers.lock().unwrap();
+        match buffers.iter().position(|b| b.capacity() >= capacity) {
+            Some(i) => {
+                let mut buffer = buffers.swap_remove(i);
+                buffer.clear();
+                buffer
+            }
+            None => {
+                drop(buffers);
+                AlignedBuffer::with_capacity(capacity)
+            }
+        }
+    }
+
+    /// Return a buffer for reuse
+    pub fn put(&self, buffer: AlignedBuffer) {
+        if buffer.capacity() > MAX_POOLED_BUFFER_SIZE {
+            return;
+        }
+        let mut buffers = self.buffers.lock().unwrap();
+        if buffers.len() < MAX_POOLED_BUFFERS {
+            buffers.push(buffer);
+        }
+    }
+}
+
+impl Default for AlignedBufferPool {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(target_os = "linux")]
+fn open_with(options: &mut OpenOptions, path: &Path) -> io::Result<File> {
+    use std::os::unix::fs::OpenOptionsExt;
+    options.custom_flags(libc::O_DIRECT).open(path)
+}
+
+#[cfg(target_os = "macos")]
+fn open_with(options: &mut OpenOptions, path: &Path) -> io::Result<File> {
+    use std::os::fd::AsRawFd;
+    let file = options.open(path)?;
+    if unsafe { libc::fcntl(file.as_raw_fd(), libc::F_NOCACHE, 1) } == -1 {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(file)
+}
+
+#[cfg(windows)]
+fn open_with(options: &mut OpenOptions, path: &Path) -> io::Result<File> {
+    use std::os::windows::fs::OpenOptionsExt;
+    const FILE_FLAG_NO_BUFFERING: u32 = 0x20000000;
+    options.custom_flags(FILE_FLAG_NO_BUFFERING).open(path)
+}
+
+#[cfg(not(any(target_os = "linux", target_os = "macos", windows)))]
+fn open_with(options: &mut OpenOptions, path: &Path) -> io::Result<File> {
+    options.open(path)
+}
+
+/// Open `path` for direct reads
+pub fn open_direct<P: AsRef<Path>>(path: P) -> io::Result<File> {
+    open_with(OpenOptions::new().read(true), path.as_ref())
+}
+
+/// Create or truncate `path` for direct writes
+pub fn create_direct<P: AsRef<Path>>(path: P) -> io::Result<File> {
+    open_with(
+        OpenOptions::new().write(true).create(true).truncate(true),
+        path.as_ref(),
+    )
+}
+
+#[cfg(unix)]
+fn pread(file: &File, buf: &mut [u8], offset: u64) -> io::Result<usize> {
+    use std::os::unix::fs::FileExt;
+    file.read_at(buf, offset)
+}
+
+#[cfg(windows)]
+fn pread(file: &File, buf: &mut [u8], offset: u64) -> io::Result<usize> {
+    use std::os::windows::fs::FileExt;
+    file.seek_read(buf, offset)
+}
+
+/// Fill `buf` with the bytes at `offset`. Positional reads leave the file
+/// position alone, so one handle can serve several readers at once.
+pub(crate) fn pread_exact(file: &File, buf: &mut [u8], offset: u64) -> io::Result<()> {
+    let len = buf.len();
+    pread_at_least(file, buf, offset, len)
+}
+
+/// Read into `buf` from `offset` until at least its first `needed` bytes are
+/// filled. Every read asks for the rest of `buf`, so an aligned buffer keeps each
+/// request aligned; only the read reaching end of file may come up short.
+fn pread_at_least(file: &File, buf: &mut [u8], offset: u64, needed: usize) -> io::Result<()> {
+    let mut filled = 0;
+    while filled < needed {
+        match pread(file, &mut buf[filled..], offset + filled as u64) {
+            Ok(0) => return Err(io::ErrorKind::UnexpectedEof.into()),
+            Ok(n) => filled += n,
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+            Err(e) => return Err(e),
+        }
+    }
+    Ok(())
+}
+
+fn is_aligned(value: u64) -> bool {
+    value % DIRECT_IO_ALIGNMENT as u64 == 0
+}
+
+/// Bytes returned by [`read_at`], viewed in place in the pooled aligned buffer they
+/// were read into. The buffer goes back to the pool when the view is dropped.
+pub struct AlignedRead {
+    buffer: Option<AlignedBuffer>,
+    start: usize,
+    len: usize,
+}
+
+impl Deref for AlignedRead {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        let buffer = self.buffer.as_ref().expect("aligned read holds its buffer");
+        &buffer.as_slice()[self.start..self.start + self.len]
+    }
+}
+
+impl Drop for AlignedRead {
+    fn drop(&mut self) {
+        if let Some(buffer) = self.buffer.take() {
+            AlignedBufferPool::global().put(buffer);
+        }
+    }
+}
+
+/// Read `len` bytes at `offset` of a file opened with [`open_direct`]. The request
+/// is rounded out to sector boundaries and read into a pooled buffer, which the
+/// result views without copying.
+pub fn read_at(file: &File, offset: u64, len: usize) -> io::Result<AlignedRead> {
+    let aligned_start = align_down(offset);
+    let end = offset + len as u64;
+    let aligned_len = (align_up(end) - aligned_start) as usize;
+
+    let mut buffer = AlignedBufferPool::global().get(aligned_len);
+    buffer.set_len(aligned_len);
+    let mut read = AlignedRead {
+        buffer: None,
+        start: (offset - aligned_start) as usize,
+        len,
+    };
+    // Holding the buffer in the view returns it to the pool on error too
+    let buffer = read.buffer.insert(buffer);
+    pread_at_least(
+        file,
+        buffer.as_mut_slice(),
+        aligned_start,
+        (end - aligned_start) as usize,
+    )?;
+    Ok(read)
+}
+
+/// Fill `buf` with the bytes at `offset` of a file opened with [`open_direct`].
+/// An aligned request is read straight into `buf`; any other goes through
+/// [`read_at`] and is copied out of the pooled buffer.
+pub fn read_exact_at(file: &File, buf: &mut [u8], offset: u64) -> io::Result<()> {
+    if is_aligned(offset) && is_aligned(buf.len() as u64) && is_aligned(buf.as_ptr() as u64) {
+        return pread_exact(file, buf, offset);
+    }
+    buf.copy_from_slice(&read_at(file, offset, buf.len())?);
+    Ok(())
+}
+
+/// Sequential writer for a file opened with [`create_direct`].
+///
+/// Only whole sectors are written until [`DirectFileWriter::finish`], which pads the
+/// last partial sector with zeros and truncates the file back to its logical length.
+pub struct DirectFileWriter {
+    file: File,
+    buffer: AlignedBuffer,
+}
+
+impl DirectFileWriter {
+    pub fn create<P: AsRef<Path>>(path: P) -> io::Result<Self> {
+        Ok(DirectFileWriter {
+            file: create_direct(path)?,
+            buffer: AlignedBuffer::with_capacity(DIRECT_WRITE_BUFFER_SIZE),
+        })
+    }
+
+    /// Write out every complete sector, keeping the partial remainder buffered
+    fn write_full_sectors(&mut self) -> io::Result<()> {
+        let aligned_len = align_down(self.buffer.len() as u64) as usize;
+        if aligned_len == 0 {
+            return Ok(());
+        }
+
+        self.file
+            .write_all(&self.buffer.as_slice()[..aligned_len])?;
+
+        let remainder = self.buffer.len() - aligned_len;
+        let len = self.buffer.len();
+        self.buffer.as_mut_slice().copy_within(aligned_len..len, 0);
+        self.buffer.set_len(remainder);
+        Ok(())
+    }
+
+    /// Write the buffered tail and trim the file to the bytes actually written
+    pub fn finish(&mut self) -> io::Result<()> {
+        self.write_full_sectors()?;
+
+        let remainder = self.buffer.len();
+        if remainder > 0 {
+            let logical_size = self.file.metadata()?.len() + remainder as u64;
+
+            self.buffer.set_len(DIRECT_IO_ALIGNMENT);
+            self.buffer.as_mut_slice()[remainder..].fill(0);
+            self.file.write_all(self.buffer.as_slice())?;
+            self.buffer.clear();
+
+            self.file.set_len(logical_size)?;
+        }
+
+        Ok(())
+    }
+}
+
+impl Write for DirectFileWriter {
+    fn write(&mut self, data: &[u8]) -> io::Result<usize> {
+        if self.buffer.len() == self.buffer.capacity() {
+            self.write_full_sectors()?;
+        }
+        Ok(self.buffer.extend_from_slice(data))
+    }
+
+    /// Writes every complete sector; a trailing partial sector is only written by `finish`
+    fn flush(&mut self) -> io::Result<()> {
+        self.write_full_sectors()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::{Error, Result};
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_direct_write_and_unaligned_reads() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("direct.bin");
+
+        let data: Vec<u8> = (0..3 * DIRECT_IO_ALIGNMENT + 123)
+            .map(|i| (i % 251) as u8)
+            .collect();
+
+        // Some filesystems (e.g. tmpfs) reject O_DIRECT; nothing to test there
+        let mut writer = match DirectFileWriter::create(&path) {
+            Ok(writer) => writer,
+            Err(e) if e.kind() == io::ErrorKind::InvalidInput => return Ok(()),
+            Err(e) => return Err(e.into()),
+        };
+        for chunk in data.chunks(1000) {
+            writer.write_all(chunk)?;
+        }
+        writer.flush()?;
+        writer.finish()?;
+        assert_eq!(std::fs::read(&path)?, data);
+
+        let file = open_direct(&path)?;
+        for (offset, len) in [(0, 10), (4090, 20), (5000, 7000), (data.len() - 50, 50)] {
+            let mut buf = vec![0u8; len];
+            read_exact_at(&file, &mut buf, offset as u64)?;
+            assert_eq!(buf, &data[offset..offset + len]);
+        }
+
+        let view = read_at(&file, 5000, 7000)?;
+        assert_eq!(&view[..], &data[5000..12000]);
+        drop(view);
+
+        // An aligned request is read straight into the caller's buffer
+        let mut aligned = AlignedBuffer::with_capacity(2 * DIRECT_IO_ALIGNMENT);
+        aligned.set_len(2 * DIRECT_IO_ALIGNMENT);
+        read_exact_at(&file, aligned.as_mut_slice(), DIRECT_IO_ALIGNMENT as u64)?;
+        assert_eq!(
+            aligned.as_slice(),
+            &data[DIRECT_IO_ALIGNMENT..3 * DIRECT_IO_ALIGNMENT]
+        );
+
+        let mut buf = vec![0u8; 10];
+        assert!(read_exact_at(&file, &mut buf, data.len() as u64 - 5).is_err());
+        assert!(read_at(&file, data.len() as u64 - 5, 10).is_err());
+        Ok(())
+    }
+
+    #[test]
+    fn test_aligned_buffer_pool_reuse() {
+        let pool = AlignedBufferPool::new();
+        let buffer = pool.get(100);
+        assert_eq!(buffer.capacity(), DIRECT_IO_ALIGNMENT);
+        assert_eq!(buffer.as_slice().as_ptr() as usize % DIRECT_IO_ALIGNMENT, 0);
+
+        let ptr = buffer.as_slice().as_ptr();
+        pool.put(buffer);
+        assert_eq!(pool.get(DIRECT_IO_ALIGNMENT).as_slice().as_ptr(), ptr);
+        assert!(pool.get(DIRECT_IO_ALIGNMENT + 1).capacity() > DIRECT_IO_ALIGNMENT);
+    }
+}
@@ -5,6 +5,7 @@ use byteorder::{ByteOrder, LittleEndian};
 
 use crate::block_handle::BlockHandle;
 use crate::error::{Error, Result};
+use crate::perf_context::PerfTimer;
 use crate::types::{
     ChecksumType, LEGACY_FOOTER_SIZE, LEGACY_MAGIC_NUMBER, ROCKSDB_FOOTER_SIZE,
     ROCKSDB_MAGIC_NUMBER, checksum_modifier_for_context,
@@ -108,42 +109,44 @@ impl Footer {
             return Err(Error::FileTooSmall);
         }
 
+        // A single read covers either footer layout
+        let tail_len = file_size.min(ROCKSDB_FOOTER_SIZE as u64);
+        reader.seek(SeekFrom::End(-(tail_len as i64)))?;
+        let mut tail = vec![0u8; tail_len as usize];
+        reader.read_exact(&mut tail)?;
+
+        Self::decode_from_tail(&tail, file_size)
+    }
+
+    /// Decode the footer from `tail`, which holds the last bytes of a file of `file_size` bytes.
+    /// `tail` must cover at least the footer, i.e. `min(file_size, ROCKSDB_FOOTER_SIZE)` bytes.
+    pub fn decode_from_tail(tail: &[u8], file_size: u64) -> Result<Self> {
+        if file_size < LEGACY_FOOTER_SIZE as u64 {
+            return Err(Error::FileTooSmall);
+        }
+        if (tail.len() as u64) < file_size.min(ROCKSDB_FOOTER_SIZE as u64) {
+            return Err(Error::InvalidFooterSize(tail.len()));
+        }
+
         // First, check for the new magic number at position -8
-        reader.seek(SeekFrom::End(-8))?;
-        let mut magic_bytes = [0u8; 8];
-        reader.read_exact(&mut magic_bytes)?;
-        let magic = u64::from_le_bytes(magic_bytes);
+        let magic = LittleEndian::read_u64(&tail[tail.len() - 8..]);
 
         if magic == ROCKSDB_MAGIC_NUMBER {
-            // New format - read format version to determine footer size
-            reader.seek(SeekFrom::End(-12))?;
-            let mut version_bytes = [0u8; 4];
-            reader.read_exact(&mut version_bytes)?;
-
-            // Read the full footer
             if file_size < ROCKSDB_FOOTER_SIZE as u64 {
                 return Err(Error::FileTooSmall);
             }
-            reader.seek(SeekFrom::End(-(ROCKSDB_FOOTER_SIZE as i64)))?;
-            let mut footer_data = vec![0u8; ROCKSDB_FOOTER_SIZE];
-            reader.read_exact(&mut footer_data)?;
-
+            let footer_data = &tail[tail.len() - ROCKSDB_FOOTER_SIZE..];
             let input_offset = file_size - (ROCKSDB_FOOTER_SIZE as u64);
-            Self::decode_from_bytes(&footer_data, input_offset)
+            Self::decode_from_bytes(footer_data, input_offset)
         } else {
             // Check for legacy magic number at position -48
-            reader.seek(SeekFrom::End(-(LEGACY_FOOTER_SIZE as i64)))?;
-            let mut legacy_magic_bytes = [0u8; 8];
-            reader.read_exact(&mut legacy_magic_bytes)?;
-            let legacy_magic = u64::from_le_bytes(legacy_magic_bytes);
+            let footer_data = &tail[tail.len() - LEGACY_FOOTER_SIZE..];
+            let legacy_magic = LittleEndian::read_u64(&footer_data[..8]);
 
             if legacy_magic == LEGACY_MAGIC_NUMBER {
                 // Legacy format (v0) - 48-byte footer
-                reader.seek(SeekFrom::End(-(LEGACY_FOOTER_SIZE as i64)))?;
-                let mut footer_data = vec![0u8; LEGACY_FOOTER_SIZE];
-                reader.read_exact(&mut footer_data)?;
                 let input_offset = file_size - (LEGACY_FOOTER_SIZE as u64);
-                Self::decode_from_bytes(&footer_data, input_offset)
+                Self::decode_from_bytes(footer_data, input_offset)
             } else {
                 Err(Error::InvalidMagicNumber(magic))
             }
@@ -253,11 +256,13 @@ impl Footer {
             // Zero out the checksum field (bytes 5-8 from the start)
             footer_copy[5..9].fill(0);
 
+            let timer = PerfTimer::start();
             let computed_checksum = checksum_type.calculate(&footer_copy);
             let modified_checksum = computed_checksum.wrapping_add(checksum_modifier_for_context(
                 base_context_checksum,
                 input_offset,
             ));
+            timer.stop(|context| &mut context.block_checksum_nanos);
 
             if modified_checksum != stored_checksum {
                 return Err(Error::DataCorruption(format!(
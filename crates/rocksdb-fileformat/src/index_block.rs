@@ -1,6 +1,7 @@
 use crate::block_handle::BlockHandle;
 use crate::compression::decompress;
 use crate::error::{Error, Result};
+use crate::perf_context::PerfTimer;
 use crate::types::CompressionType;
 use byteorder::{LittleEndian, ReadBytesExt};
 use std::io::Cursor;
@@ -10,6 +11,63 @@ pub struct IndexEntry {
     pub block_handle: BlockHandle,
 }
 
+/// The separator keys and block handles of an index block, decoded once. Keys are
+/// stored back to back in a single buffer.
+#[derive(Debug, Default)]
+pub struct DecodedIndex {
+    keys: Vec<u8>,
+    /// End of each key in `keys`
+    key_ends: Vec<usize>,
+    handles: Vec<BlockHandle>,
+}
+
+impl DecodedIndex {
+    /// Number of data blocks
+    pub fn len(&self) -> usize {
+        self.handles.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.handles.is_empty()
+    }
+
+    /// Separator key of block `index`: not smaller than any key in the block
+    pub fn key(&self, index: usize) -> &[u8] {
+        let start = index.checked_sub(1).map_or(0, |i| self.key_ends[i]);
+        &self.keys[start..self.key_ends[index]]
+    }
+
+    pub fn handles(&self) -> &[BlockHandle] {
+        &self.handles
+    }
+
+    /// Index of the first block whose separator is not smaller than `key`, which
+    /// is `len()` when `key` is past the last block
+    pub fn block_index_for_key(&self, key: &[u8]) -> usize {
+        let timer = PerfTimer::start();
+        let mut low = 0;
+        let mut high = self.len();
+        while low < high {
+            let mid = low + (high - low) / 2;
+            if self.key(mid) < key {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        timer.stop(|context| &mut context.index_seek_nanos);
+        low
+    }
+
+    /// Memory held by the keys and handles
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>()
+            + self.keys.capacity()
+            + self.key_ends.capacity() * size_of::<usize>()
+            + self.handles.capacity() * size_of::<BlockHandle>()
+    }
+}
+
 pub struct IndexBlock {
     data: Vec<u8>,
     restart_offset: usize,
@@ -19,14 +77,18 @@ pub struct IndexBlock {
 
 impl IndexBlock {
     pub fn new(compressed_data: &[u8], compression_type: CompressionType) -> Result<Self> {
-        let raw_data = decompress(compressed_data, compression_type)?;
-
-        // RocksDB blocks have a 5-byte trailer: compression_type (1) + checksum (4)
-        let data = if raw_data.len() >= 5 {
-            raw_data[..raw_data.len() - 5].to_vec()
+        // RocksDB blocks have a 5-byte trailer: compression_type (1) + checksum (4).
+        // The trailer is appended after compression, so strip it first.
+        let contents = if compressed_data.len() >= 5 {
+            &compressed_data[..compressed_data.len() - 5]
         } else {
-            raw_data
+            compressed_data
         };
+        let timer = PerfTimer::start();
+        let data = decompress(contents, compression_type)?;
+        if compression_type != CompressionType::None {
+            timer.stop(|context| &mut context.block_decompress_nanos);
+        }
 
         if data.len() < 4 {
             return Err(Error::InvalidBlockFormat(
@@ -38,21 +100,10 @@ impl IndexBlock {
         cursor.set_position((data.len() - 4) as u64);
         let num_restarts = cursor.read_u32::<LittleEndian>()?;
 
-        // Check if this looks like a valid restart count (reasonable small number)
-        if num_restarts == 0 || num_restarts > 1000 {
-            // This might not be a standard block format
-            // Try to parse as a single-entry index with no restart points
-            let data_len = data.len();
-            return Ok(IndexBlock {
-                data,
-                restart_offset: data_len,
-                num_restarts: 1,
-                restart_points: vec![0],
-            });
-        }
-
-        if data.len() < 4 + (num_restarts as usize * 4) {
-            // Fallback to simple format
+        // Large files have index blocks with many thousands of restarts, so only a
+        // count whose restart array does not fit in the block marks a block without
+        // the standard layout, parsed as a single-entry index with no restart points
+        if num_restarts == 0 || data.len() < 4 + (num_restarts as usize * 4) {
             let data_len = data.len();
             return Ok(IndexBlock {
                 data,
@@ -84,10 +135,46 @@ impl IndexBlock {
         })
     }
 
+    /// Memory held by the decoded block
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>() + self.data.capacity() + self.restart_points.capacity() * size_of::<u32>()
+    }
+
     pub fn get_entries(&self) -> Result<Vec<IndexEntry>> {
         let mut entries = Vec::new();
+        self.for_each_entry(|key, block_handle| {
+            entries.push(IndexEntry {
+                key: key.to_vec(),
+                block_handle,
+            });
+            Ok(())
+        })?;
+        Ok(entries)
+    }
+
+    /// Decode the separator keys and block handles once, for lookups that binary
+    /// search them instead of walking the block
+    pub fn decode_entries(&self) -> Result<DecodedIndex> {
+        let mut index = DecodedIndex::default();
+        self.for_each_entry(|key, block_handle| {
+            index.keys.extend_from_slice(key);
+            index.key_ends.push(index.keys.len());
+            index.handles.push(block_handle);
+            Ok(())
+        })?;
+        index.keys.shrink_to_fit();
+        index.key_ends.shrink_to_fit();
+        index.handles.shrink_to_fit();
+        Ok(index)
+    }
+
+    /// Visit every entry in order with its full key
+    fn for_each_entry<F>(&self, mut f: F) -> Result<()>
+    where
+        F: FnMut(&[u8], BlockHandle) -> Result<()>,
+    {
         let mut cursor = Cursor::new(&self.data);
-        let mut last_key = Vec::new();
+        let mut key = Vec::new();
 
         // Try to find a valid starting point by looking for an entry with shared_len=0
         let mut start_pos = 0;
@@ -110,18 +197,22 @@ impl IndexBlock {
         while (cursor.position() as usize) < self.restart_offset {
             let entry_start = cursor.position();
 
+            // At restart points, we should have no shared prefix
+            if self.is_restart_point(entry_start as u32) {
+                key.clear();
+            }
+
             let shared_key_len = self.read_varint(&mut cursor)?;
             let unshared_key_len = self.read_varint(&mut cursor)?;
             let value_len = self.read_varint(&mut cursor)?;
 
-            if shared_key_len > last_key.len() as u32 {
+            if shared_key_len > key.len() as u32 {
                 return Err(Error::InvalidBlockFormat(
                     "Shared key length exceeds previous key length in index block".to_string(),
                 ));
             }
 
-            let mut key = Vec::new();
-            key.extend_from_slice(&last_key[..shared_key_len as usize]);
+            key.truncate(shared_key_len as usize);
 
             if unshared_key_len > 0 {
                 let pos = cursor.position() as usize;
@@ -151,15 +242,10 @@ impl IndexBlock {
             let block_handle = self.parse_block_handle(value_data)?;
             cursor.set_position((value_start + value_len as usize) as u64);
 
-            last_key = key.clone();
-            entries.push(IndexEntry { key, block_handle });
-
-            if self.is_restart_point(entry_start as u32) {
-                last_key.clear();
-            }
+            f(&key, block_handle)?;
         }
 
-        Ok(entries)
+        Ok(())
     }
 
     fn parse_block_handle(&self, data: &[u8]) -> Result<BlockHandle> {
@@ -236,19 +322,17 @@ impl IndexBlock {
     }
 
     pub fn find_block_for_key(&self, target_key: &[u8]) -> Result<Option<BlockHandle>> {
+        let timer = PerfTimer::start();
         let entries = self.get_entries()?;
 
-        for entry in entries.iter() {
-            if entry.key.as_slice() >= target_key {
-                return Ok(Some(entry.block_handle.clone()));
-            }
-        }
-
-        if let Some(last_entry) = entries.last() {
-            Ok(Some(last_entry.block_handle.clone()))
-        } else {
-            Ok(None)
-        }
+        // Past the last separator, fall back to the last block
+        let handle = entries
+            .iter()
+            .find(|entry| entry.key.as_slice() >= target_key)
+            .or(entries.last())
+            .map(|entry| entry.block_handle.clone());
+        timer.stop(|context| &mut context.index_seek_nanos);
+        Ok(handle)
     }
 
     pub fn get_all_block_handles(&self) -> Result<Vec<BlockHandle>> {
@@ -289,6 +373,29 @@ mod tests {
         Ok(())
     }
 
+    #[test]
+    fn test_roundtrip_index_block_many_restarts() -> Result<()> {
+        let mut builder = IndexBlockBuilder::new(1);
+        for i in 0..5000u64 {
+            builder.add_index_entry(
+                format!("key{:05}", i).as_bytes(),
+                &BlockHandle::new(i * 4096, 4000),
+            );
+        }
+        let block_data = builder.finish(CompressionType::None, ChecksumType::CRC32c, None, None)?;
+
+        let index_block = IndexBlock::new(&block_data, CompressionType::None)?;
+        assert_eq!(index_block.restart_points.len(), 5000);
+        let entries = index_block.get_entries()?;
+        assert_eq!(entries.len(), 5000);
+        assert_eq!(entries[4999].key, b"key04999");
+        assert_eq!(
+            index_block.find_block_for_key(b"key03000")?,
+            Some(BlockHandle::new(3000 * 4096, 4000))
+        );
+        Ok(())
+    }
+
     #[test]
     fn test_roundtrip_find_block_for_key() -> Result<()> {
         let key1 = b"key001";
@@ -320,6 +427,14 @@ mod tests {
         let result = index_block.find_block_for_key(b"key002")?;
         assert!(result.is_some());
         assert_eq!(result.unwrap().offset, handle2.offset);
+
+        let decoded = index_block.decode_entries()?;
+        assert_eq!(decoded.len(), 2);
+        assert_eq!(decoded.key(1), key2);
+        assert_eq!(decoded.handles(), &[handle1, handle2]);
+        assert_eq!(decoded.block_index_for_key(b"key000"), 0);
+        assert_eq!(decoded.block_index_for_key(b"key0015"), 1);
+        assert_eq!(decoded.block_index_for_key(b"key003"), 2);
         Ok(())
     }
 }
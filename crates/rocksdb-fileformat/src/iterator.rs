@@ -1,8 +1,17 @@
-use crate::data_block::DataBlockReader;
+use crate::block_cache_tracer::{TableReaderCaller, TraceBlockType};
+use crate::block_handle::BlockHandle;
+use crate::data_block::{DataBlock, DataBlockCursor, DataBlockReader};
 use crate::error::Result;
-use crate::index_block::IndexBlock;
+use crate::index_block::DecodedIndex;
+use crate::memory_budget::MemoryReservation;
+use crate::prefetch_buffer::FilePrefetchBuffer;
 use crate::sst_reader::SstReader;
-use crate::types::CompressionType;
+use crate::statistics::{Histogram, StopWatch};
+use crate::types::{CompressionType, ReadOptions};
+use std::sync::Arc;
+
+/// Upper bound on the size of a single coalesced multi_get read
+const MAX_COALESCED_READ_SIZE: u64 = 1 << 20;
 
 pub trait SstIterator {
     fn seek_to_first(&mut self) -> Result<()>;
@@ -17,43 +26,112 @@ pub trait SstIterator {
 
 pub struct SstTableIterator {
     sst_reader: SstReader,
-    index_block: IndexBlock,
     current_data_block: Option<DataBlockReader>,
     current_block_index: usize,
-    all_block_handles: Vec<crate::block_handle::BlockHandle>,
+    /// Separator keys and handles of every data block, decoded once and searched
+    /// by seeks and multi_get
+    index: Arc<DecodedIndex>,
     compression_type: CompressionType,
+    prefetch_buffer: FilePrefetchBuffer,
     valid: bool,
+    /// Operation data blocks are loaded for, as recorded in block traces
+    caller: TableReaderCaller,
+    /// Budget charge for an index the iterator decoded itself, released when the
+    /// iterator is dropped
+    _memory_reservation: Option<MemoryReservation>,
 }
 
 impl SstTableIterator {
-    pub fn new(mut sst_reader: SstReader, compression_type: CompressionType) -> Result<Self> {
-        let footer = sst_reader.get_footer();
-        let index_data = sst_reader.read_block(footer.index_handle.clone())?;
-        let index_block = IndexBlock::new(&index_data, CompressionType::None)?;
-        let all_block_handles = index_block.get_all_block_handles()?;
+    pub fn new(sst_reader: SstReader, compression_type: CompressionType) -> Result<Self> {
+        Self::with_options(sst_reader, compression_type, &ReadOptions::default())
+    }
+
+    pub fn with_options(
+        mut sst_reader: SstReader,
+        compression_type: CompressionType,
+        options: &ReadOptions,
+    ) -> Result<Self> {
+        let index = sst_reader.read_index_block()?.decode_entries()?;
+        let memory_reservation = options
+            .memory_budget
+            .as_ref()
+            .map(|budget| budget.reserve(index.approximate_memory_usage()));
+        Ok(Self::from_parts(
+            sst_reader,
+            Arc::new(index),
+            compression_type,
+            options,
+            memory_reservation,
+        ))
+    }
+
+    /// Iterate a table whose index was already decoded and is pinned elsewhere.
+    /// The owner of the index charges it to the memory budget, so the iterator
+    /// does not charge it again.
+    pub(crate) fn with_shared_index(
+        sst_reader: SstReader,
+        index: Arc<DecodedIndex>,
+        compression_type: CompressionType,
+        options: &ReadOptions,
+    ) -> Self {
+        Self::from_parts(sst_reader, index, compression_type, options, None)
+    }
 
-        Ok(SstTableIterator {
+    fn from_parts(
+        sst_reader: SstReader,
+        index: Arc<DecodedIndex>,
+        compression_type: CompressionType,
+        options: &ReadOptions,
+        memory_reservation: Option<MemoryReservation>,
+    ) -> Self {
+        SstTableIterator {
             sst_reader,
-            index_block,
             current_data_block: None,
             current_block_index: 0,
-            all_block_handles,
+            index,
             compression_type,
+            prefetch_buffer: FilePrefetchBuffer::new(options),
             valid: false,
-        })
+            caller: TableReaderCaller::UserIterator,
+            _memory_reservation: memory_reservation,
+        }
+    }
+
+    /// Memory held by the iterator: its reader, the decoded index, the current data
+    /// block and the readahead buffer
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>()
+            + self.sst_reader.approximate_memory_usage()
+            + self.index.approximate_memory_usage()
+            + self
+                .current_data_block
+                .as_ref()
+                .map_or(0, |block| block.approximate_memory_usage())
+            + self.prefetch_buffer.approximate_memory_usage()
     }
 
     fn load_data_block(&mut self, block_index: usize) -> Result<()> {
-        if block_index >= self.all_block_handles.len() {
+        if block_index >= self.index.len() {
             self.current_data_block = None;
             self.valid = false;
             return Ok(());
         }
 
-        let block_handle = self.all_block_handles[block_index].clone();
-        let data_block_reader = self
-            .sst_reader
-            .read_data_block_reader(block_handle, self.compression_type)?;
+        let block_data = self.prefetch_buffer.read_block(
+            &mut self.sst_reader,
+            &self.index.handles()[block_index],
+            self.caller,
+        )?;
+        // Decode into the buffer of the block being replaced
+        let buffer = self
+            .current_data_block
+            .take()
+            .map(|reader| reader.into_block().into_data())
+            .unwrap_or_default();
+        let data_block_reader = DataBlockReader::from_block(
+            self.sst_reader
+                .decode_data_block_into(block_data, self.compression_type, buffer)?,
+        )?;
 
         self.current_data_block = Some(data_block_reader);
         self.current_block_index = block_index;
@@ -68,13 +146,121 @@ impl SstTableIterator {
     }
 
     pub fn block_count(&self) -> usize {
-        self.all_block_handles.len()
+        self.index.len()
+    }
+
+    /// Visit every entry of the table with borrowed key and value slices.
+    /// Blocks are decoded one at a time and no allocation is made per entry.
+    pub fn for_each_entry<F>(&mut self, mut f: F) -> Result<()>
+    where
+        F: FnMut(&[u8], &[u8]) -> Result<()>,
+    {
+        let mut buffer = Vec::new();
+        for block_handle in self.index.handles() {
+            let block_data = self.prefetch_buffer.read_block(
+                &mut self.sst_reader,
+                block_handle,
+                TableReaderCaller::UserIterator,
+            )?;
+            let data_block = self.sst_reader.decode_data_block_into(
+                block_data,
+                self.compression_type,
+                buffer,
+            )?;
+            data_block.for_each_entry(&mut f)?;
+            buffer = data_block.into_data();
+        }
+
+        Ok(())
+    }
+
+    /// Look up a batch of keys, returning their values in input order.
+    ///
+    /// Keys are sorted and grouped by the data block the index maps them to, so every
+    /// needed block is read and decoded once. Physically adjacent blocks are fetched
+    /// with a single coalesced read.
+    pub fn multi_get(&mut self, keys: &[&[u8]]) -> Result<Vec<Option<Vec<u8>>>> {
+        let mut results = vec![None; keys.len()];
+        if keys.is_empty() {
+            return Ok(results);
+        }
+
+        let handles = self.index.handles();
+        let groups = group_keys_by_block(&self.index, keys);
+        let mut buffer = Vec::new();
+
+        let mut start = 0;
+        while start < groups.len() {
+            let first = &handles[groups[start].0];
+            let mut read_end = first.offset + first.size;
+
+            let mut end = start + 1;
+            while end < groups.len() {
+                let handle = &handles[groups[end].0];
+                if handle.offset != read_end
+                    || handle.offset + handle.size - first.offset > MAX_COALESCED_READ_SIZE
+                {
+                    break;
+                }
+                read_end = handle.offset + handle.size;
+                end += 1;
+            }
+
+            let contents = self
+                .sst_reader
+                .read_range(&BlockHandle::new(first.offset, read_end - first.offset))?;
+
+            for (block_index, key_indexes) in &groups[start..end] {
+                let handle = &handles[*block_index];
+                self.sst_reader.trace_block_access(
+                    handle,
+                    TraceBlockType::Data,
+                    TableReaderCaller::UserMultiGet,
+                    false,
+                );
+                let block_start = (handle.offset - first.offset) as usize;
+                let data_block = self.sst_reader.decode_data_block_into(
+                    &contents[block_start..block_start + handle.size as usize],
+                    self.compression_type,
+                    buffer,
+                )?;
+                buffer = lookup_in_block(data_block, keys, key_indexes, &mut results)?.into_data();
+            }
+
+            start = end;
+        }
+
+        Ok(results)
+    }
+
+    /// Visit every key of the table in order without materializing values
+    pub fn for_each_key<F>(&mut self, mut f: F) -> Result<()>
+    where
+        F: FnMut(&[u8]) -> Result<()>,
+    {
+        let mut buffer = Vec::new();
+        for block_handle in self.index.handles() {
+            let block_data = self.prefetch_buffer.read_block(
+                &mut self.sst_reader,
+                block_handle,
+                TableReaderCaller::UserIterator,
+            )?;
+            let data_block = self.sst_reader.decode_data_block_into(
+                block_data,
+                self.compression_type,
+                buffer,
+            )?;
+            data_block.for_each_key(&mut f)?;
+            buffer = data_block.into_data();
+        }
+
+        Ok(())
     }
 }
 
 impl SstIterator for SstTableIterator {
     fn seek_to_first(&mut self) -> Result<()> {
-        if self.all_block_handles.is_empty() {
+        if self.index.is_empty() {
             self.valid = false;
             return Ok(());
         }
@@ -92,12 +278,12 @@ impl SstIterator for SstTableIterator {
     }
 
     fn seek_to_last(&mut self) -> Result<()> {
-        if self.all_block_handles.is_empty() {
+        if self.index.is_empty() {
             self.valid = false;
             return Ok(());
         }
 
-        let last_block_index = self.all_block_handles.len() - 1;
+        let last_block_index = self.index.len() - 1;
         self.load_data_block(last_block_index)?;
 
         if let Some(ref mut data_block) = self.current_data_block {
@@ -120,24 +306,20 @@ impl SstIterator for SstTableIterator {
     }
 
     fn seek(&mut self, target_key: &[u8]) -> Result<()> {
-        let block_handle = self.index_block.find_block_for_key(target_key)?;
-
-        if let Some(handle) = block_handle {
-            if let Some(block_index) = self
-                .all_block_handles
-                .iter()
-                .position(|h| h.offset == handle.offset && h.size == handle.size)
-            {
-                self.load_data_block(block_index)?;
-
-                if let Some(ref mut data_block) = self.current_data_block {
-                    self.valid = data_block.seek(target_key);
-                } else {
-                    self.valid = false;
-                }
-            } else {
-                self.valid = false;
-            }
+        if self.index.is_empty() {
+            self.valid = false;
+            return Ok(());
+        }
+
+        // Past the last separator, fall back to the last block
+        let block_index = self
+            .index
+            .block_index_for_key(target_key)
+            .min(self.index.len() - 1);
+        self.load_data_block(block_index)?;
+
+        if let Some(ref mut data_block) = self.current_data_block {
+            self.valid = data_block.seek(target_key);
         } else {
             self.valid = false;
         }
@@ -156,7 +338,7 @@ impl SstIterator for SstTableIterator {
             }
 
             let next_block_index = self.current_block_index + 1;
-            if next_block_index < self.all_block_handles.len() {
+            if next_block_index < self.index.len() {
                 self.load_data_block(next_block_index)?;
 
                 if let Some(ref mut new_data_block) = self.current_data_block {
@@ -221,34 +403,126 @@ impl SstIterator for SstTableIterator {
     }
 }
 
+/// Sort `keys` and group their indexes by the data block each one falls in.
+///
+/// Index keys are the last key of each block, so a key belongs to the first block
+/// whose index key is not smaller than it. Keys past the end of the table are dropped.
+pub(crate) fn group_keys_by_block(
+    index: &DecodedIndex,
+    keys: &[&[u8]],
+) -> Vec<(usize, Vec<usize>)> {
+    let mut order: Vec<usize> = (0..keys.len()).collect();
+    order.sort_by(|&a, &b| keys[a].cmp(keys[b]));
+
+    let mut groups: Vec<(usize, Vec<usize>)> = Vec::new();
+    for key_index in order {
+        let block_index = index.block_index_for_key(keys[key_index]);
+        if block_index == index.len() {
+            continue;
+        }
+
+        match groups.last_mut() {
+            Some((last_block, members)) if *last_block == block_index => members.push(key_index),
+            _ => groups.push((block_index, vec![key_index])),
+        }
+    }
+
+    groups
+}
+
+/// Resolve `key_indexes` (sorted by key) against a single decoded block in one pass.
+/// The block is handed back so that its buffer can be reused.
+pub(crate) fn lookup_in_block(
+    data_block: DataBlock,
+    keys: &[&[u8]],
+    key_indexes: &[usize],
+    results: &mut [Option<Vec<u8>>],
+) -> Result<DataBlock> {
+    let mut cursor = DataBlockCursor::new(data_block);
+    let mut valid = cursor.seek_to_first()?;
+
+    for &key_index in key_indexes {
+        let target = keys[key_index];
+        while valid && cursor.key().is_some_and(|key| key < target) {
+            valid = cursor.next()?;
+        }
+        if !valid {
+            break;
+        }
+        if cursor.key() == Some(target) {
+            results[key_index] = cursor.value().map(|value| value.to_vec());
+        }
+    }
+
+    Ok(cursor.into_block())
+}
+
 pub struct SstEntryIterator {
     iterator: SstTableIterator,
 }
 
 impl SstEntryIterator {
     pub fn new(sst_reader: SstReader, compression_type: CompressionType) -> Result<Self> {
-        let iterator = SstTableIterator::new(sst_reader, compression_type)?;
+        Self::with_options(sst_reader, compression_type, &ReadOptions::default())
+    }
+
+    pub fn with_options(
+        sst_reader: SstReader,
+        compression_type: CompressionType,
+        options: &ReadOptions,
+    ) -> Result<Self> {
+        let iterator = SstTableIterator::with_options(sst_reader, compression_type, options)?;
         Ok(SstEntryIterator { iterator })
     }
 
     pub fn collect_all(&mut self) -> Result<Vec<(Vec<u8>, Vec<u8>)>> {
         let mut entries = Vec::new();
-        self.iterator.seek_to_first()?;
-
-        while self.iterator.valid() {
-            if let (Some(key), Some(value)) = (self.iterator.key(), self.iterator.value()) {
-                entries.push((key.to_vec(), value.to_vec()));
-            }
-            if !self.iterator.next()? {
-                break;
-            }
-        }
+        self.iterator.for_each_entry(|key, value| {
+            entries.push((key.to_vec(), value.to_vec()));
+            Ok(())
+        })?;
 
         Ok(entries)
     }
 
+    /// Visit every entry with borrowed key and value slices, see
+    /// [`SstTableIterator::for_each_entry`]
+    pub fn for_each_entry<F>(&mut self, f: F) -> Result<()>
+    where
+        F: FnMut(&[u8], &[u8]) -> Result<()>,
+    {
+        self.iterator.for_each_entry(f)
+    }
+
+    /// Visit every key without materializing values, see [`SstTableIterator::for_each_key`]
+    pub fn for_each_key<F>(&mut self, f: F) -> Result<()>
+    where
+        F: FnMut(&[u8]) -> Result<()>,
+    {
+        self.iterator.for_each_key(f)
+    }
+
+    pub fn collect_keys(&mut self) -> Result<Vec<Vec<u8>>> {
+        let mut keys = Vec::new();
+        self.iterator.for_each_key(|key| {
+            keys.push(key.to_vec());
+            Ok(())
+        })?;
+
+        Ok(keys)
+    }
+
     pub fn find(&mut self, target_key: &[u8]) -> Result<Option<Vec<u8>>> {
-        self.iterator.seek(target_key)?;
+        let statistics = self.iterator.sst_reader.shared_statistics();
+        let _stop_watch = StopWatch::start(statistics.as_deref(), Histogram::TableGetNanos);
+        self.find_impl(target_key)
+    }
+
+    fn find_impl(&mut self, target_key: &[u8]) -> Result<Option<Vec<u8>>> {
+        self.iterator.caller = TableReaderCaller::UserGet;
+        let result = self.iterator.seek(target_key);
+        self.iterator.caller = TableReaderCaller::UserIterator;
+        result?;
 
         if self.iterator.valid() {
             if let Some(key) = self.iterator.key() {
@@ -261,6 +535,15 @@ impl SstEntryIterator {
         Ok(None)
     }
 
+    pub fn approximate_memory_usage(&self) -> usize {
+        self.iterator.approximate_memory_usage()
+    }
+
+    /// Batched point lookups, see [`SstTableIterator::multi_get`]
+    pub fn multi_get(&mut self, keys: &[&[u8]]) -> Result<Vec<Option<Vec<u8>>>> {
+        self.iterator.multi_get(keys)
+    }
+
     pub fn entries_count(&self) -> usize {
         self.iterator.entries_count()
     }
@@ -292,3 +575,252 @@ impl Iterator for SstEntryIterator {
         }
     }
 }
+
+/// Streaming iterator that lends key and value slices into the current block.
+///
+/// Each call to [`next_entry`](Self::next_entry) invalidates the slices returned by the
+/// previous call, which lets the iterator reuse its buffers instead of allocating per entry.
+pub struct SstLendingIterator {
+    sst_reader: SstReader,
+    /// Separator keys and handles of every data block, decoded once
+    index: DecodedIndex,
+    compression_type: CompressionType,
+    next_block_index: usize,
+    current_block: Option<DataBlockCursor>,
+    prefetch_buffer: FilePrefetchBuffer,
+    /// Budget charge for the decoded index, released when the iterator is dropped
+    _memory_reservation: Option<MemoryReservation>,
+}
+
+impl SstLendingIterator {
+    pub fn new(sst_reader: SstReader, compression_type: CompressionType) -> Result<Self> {
+        Self::with_options(sst_reader, compression_type, &ReadOptions::default())
+    }
+
+    pub fn with_options(
+        mut sst_reader: SstReader,
+        compression_type: CompressionType,
+        options: &ReadOptions,
+    ) -> Result<Self> {
+        let index = sst_reader.read_index_block()?.decode_entries()?;
+        let memory_reservation = options
+            .memory_budget
+            .as_ref()
+            .map(|budget| budget.reserve(index.approximate_memory_usage()));
+
+        Ok(SstLendingIterator {
+            sst_reader,
+            index,
+            compression_type,
+            next_block_index: 0,
+            current_block: None,
+            prefetch_buffer: FilePrefetchBuffer::new(options),
+            _memory_reservation: memory_reservation,
+        })
+    }
+
+    /// Advance to the next entry and return borrowed slices to its key and value
+    pub fn next_entry(&mut self) -> Result<Option<(&[u8], &[u8])>> {
+        loop {
+            if let Some(cursor) = self.current_block.as_mut() {
+                if cursor.next()? {
+                    break;
+                }
+            }
+
+            if self.next_block_index >= self.index.len() {
+                self.current_block = None;
+                return Ok(None);
+            }
+
+            let block_data = self.prefetch_buffer.read_block(
+                &mut self.sst_reader,
+                &self.index.handles()[self.next_block_index],
+                TableReaderCaller::UserIterator,
+            )?;
+            self.next_block_index += 1;
+            let buffer = self
+                .current_block
+                .take()
+                .map(|cursor| cursor.into_block().into_data())
+                .unwrap_or_default();
+
+            let data_block = self.sst_reader.decode_data_block_into(
+                block_data,
+                self.compression_type,
+                buffer,
+            )?;
+            self.current_block = Some(DataBlockCursor::new(data_block));
+        }
+
+        Ok(self.current_entry())
+    }
+
+    /// Position at the first entry not smaller than `key` and return it. The next
+    /// [`next_entry`](Self::next_entry) continues after it.
+    pub fn seek(&mut self, key: &[u8]) -> Result<Option<(&[u8], &[u8])>> {
+        self.next_block_index = self.index.block_index_for_key(key);
+        self.current_block = None;
+        while self
+            .next_entry()?
+            .is_some_and(|(entry_key, _)| entry_key < key)
+        {}
+        Ok(self.current_entry())
+    }
+
+    fn current_entry(&self) -> Option<(&[u8], &[u8])> {
+        self.current_block
+            .as_ref()
+            .and_then(|cursor| cursor.key().zip(cursor.value()))
+    }
+
+    /// Restart iteration from the first entry of the table
+    pub fn rewind(&mut self) {
+        self.next_block_index = 0;
+        self.current_block = None;
+    }
+
+    pub fn block_count(&self) -> usize {
+        self.index.len()
+    }
+
+    /// Memory held by the iterator: its reader, the decoded index, the current
+    /// data block and the readahead buffer
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>()
+            + self.sst_reader.approximate_memory_usage()
+            + self.index.approximate_memory_usage()
+            + self
+                .current_block
+                .as_ref()
+                .map_or(0, |cursor| cursor.approximate_memory_usage())
+            + self.prefetch_buffer.approximate_memory_usage()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::Error;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::types::WriteOptions;
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_lending_iterator_matches_collect_all() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("lending.sst");
+
+        let opts = WriteOptions {
+            block_size: 256,
+            ..WriteOptions::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+        for i in 0..300 {
+            writer.put(format!("key{:04}", i), format!("v{}", i))?;
+        }
+        writer.finish()?;
+
+        let expected =
+            SstEntryIterator::new(SstReader::open(&path)?, CompressionType::None)?.collect_all()?;
+        assert_eq!(expected.len(), 300);
+
+        let mut iterator = SstLendingIterator::new(SstReader::open(&path)?, CompressionType::None)?;
+        assert!(iterator.block_count() > 1);
+
+        for _ in 0..2 {
+            let mut count = 0;
+            while let Some((key, value)) = iterator.next_entry()? {
+                assert_eq!(key, expected[count].0.as_slice());
+                assert_eq!(value, expected[count].1.as_slice());
+                count += 1;
+            }
+            assert_eq!(count, expected.len());
+            iterator.rewind();
+        }
+
+        // Seeks binary search the decoded index, then iteration continues from there
+        let (key, value) = iterator.seek(b"key0150")?.unwrap();
+        assert_eq!(
+            (key, value),
+            (b"key0150".as_slice(), expected[150].1.as_slice())
+        );
+        let (key, _) = iterator.next_entry()?.unwrap();
+        assert_eq!(key, b"key0151");
+        let (key, _) = iterator.seek(b"key0099a")?.unwrap();
+        assert_eq!(key, b"key0100");
+        assert!(iterator.seek(b"key9999")?.is_none());
+        assert!(iterator.next_entry()?.is_none());
+
+        let mut total_key_bytes = 0;
+        SstEntryIterator::new(SstReader::open(&path)?, CompressionType::None)?.for_each_entry(
+            |key, _value| {
+                total_key_bytes += key.len();
+                Ok(())
+            },
+        )?;
+        assert_eq!(total_key_bytes, 300 * 7);
+
+        let keys = SstEntryIterator::new(SstReader::open(&path)?, CompressionType::None)?
+            .collect_keys()?;
+        let expected_keys: Vec<Vec<u8>> = expected.into_iter().map(|(key, _)| key).collect();
+        assert_eq!(keys, expected_keys);
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_multi_get() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("multi_get.sst");
+
+        let opts = WriteOptions {
+            compression: CompressionType::Snappy,
+            block_size: 256,
+            ..WriteOptions::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+        // Only even keys are present
+        for i in (0..1000).step_by(2) {
+            writer.put(format!("key{:04}", i), format!("value{}", i))?;
+        }
+        writer.finish()?;
+
+        let mut iterator = SstEntryIterator::new(SstReader::open(&path)?, CompressionType::Snappy)?;
+        assert!(iterator.block_count() > 4);
+
+        let lookups: Vec<String> = [998, 3, 0, 500, 501, 2, 500, 1500, 640]
+            .iter()
+            .map(|i| format!("key{:04}", i))
+            .chain(["a".to_string(), "zzz".to_string()])
+            .collect();
+        let keys: Vec<&[u8]> = lookups.iter().map(|k| k.as_bytes()).collect();
+
+        let results = iterator.multi_get(&keys)?;
+        assert_eq!(results.len(), keys.len());
+
+        for (key, result) in lookups.iter().zip(&results) {
+            let expected = key
+                .strip_prefix("key")
+                .and_then(|n| n.parse::<u32>().ok())
+                .filter(|n| n % 2 == 0 && *n < 1000)
+                .map(|n| format!("value{}", n));
+
+            match expected {
+                // Values carry the entry type prefix written by SstFileWriter
+                Some(value) => assert_eq!(
+                    result.as_deref(),
+                    Some(&[b"\0", value.as_bytes()].concat()[..])
+                ),
+                None => assert!(result.is_none(), "unexpected hit for {}", key),
+            }
+        }
+
+        assert!(iterator.multi_get(&[])?.is_empty());
+        Ok(())
+    }
+}
@@ -1,25 +1,56 @@
 // Copyright 2024 YaleDB Contributors
 // SPDX-License-Identifier: Apache-2.0
 
+pub mod async_reader;
 pub mod block_builder;
+pub mod block_cache_tracer;
 pub mod block_handle;
+pub mod cache_simulator;
 pub mod compression;
 pub mod data_block;
+pub mod direct_io;
 pub mod error;
 pub mod footer;
 pub mod index_block;
 pub mod iterator;
+pub mod memory_budget;
+mod parallel_compression;
+pub mod parallel_scan;
+pub mod perf_context;
+mod prefetch_buffer;
 pub mod sst_file_writer;
 pub mod sst_reader;
+pub mod statistics;
+pub mod table_cache;
+pub mod tail_prefetch;
 pub mod types;
 
+pub use async_reader::{
+    AsyncReadOptions, AsyncSstIterator, AsyncSstReader, BlockReadFuture, IoBackend,
+};
+pub use block_cache_tracer::{
+    BlockAccessRecord, BlockCacheTracer, TableReaderCaller, TraceBlockType, read_block_trace,
+};
 pub use block_handle::BlockHandle;
-pub use compression::{compress, decompress};
-pub use data_block::{DataBlock, DataBlockReader, KeyValue};
+pub use compression::{
+    CompressedBlock, CompressionDict, CompressionStats, Compressor, DecompressionDict,
+    Decompressor, compress, decompress,
+};
+pub use data_block::{DataBlock, DataBlockCursor, DataBlockReader, KeyValue};
 pub use error::{Error, Result};
 pub use footer::Footer;
-pub use index_block::{IndexBlock, IndexEntry};
-pub use iterator::{SstEntryIterator, SstIterator, SstTableIterator};
+pub use index_block::{DecodedIndex, IndexBlock, IndexEntry};
+pub use iterator::{SstEntryIterator, SstIterator, SstLendingIterator, SstTableIterator};
+pub use memory_budget::{MemoryBudget, MemoryReservation};
+pub use parallel_scan::{ParallelScanIterator, ParallelScanOptions, ParallelTableScanner};
+pub use perf_context::{
+    PerfContext, PerfLevel, perf_context, perf_level, reset_perf_context, set_perf_level,
+};
 pub use sst_file_writer::{EntryType, SstFileWriter};
 pub use sst_reader::SstReader;
-pub use types::{ChecksumType, CompressionType, FormatVersion, ReadOptions, WriteOptions};
+pub use statistics::{Histogram, HistogramData, Statistics, Ticker};
+pub use table_cache::{CachedTable, TableCache, table_file_name};
+pub use tail_prefetch::TailPrefetchStats;
+pub use types::{
+    ChecksumType, CompressionOptions, CompressionType, FormatVersion, ReadOptions, WriteOptions,
+};
@@ -0,0 +1,162 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! A process wide limit on the metadata readers keep pinned in memory, in the
+//! spirit of RocksDB's `CacheReservationManager` charging table reader memory to
+//! the block cache.
+//!
+//! Iterators and cached tables opened with
+//! [`ReadOptions::memory_budget`](crate::types::ReadOptions::memory_budget)
+//! charge their decoded index to the budget. The index is needed by every seek, so
+//! it is always kept and charged, even past the limit, so that
+//! [`MemoryBudget::usage`] reflects it. The
+//! [`TableCache`](crate::table_cache::TableCache) brings usage back under the limit
+//! by closing its least recently used tables.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/cache/cache_reservation_manager.h
+
+use std::sync::Arc;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+#[derive(Debug)]
+pub struct MemoryBudget {
+    limit: usize,
+    usage: AtomicUsize,
+}
+
+impl MemoryBudget {
+    pub fn new(limit: usize) -> Arc<Self> {
+        Arc::new(MemoryBudget {
+            limit,
+            usage: AtomicUsize::new(0),
+        })
+    }
+
+    pub fn limit(&self) -> usize {
+        self.limit
+    }
+
+    /// Bytes currently reserved
+    pub fn usage(&self) -> usize {
+        self.usage.load(Ordering::Relaxed)
+    }
+
+    /// Reserve `size` bytes if they fit within the limit
+    pub fn try_reserve(self: &Arc<Self>, size: usize) -> Option<MemoryReservation> {
+        self.usage
+            .fetch_update(Ordering::Relaxed, Ordering::Relaxed, |usage| {
+                usage.checked_add(size).filter(|&total| total <= self.limit)
+            })
+            .ok()?;
+        Some(MemoryReservation {
+            budget: self.clone(),
+            size,
+        })
+    }
+
+    /// Reserve `size` bytes even if that exceeds the limit
+    pub fn reserve(self: &Arc<Self>, size: usize) -> MemoryReservation {
+        self.usage.fetch_add(size, Ordering::Relaxed);
+        MemoryReservation {
+            budget: self.clone(),
+            size,
+        }
+    }
+}
+
+/// Memory charged to a [`MemoryBudget`], released when dropped
+#[derive(Debug)]
+pub struct MemoryReservation {
+    budget: Arc<MemoryBudget>,
+    size: usize,
+}
+
+impl MemoryReservation {
+    pub fn size(&self) -> usize {
+        self.size
+    }
+}
+
+impl Drop for MemoryReservation {
+    fn drop(&mut self) {
+        self.budget.usage.fetch_sub(self.size, Ordering::Relaxed);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::{Error, Result};
+    use crate::iterator::SstEntryIterator;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::sst_reader::SstReader;
+    use crate::table_cache::{TableCache, table_file_name};
+    use crate::types::{CompressionType, ReadOptions, WriteOptions};
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_memory_budget_charges_metadata() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = table_file_name(dir.path(), 1);
+
+        let mut writer = SstFileWriter::create(&WriteOptions {
+            block_size: 256,
+            ..WriteOptions::default()
+        });
+        writer.open(&path)?;
+        for i in 0..2000 {
+            writer.put(format!("key{:05}", i), format!("value{}", i))?;
+        }
+        writer.finish()?;
+
+        let open = |budget: &Arc<MemoryBudget>| -> Result<SstEntryIterator> {
+            let options = ReadOptions {
+                memory_budget: Some(budget.clone()),
+                ..ReadOptions::default()
+            };
+            let reader = SstReader::open_with_options(&path, &options)?;
+            SstEntryIterator::with_options(reader, CompressionType::None, &options)
+        };
+
+        let roomy = MemoryBudget::new(usize::MAX);
+        let tight = MemoryBudget::new(0);
+        let mut iterator = open(&roomy)?;
+        let mut over_limit = open(&tight)?;
+
+        // The index is charged in full even when it does not fit
+        assert!(roomy.usage() > 0);
+        assert_eq!(tight.usage(), roomy.usage());
+        assert!(tight.usage() > tight.limit());
+        assert!(iterator.approximate_memory_usage() > roomy.usage());
+        for key in ["key00000", "key01234", "key01999"] {
+            assert!(over_limit.find(key.as_bytes())?.is_some());
+            assert_eq!(
+                iterator.find(key.as_bytes())?,
+                over_limit.find(key.as_bytes())?
+            );
+        }
+
+        drop(iterator);
+        drop(over_limit);
+        assert_eq!(roomy.usage(), 0);
+        assert_eq!(tight.usage(), 0);
+
+        // The table cache closes cold tables to stay within the budget
+        std::fs::copy(&path, table_file_name(dir.path(), 2))?;
+        let cache_options = |budget: &Arc<MemoryBudget>| ReadOptions {
+            memory_budget: Some(budget.clone()),
+            ..ReadOptions::default()
+        };
+        let cache = TableCache::new(dir.path(), 10, cache_options(&roomy));
+        cache.find_table(1)?;
+        let one_table = roomy.usage();
+        let budget = MemoryBudget::new(one_table * 3 / 2);
+        let cache = TableCache::new(dir.path(), 10, cache_options(&budget));
+        cache.find_table(1)?;
+        assert!(cache.get(2, b"key01999")?.is_some());
+        assert_eq!(cache.len(), 1);
+        assert!(budget.usage() <= budget.limit());
+        Ok(())
+    }
+}
@@ -0,0 +1,178 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Block compression on a pool of worker threads, modelled on RocksDB's parallel
+//! compression in `BlockBasedTableBuilder`.
+//!
+//! The writer thread keeps building blocks and submits their uncompressed contents
+//! here. Workers compress them concurrently, and the results are handed back in
+//! submission order, so the writer can assign file offsets and checksums exactly as
+//! it would for inline compression.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/table/block_based/block_based_table_builder.cc
+
+use crate::compression::{CompressedBlock, CompressionDict, Compressor};
+use crate::error::{Error, Result};
+use crate::statistics::Statistics;
+use crate::types::{CompressionOptions, CompressionType};
+use std::collections::BTreeMap;
+use std::sync::mpsc::{Receiver, Sender, SyncSender, channel, sync_channel};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+
+type PipelineResult = (u64, Result<CompressedBlock>);
+
+pub(crate) struct CompressionPipeline {
+    job_sender: Option<SyncSender<(u64, Vec<u8>)>>,
+    result_receiver: Receiver<PipelineResult>,
+    workers: Vec<JoinHandle<()>>,
+    next_submitted: u64,
+    next_emitted: u64,
+    /// Blocks that finished out of order, waiting for their predecessors
+    completed: BTreeMap<u64, Result<CompressedBlock>>,
+}
+
+impl CompressionPipeline {
+    pub fn new(
+        threads: usize,
+        compression_type: CompressionType,
+        dict: Option<Arc<CompressionDict>>,
+        options: &CompressionOptions,
+        statistics: Option<Arc<Statistics>>,
+    ) -> Self {
+        let (job_sender, job_receiver) = sync_channel::<(u64, Vec<u8>)>(threads);
+        let (result_sender, result_receiver) = channel();
+        let job_receiver = Arc::new(Mutex::new(job_receiver));
+
+        let workers = (0..threads)
+            .map(|_| {
+                let job_receiver = job_receiver.clone();
+                let result_sender = result_sender.clone();
+                let dict = dict.clone();
+                let options = options.clone();
+                let statistics = statistics.clone();
+                std::thread::spawn(move || {
+                    compression_worker(
+                        &job_receiver,
+                        &result_sender,
+                        compression_type,
+                        dict,
+                        &options,
+                        statistics,
+                    )
+                })
+            })
+            .collect();
+
+        CompressionPipeline {
+            job_sender: Some(job_sender),
+            result_receiver,
+            workers,
+            next_submitted: 0,
+            next_emitted: 0,
+            completed: BTreeMap::new(),
+        }
+    }
+
+    /// Number of submitted blocks not yet returned by [`CompressionPipeline::next_block`]
+    pub fn in_flight(&self) -> usize {
+        (self.next_submitted - self.next_emitted) as usize
+    }
+
+    /// Queue uncompressed block contents, blocking while every worker is busy and
+    /// the queue is full
+    pub fn submit(&mut self, contents: Vec<u8>) -> Result<()> {
+        let sender = self.job_sender.as_ref().unwrap();
+        sender
+            .send((self.next_submitted, contents))
+            .map_err(|_| workers_exited())?;
+        self.next_submitted += 1;
+        Ok(())
+    }
+
+    /// The next compressed block in submission order. Without `wait`, returns
+    /// `None` if it is not finished yet.
+    pub fn next_block(&mut self, wait: bool) -> Option<Result<CompressedBlock>> {
+        if self.in_flight() == 0 {
+            return None;
+        }
+
+        loop {
+            if let Some(block) = self.completed.remove(&self.next_emitted) {
+                self.next_emitted += 1;
+                return Some(block);
+            }
+
+            let (seq, block) = if wait {
+                match self.result_receiver.recv() {
+                    Ok(result) => result,
+                    Err(_) => return Some(Err(workers_exited())),
+                }
+            } else {
+                match self.result_receiver.try_recv() {
+                    Ok(result) => result,
+                    Err(std::sync::mpsc::TryRecvError::Empty) => return None,
+                    Err(std::sync::mpsc::TryRecvError::Disconnected) => {
+                        return Some(Err(workers_exited()));
+                    }
+                }
+            };
+            self.completed.insert(seq, block);
+        }
+    }
+}
+
+impl Drop for CompressionPipeline {
+    fn drop(&mut self) {
+        // Closing the job queue lets the workers exit once they are idle
+        self.job_sender.take();
+        for worker in self.workers.drain(..) {
+            let _ = worker.join();
+        }
+    }
+}
+
+fn workers_exited() -> Error {
+    Error::Compression("Compression workers exited".to_string())
+}
+
+fn compression_worker(
+    job_receiver: &Mutex<Receiver<(u64, Vec<u8>)>>,
+    result_sender: &Sender<PipelineResult>,
+    compression_type: CompressionType,
+    dict: Option<Arc<CompressionDict>>,
+    options: &CompressionOptions,
+    statistics: Option<Arc<Statistics>>,
+) {
+    let mut compressor = Compressor::with_options(options).with_statistics(statistics);
+    loop {
+        // Hold the lock only while waiting for a job, not while compressing it
+        let job = job_receiver.lock().unwrap().recv();
+        let Ok((seq, contents)) = job else {
+            return;
+        };
+
+        let mut data = Vec::new();
+        let block = compressor
+            .compress_block_into(
+                &contents,
+                compression_type,
+                dict.as_deref(),
+                options.max_compressed_bytes_per_kb,
+                &mut data,
+            )
+            .map(|compression_type| CompressedBlock {
+                uncompressed_len: contents.len(),
+                // A rejected block is stored as submitted, without copying it
+                data: if compression_type == CompressionType::None {
+                    contents
+                } else {
+                    data
+                },
+                compression_type,
+            });
+        if result_sender.send((seq, block)).is_err() {
+            return;
+        }
+    }
+}
@@ -0,0 +1,425 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+use crate::block_handle::BlockHandle;
+use crate::error::{Error, Result};
+use crate::sst_reader::SstReader;
+use crate::types::CompressionType;
+use std::collections::VecDeque;
+use std::ops::Range;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::mpsc::{Receiver, SyncSender, sync_channel};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+
+/// Number of decoded blocks a partition may buffer ahead of the consumer
+const PARTITION_CHANNEL_BOUND: usize = 4;
+
+type Entries = Vec<(Vec<u8>, Vec<u8>)>;
+
+/// Configuration options for parallel table scans
+#[derive(Debug, Clone)]
+pub struct ParallelScanOptions {
+    /// Number of contiguous block ranges the index is split into
+    pub num_partitions: usize,
+    /// Number of worker threads scanning partitions
+    pub num_threads: usize,
+}
+
+impl Default for ParallelScanOptions {
+    fn default() -> Self {
+        let num_threads = std::thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+
+        ParallelScanOptions {
+            num_partitions: num_threads,
+            num_threads,
+        }
+    }
+}
+
+impl ParallelScanOptions {
+    fn validate(&self) -> Result<()> {
+        if self.num_partitions == 0 || self.num_threads == 0 {
+            return Err(Error::InvalidArgument(
+                "Parallel scan needs at least one partition and one thread".to_string(),
+            ));
+        }
+        Ok(())
+    }
+}
+
+/// Split `block_count` blocks into at most `num_partitions` contiguous, non-empty ranges
+pub fn partition_blocks(block_count: usize, num_partitions: usize) -> Vec<Range<usize>> {
+    let num_partitions = num_partitions.min(block_count);
+    if num_partitions == 0 {
+        return Vec::new();
+    }
+
+    let base = block_count / num_partitions;
+    let remainder = block_count % num_partitions;
+
+    let mut ranges = Vec::with_capacity(num_partitions);
+    let mut start = 0;
+    for i in 0..num_partitions {
+        let len = base + usize::from(i < remainder);
+        ranges.push(start..start + len);
+        start += len;
+    }
+    ranges
+}
+
+/// Full-table scanner that decodes contiguous block ranges on multiple threads.
+///
+/// Every worker reads through its own reader (see [`SstReader::try_clone`]), all
+/// sharing the file through positional reads, so reading and decompression scale
+/// with the number of threads.
+pub struct ParallelTableScanner {
+    sst_reader: SstReader,
+    block_handles: Arc<Vec<BlockHandle>>,
+    compression_type: CompressionType,
+}
+
+impl ParallelTableScanner {
+    pub fn new(mut sst_reader: SstReader, compression_type: CompressionType) -> Result<Self> {
+        let index_block = sst_reader.read_index_block()?;
+        let block_handles = index_block.get_all_block_handles()?;
+
+        Ok(ParallelTableScanner {
+            sst_reader,
+            block_handles: Arc::new(block_handles),
+            compression_type,
+        })
+    }
+
+    pub fn block_count(&self) -> usize {
+        self.block_handles.len()
+    }
+
+    /// Memory held by the scanner's reader and block handles. Workers hold their
+    /// own reader clones only while a scan runs.
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>()
+            + self.sst_reader.approximate_memory_usage()
+            + self.block_handles.capacity() * size_of::<BlockHandle>()
+    }
+
+    /// Block ranges the table would be split into for the given options
+    pub fn partitions(&self, options: &ParallelScanOptions) -> Vec<Range<usize>> {
+        partition_blocks(self.block_handles.len(), options.num_partitions)
+    }
+
+    /// Scan all partitions concurrently, invoking `f(partition, key, value)` for every entry.
+    ///
+    /// Entries within a partition are visited in key order; partitions run concurrently.
+    /// The first error returned by `f` or by a block read stops the scan and is returned.
+    pub fn for_each_partition<F>(&self, options: &ParallelScanOptions, f: F) -> Result<()>
+    where
+        F: Fn(usize, &[u8], &[u8]) -> Result<()> + Sync,
+    {
+        options.validate()?;
+
+        let partitions = self.partitions(options);
+        let num_threads = options.num_threads.min(partitions.len());
+        let readers = self.clone_readers(num_threads)?;
+
+        let next_partition = AtomicUsize::new(0);
+        let failed = AtomicBool::new(false);
+        let first_error: Mutex<Option<Error>> = Mutex::new(None);
+
+        std::thread::scope(|scope| {
+            for mut reader in readers {
+                let partitions = &partitions;
+                let next_partition = &next_partition;
+                let failed = &failed;
+                let first_error = &first_error;
+                let f = &f;
+
+                scope.spawn(move || {
+                    while !failed.load(Ordering::Relaxed) {
+                        let partition = next_partition.fetch_add(1, Ordering::Relaxed);
+                        if partition >= partitions.len() {
+                            break;
+                        }
+
+                        let result = self.scan_range(
+                            &mut reader,
+                            partitions[partition].clone(),
+                            failed,
+                            |key, value| f(partition, key, value),
+                        );
+
+                        if let Err(e) = result {
+                            failed.store(true, Ordering::Relaxed);
+                            first_error.lock().unwrap().get_or_insert(e);
+                            break;
+                        }
+                    }
+                });
+            }
+        });
+
+        match first_error.into_inner().unwrap() {
+            Some(e) => Err(e),
+            None => Ok(()),
+        }
+    }
+
+    /// Scan the table on worker threads, yielding entries in key order.
+    ///
+    /// Each partition buffers a bounded number of decoded blocks, so memory stays
+    /// proportional to the thread count rather than to the table size.
+    pub fn scan(&self, options: &ParallelScanOptions) -> Result<ParallelScanIterator> {
+        options.validate()?;
+
+        let partitions = self.partitions(options);
+        let num_threads = options.num_threads.min(partitions.len());
+        let readers = self.clone_readers(num_threads)?;
+
+        let mut receivers = Vec::with_capacity(partitions.len());
+        let mut jobs = VecDeque::with_capacity(partitions.len());
+        for range in partitions {
+            let (sender, receiver) = sync_channel(PARTITION_CHANNEL_BOUND);
+            receivers.push(receiver);
+            jobs.push_back((range, sender));
+        }
+        let jobs = Arc::new(Mutex::new(jobs));
+
+        let workers = readers
+            .into_iter()
+            .map(|mut reader| {
+                let jobs = Arc::clone(&jobs);
+                let block_handles = Arc::clone(&self.block_handles);
+                let compression_type = self.compression_type;
+
+                std::thread::spawn(move || {
+                    loop {
+                        // Partitions are claimed in order, so the lowest unfinished
+                        // partition always has a worker and the consumer never stalls.
+                        let job = jobs.lock().unwrap().pop_front();
+                        let Some((range, sender)) = job else {
+                            break;
+                        };
+
+                        if !send_range(
+                            &mut reader,
+                            &block_handles,
+                            compression_type,
+                            range,
+                            &sender,
+                        ) {
+                            // Consumer went away, nothing left to do
+                            break;
+                        }
+                    }
+                })
+            })
+            .collect();
+
+        Ok(ParallelScanIterator {
+            receivers: receivers.into(),
+            current: Vec::new().into_iter(),
+            workers,
+        })
+    }
+
+    /// Scan the whole table in parallel and collect all entries in key order
+    pub fn collect_all(&self, options: &ParallelScanOptions) -> Result<Entries> {
+        self.scan(options)?.collect()
+    }
+
+    fn clone_readers(&self, count: usize) -> Result<Vec<SstReader>> {
+        (0..count).map(|_| self.sst_reader.try_clone()).collect()
+    }
+
+    fn scan_range<F>(
+        &self,
+        reader: &mut SstReader,
+        range: Range<usize>,
+        failed: &AtomicBool,
+        mut f: F,
+    ) -> Result<()>
+    where
+        F: FnMut(&[u8], &[u8]) -> Result<()>,
+    {
+        for handle in &self.block_handles[range] {
+            if failed.load(Ordering::Relaxed) {
+                break;
+            }
+
+            let data_block =
+                reader.read_data_block_reader(handle.clone(), self.compression_type)?;
+            for entry in data_block.entries() {
+                f(&entry.key, &entry.value)?;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Send decoded blocks of `range` to the consumer, returning false once it has hung up
+fn send_range(
+    reader: &mut SstReader,
+    block_handles: &[BlockHandle],
+    compression_type: CompressionType,
+    range: Range<usize>,
+    sender: &SyncSender<Result<Entries>>,
+) -> bool {
+    for handle in &block_handles[range] {
+        let batch = reader
+            .read_data_block_reader(handle.clone(), compression_type)
+            .map(|data_block| {
+                data_block
+                    .entries()
+                    .iter()
+                    .map(|entry| (entry.key.clone(), entry.value.clone()))
+                    .collect()
+            });
+
+        let is_err = batch.is_err();
+        if sender.send(batch).is_err() {
+            return false;
+        }
+        if is_err {
+            // The error ends this partition; the consumer stops at it
+            return true;
+        }
+    }
+    true
+}
+
+/// Ordered iterator over the entries produced by [`ParallelTableScanner::scan`]
+pub struct ParallelScanIterator {
+    receivers: VecDeque<Receiver<Result<Entries>>>,
+    current: std::vec::IntoIter<(Vec<u8>, Vec<u8>)>,
+    workers: Vec<JoinHandle<()>>,
+}
+
+impl Iterator for ParallelScanIterator {
+    type Item = Result<(Vec<u8>, Vec<u8>)>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        loop {
+            if let Some(entry) = self.current.next() {
+                return Some(Ok(entry));
+            }
+
+            let receiver = self.receivers.front()?;
+            match receiver.recv() {
+                Ok(Ok(batch)) => self.current = batch.into_iter(),
+                Ok(Err(e)) => {
+                    // Stop the scan: dropping the receivers makes workers exit
+                    self.receivers.clear();
+                    return Some(Err(e));
+                }
+                Err(_) => {
+                    // Partition finished, move on to the next one
+                    self.receivers.pop_front();
+                }
+            }
+        }
+    }
+}
+
+impl Drop for ParallelScanIterator {
+    fn drop(&mut self) {
+        // Hang up first so that workers blocked on a full channel can exit
+        self.receivers.clear();
+        for worker in self.workers.drain(..) {
+            let _ = worker.join();
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::iterator::SstEntryIterator;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::types::WriteOptions;
+    use std::path::Path;
+    use tempfile::tempdir;
+
+    fn write_table(path: &Path, num_entries: usize, compression: CompressionType) -> Result<()> {
+        let opts = WriteOptions {
+            compression,
+            block_size: 256,
+            ..WriteOptions::default()
+        };
+
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(path)?;
+        for i in 0..num_entries {
+            writer.put(format!("key{:06}", i), format!("value{:06}", i))?;
+        }
+        writer.finish()
+    }
+
+    #[test]
+    fn test_partition_blocks() {
+        assert!(partition_blocks(0, 4).is_empty());
+        assert_eq!(partition_blocks(3, 8), vec![0..1, 1..2, 2..3]);
+        assert_eq!(partition_blocks(10, 3), vec![0..4, 4..7, 7..10]);
+        assert_eq!(partition_blocks(10, 1), vec![0..10]);
+    }
+
+    #[test]
+    fn test_parallel_scan_matches_sequential() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("parallel.sst");
+        write_table(&path, 2000, CompressionType::Snappy)?;
+
+        let expected = SstEntryIterator::new(SstReader::open(&path)?, CompressionType::Snappy)?
+            .collect_all()?;
+        assert_eq!(expected.len(), 2000);
+
+        let scanner = ParallelTableScanner::new(SstReader::open(&path)?, CompressionType::Snappy)?;
+        assert!(scanner.block_count() > 8);
+
+        let options = ParallelScanOptions {
+            num_partitions: 7,
+            num_threads: 3,
+        };
+        assert_eq!(scanner.collect_all(&options)?, expected);
+
+        // Dropping a partially consumed scan must not hang on blocked workers
+        let first: Vec<_> = scanner.scan(&options)?.take(10).collect::<Result<_>>()?;
+        assert_eq!(first, expected[..10]);
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_for_each_partition() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("partitions.sst");
+        write_table(&path, 1000, CompressionType::None)?;
+
+        let scanner = ParallelTableScanner::new(SstReader::open(&path)?, CompressionType::None)?;
+        let options = ParallelScanOptions {
+            num_partitions: 4,
+            num_threads: 2,
+        };
+
+        let counts: Vec<AtomicUsize> = (0..4).map(|_| AtomicUsize::new(0)).collect();
+        scanner.for_each_partition(&options, |partition, key, _value| {
+            assert!(key.starts_with(b"key"));
+            counts[partition].fetch_add(1, Ordering::Relaxed);
+            Ok(())
+        })?;
+
+        let total: usize = counts.iter().map(|c| c.load(Ordering::Relaxed)).sum();
+        assert_eq!(total, 1000);
+        assert!(counts.iter().all(|c| c.load(Ordering::Relaxed) > 0));
+
+        let result = scanner.for_each_partition(&options, |_, _, _| {
+            Err(Error::InvalidArgument("stop".to_string()))
+        });
+        assert!(matches!(result, Err(Error::InvalidArgument(_))));
+
+        Ok(())
+    }
+}
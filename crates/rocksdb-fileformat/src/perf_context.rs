@@ -0,0 +1,168 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Per-thread counters for where read time goes, modelled on RocksDB's
+//! `PerfContext`.
+//!
+//! Collection is off by default. [`set_perf_level`] enables it for the calling
+//! thread only, so a single query can be measured by enabling it around that
+//! query and reading [`perf_context`] afterwards. With [`PerfLevel::EnableCount`]
+//! only counters are updated; [`PerfLevel::EnableTime`] also times the read
+//! path, which costs a clock read per measured section.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/include/rocksdb/perf_context.h
+
+use std::cell::{Cell, RefCell};
+use std::time::Instant;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Default)]
+pub enum PerfLevel {
+    #[default]
+    Disable,
+    /// Update counters only
+    EnableCount,
+    /// Update counters and timers
+    EnableTime,
+}
+
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct PerfContext {
+    /// Blocks read from the file or a prefetch buffer
+    pub block_read_count: u64,
+    /// Total size of those blocks, including trailers
+    pub block_read_byte: u64,
+    /// Time spent in file reads
+    pub block_read_nanos: u64,
+    /// Time spent decompressing blocks
+    pub block_decompress_nanos: u64,
+    /// Time spent verifying checksums
+    pub block_checksum_nanos: u64,
+    /// Time spent searching index blocks for a data block
+    pub index_seek_nanos: u64,
+    /// Time spent searching data blocks for a key
+    pub data_block_seek_nanos: u64,
+}
+
+impl PerfContext {
+    const fn new() -> Self {
+        PerfContext {
+            block_read_count: 0,
+            block_read_byte: 0,
+            block_read_nanos: 0,
+            block_decompress_nanos: 0,
+            block_checksum_nanos: 0,
+            index_seek_nanos: 0,
+            data_block_seek_nanos: 0,
+        }
+    }
+}
+
+thread_local! {
+    static PERF_LEVEL: Cell<PerfLevel> = const { Cell::new(PerfLevel::Disable) };
+    static PERF_CONTEXT: RefCell<PerfContext> = const { RefCell::new(PerfContext::new()) };
+}
+
+/// Set what the calling thread collects
+pub fn set_perf_level(level: PerfLevel) {
+    PERF_LEVEL.with(|perf_level| perf_level.set(level));
+}
+
+pub fn perf_level() -> PerfLevel {
+    PERF_LEVEL.with(|perf_level| perf_level.get())
+}
+
+/// Snapshot of the calling thread's counters
+pub fn perf_context() -> PerfContext {
+    PERF_CONTEXT.with(|context| context.borrow().clone())
+}
+
+/// Zero the calling thread's counters
+pub fn reset_perf_context() {
+    PERF_CONTEXT.with(|context| *context.borrow_mut() = PerfContext::new());
+}
+
+/// Apply `update` to the calling thread's counters if counting is enabled
+#[inline]
+pub(crate) fn perf_count(update: impl FnOnce(&mut PerfContext)) {
+    if perf_level() >= PerfLevel::EnableCount {
+        PERF_CONTEXT.with(|context| update(&mut context.borrow_mut()));
+    }
+}
+
+/// Times a section of the read path when timing is enabled
+pub(crate) struct PerfTimer(Option<Instant>);
+
+impl PerfTimer {
+    #[inline]
+    pub fn start() -> Self {
+        PerfTimer((perf_level() >= PerfLevel::EnableTime).then(Instant::now))
+    }
+
+    /// Add the time since `start` to the timer `metric` selects
+    #[inline]
+    pub fn stop(self, metric: fn(&mut PerfContext) -> &mut u64) {
+        if let Some(start) = self.0 {
+            let nanos = start.elapsed().as_nanos() as u64;
+            PERF_CONTEXT.with(|context| *metric(&mut context.borrow_mut()) += nanos);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::{Error, Result};
+    use crate::iterator::{SstIterator, SstTableIterator};
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::sst_reader::SstReader;
+    use crate::types::{CompressionType, WriteOptions};
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_perf_context_counts_reads() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("perf.sst");
+
+        let opts = WriteOptions {
+            compression: CompressionType::ZSTD,
+            block_size: 512,
+            ..WriteOptions::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+        for i in 0..2000 {
+            writer.put(format!("key{:06}", i), format!("value{:06}", i))?;
+        }
+        writer.finish()?;
+
+        // Disabled by default
+        reset_perf_context();
+        let mut iter = SstTableIterator::new(SstReader::open(&path)?, CompressionType::ZSTD)?;
+        iter.seek(b"key001000")?;
+        assert_eq!(perf_context(), PerfContext::default());
+
+        set_perf_level(PerfLevel::EnableCount);
+        iter.seek(b"key001500")?;
+        let context = perf_context();
+        assert_eq!(context.block_read_count, 1);
+        assert!(context.block_read_byte > 0);
+        assert_eq!(context.block_decompress_nanos, 0);
+
+        reset_perf_context();
+        set_perf_level(PerfLevel::EnableTime);
+        let mut iter = SstTableIterator::new(SstReader::open(&path)?, CompressionType::ZSTD)?;
+        iter.seek(b"key000500")?;
+        assert!(iter.valid());
+        let context = perf_context();
+        // Metaindex and index at open, then the data block
+        assert_eq!(context.block_read_count, 3);
+        assert!(context.block_read_nanos > 0);
+        assert!(context.block_decompress_nanos > 0);
+        assert!(context.index_seek_nanos > 0);
+        assert!(context.data_block_seek_nanos > 0);
+
+        set_perf_level(PerfLevel::Disable);
+        Ok(())
+    }
+}
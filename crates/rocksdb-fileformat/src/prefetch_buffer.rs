@@ -0,0 +1,192 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Readahead for iterators, modelled on RocksDB's `FilePrefetchBuffer`.
+//!
+//! With automatic readahead, blocks are read exactly until the access pattern has
+//! been sequential for a couple of reads. From then on each refill reads the
+//! requested block plus a readahead window, and the window doubles on every refill
+//! up to `max_auto_readahead_size`. The OS is also asked to load the following
+//! window into the page cache while the buffered blocks are consumed. A
+//! non-sequential read resets the window.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/file/file_prefetch_buffer.h
+
+use crate::block_cache_tracer::{TableReaderCaller, TraceBlockType};
+use crate::block_handle::BlockHandle;
+use crate::error::Result;
+use crate::sst_reader::{BlockContents, SstReader};
+use crate::statistics::{Ticker, record_tick};
+use crate::types::ReadOptions;
+
+/// Sequential reads needed before automatic readahead kicks in
+const NUM_SEQUENTIAL_READS_TO_TRIGGER: usize = 2;
+
+pub(crate) struct FilePrefetchBuffer {
+    buffer: BlockContents,
+    buffer_offset: u64,
+    /// Fixed readahead size, or zero for automatic readahead
+    fixed_readahead_size: usize,
+    initial_readahead_size: usize,
+    max_readahead_size: usize,
+    readahead_size: usize,
+    prev_read_end: Option<u64>,
+    num_sequential_reads: usize,
+    num_file_reads: usize,
+}
+
+impl FilePrefetchBuffer {
+    pub fn new(options: &ReadOptions) -> Self {
+        let initial_readahead_size = options
+            .initial_auto_readahead_size
+            .min(options.max_auto_readahead_size);
+
+        FilePrefetchBuffer {
+            buffer: BlockContents::default(),
+            buffer_offset: 0,
+            fixed_readahead_size: options.readahead_size,
+            initial_readahead_size,
+            max_readahead_size: options.max_auto_readahead_size,
+            readahead_size: initial_readahead_size,
+            prev_read_end: None,
+            num_sequential_reads: 0,
+            num_file_reads: 0,
+        }
+    }
+
+    /// Memory held by the readahead buffer
+    pub fn approximate_memory_usage(&self) -> usize {
+        match &self.buffer {
+            BlockContents::Owned(buffer) => buffer.capacity(),
+            BlockContents::Aligned(buffer) => buffer.len(),
+        }
+    }
+
+    /// Number of reads issued to the file so far
+    #[cfg(test)]
+    pub fn num_file_reads(&self) -> usize {
+        self.num_file_reads
+    }
+
+    /// Return the raw contents of the block at `handle`, served from the buffer when
+    /// it was already prefetched.
+    pub fn read_block(
+        &mut self,
+        sst_reader: &mut SstReader,
+        handle: &BlockHandle,
+        caller: TableReaderCaller,
+    ) -> Result<&[u8]> {
+        let block_end = handle.offset + handle.size;
+
+        if self.prev_read_end == Some(handle.offset) {
+            self.num_sequential_reads += 1;
+        } else {
+            self.num_sequential_reads = 0;
+            self.readahead_size = self.initial_readahead_size;
+        }
+        self.prev_read_end = Some(block_end);
+
+        let buffer_end = self.buffer_offset + self.buffer.len() as u64;
+        let hit = handle.offset >= self.buffer_offset && block_end <= buffer_end;
+        if !hit {
+            let readahead = self.next_readahead_size();
+            if block_end > sst_reader.file_size() {
+                // Let the reader produce its usual error for an out of range handle
+                self.buffer = sst_reader.read_range(handle)?;
+            } else {
+                let read_end = (block_end + readahead as u64).min(sst_reader.file_size());
+                let len = (read_end - handle.offset) as usize;
+                sst_reader.read_into(handle.offset, len, &mut self.buffer)?;
+
+                if readahead > 0 && read_end < sst_reader.file_size() {
+                    sst_reader.advise_willneed(read_end, readahead as u64);
+                }
+            }
+            self.buffer_offset = handle.offset;
+            self.num_file_reads += 1;
+        } else {
+            record_tick(sst_reader.statistics(), Ticker::PrefetchHits, 1);
+        }
+
+        sst_reader.record_block_read(handle.size);
+        sst_reader.trace_block_access(handle, TraceBlockType::Data, caller, hit);
+        let start = (handle.offset - self.buffer_offset) as usize;
+        Ok(&self.buffer[start..start + handle.size as usize])
+    }
+
+    /// Readahead for the refill about to happen, growing the automatic window
+    fn next_readahead_size(&mut self) -> usize {
+        if self.fixed_readahead_size > 0 {
+            return self.fixed_readahead_size;
+        }
+        if self.max_readahead_size == 0
+            || self.num_sequential_reads < NUM_SEQUENTIAL_READS_TO_TRIGGER
+        {
+            return 0;
+        }
+
+        let readahead = self.readahead_size;
+        self.readahead_size = (self.readahead_size * 2).min(self.max_readahead_size);
+        readahead
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::Error;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::types::WriteOptions;
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_auto_readahead_grows_on_sequential_reads() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("readahead.sst");
+
+        let opts = WriteOptions {
+            block_size: 512,
+            ..WriteOptions::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+        for i in 0..5000 {
+            writer.put(format!("key{:06}", i), format!("value{:06}", i))?;
+        }
+        writer.finish()?;
+
+        let mut sst_reader = SstReader::open(&path)?;
+        let index_block = sst_reader.read_index_block()?;
+        let handles = index_block.get_all_block_handles()?;
+        assert!(handles.len() > 100);
+
+        let mut prefetch = FilePrefetchBuffer::new(&ReadOptions::default());
+        for handle in &handles {
+            let expected = sst_reader.read_range(handle)?;
+            assert_eq!(
+                prefetch.read_block(&mut sst_reader, handle, TableReaderCaller::UserIterator)?,
+                &expected[..]
+            );
+        }
+        assert!(prefetch.num_file_reads() < handles.len() / 4);
+
+        // Random access never triggers readahead
+        let mut prefetch = FilePrefetchBuffer::new(&ReadOptions::default());
+        for handle in handles.iter().step_by(2) {
+            prefetch.read_block(&mut sst_reader, handle, TableReaderCaller::UserIterator)?;
+        }
+        assert_eq!(prefetch.num_file_reads(), handles.len().div_ceil(2));
+
+        let disabled = ReadOptions {
+            max_auto_readahead_size: 0,
+            ..ReadOptions::default()
+        };
+        let mut prefetch = FilePrefetchBuffer::new(&disabled);
+        for handle in &handles {
+            prefetch.read_block(&mut sst_reader, handle, TableReaderCaller::UserIterator)?;
+        }
+        assert_eq!(prefetch.num_file_reads(), handles.len());
+        Ok(())
+    }
+}
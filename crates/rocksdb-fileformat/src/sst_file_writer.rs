@@ -1,12 +1,21 @@
-use crate::block_builder::{DataBlockBuilder, DataBlockBuilderOptions, IndexBlockBuilder};
+use crate::block_builder::{
+    DataBlockBuilder, DataBlockBuilderOptions, IndexBlockBuilder, block_trailer,
+};
 use crate::block_handle::BlockHandle;
+use crate::compression::{CompressionDict, CompressionStats, Compressor};
+use crate::direct_io::DirectFileWriter;
 use crate::error::{Error, Result};
 use crate::footer::Footer;
-use crate::types::{CompressionType, FormatVersion, WriteOptions};
-use byteorder::{LittleEndian, WriteBytesExt};
+use crate::parallel_compression::CompressionPipeline;
+use crate::statistics::{Ticker, record_tick};
+use crate::types::{
+    BLOCK_TRAILER_SIZE, COMPRESSION_DICT_BLOCK_NAME, CompressionType, FormatVersion, WriteOptions,
+};
+use std::collections::VecDeque;
 use std::fs::File;
 use std::io::{BufWriter, Write};
 use std::path::Path;
+use std::sync::Arc;
 
 /// Entry type for SST files  
 #[derive(Debug, Clone, PartialEq, Eq)]
@@ -16,10 +25,50 @@ pub enum EntryType {
     Merge,
 }
 
+/// Destination file, written through the page cache or with direct I/O
+enum WritableFile {
+    Buffered(BufWriter<File>),
+    Direct(DirectFileWriter),
+}
+
+impl WritableFile {
+    /// Flush all data, including a trailing partial sector for direct I/O
+    fn close(&mut self) -> Result<()> {
+        match self {
+            WritableFile::Buffered(writer) => writer.flush()?,
+            WritableFile::Direct(writer) => writer.finish()?,
+        }
+        Ok(())
+    }
+}
+
+impl Write for WritableFile {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        match self {
+            WritableFile::Buffered(writer) => writer.write(buf),
+            WritableFile::Direct(writer) => writer.write(buf),
+        }
+    }
+
+    fn write_all(&mut self, buf: &[u8]) -> std::io::Result<()> {
+        match self {
+            WritableFile::Buffered(writer) => writer.write_all(buf),
+            WritableFile::Direct(writer) => writer.write_all(buf),
+        }
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        match self {
+            WritableFile::Buffered(writer) => writer.flush(),
+            WritableFile::Direct(writer) => writer.flush(),
+        }
+    }
+}
+
 /// SST file writer that matches RocksDB's SstFileWriter API
 pub struct SstFileWriter {
     options: WriteOptions,
-    writer: Option<BufWriter<File>>,
+    writer: Option<WritableFile>,
     data_block_builder: DataBlockBuilder,
     index_block_builder: IndexBlockBuilder,
     offset: u64,
@@ -28,6 +77,21 @@ pub struct SstFileWriter {
     finished: bool,
     pending_index_entry: Option<(Vec<u8>, BlockHandle)>,
     base_context_checksum: Option<u32>,
+    /// While a compression dictionary is pending, finished data blocks are held
+    /// back uncompressed (with their last key) so they can be used as training
+    /// samples and then compressed with the dictionary
+    buffering: bool,
+    buffered_blocks: Vec<(Vec<u8>, Vec<u8>)>,
+    buffered_bytes: usize,
+    compression_dict: Option<Arc<CompressionDict>>,
+    compressor: Compressor,
+    /// Reused output buffer for data blocks compressed on the writer thread
+    compressed_block: Vec<u8>,
+    /// Worker pool compressing blocks when `parallel_threads` is above 1, and the
+    /// last keys of the blocks it has not returned yet
+    compression_pipeline: Option<CompressionPipeline>,
+    in_flight_keys: VecDeque<Vec<u8>>,
+    compression_stats: CompressionStats,
 }
 
 impl SstFileWriter {
@@ -54,6 +118,16 @@ impl SstFileWriter {
             finished: false,
             pending_index_entry: None,
             base_context_checksum,
+            buffering: false,
+            buffered_blocks: Vec::new(),
+            buffered_bytes: 0,
+            compression_dict: None,
+            compressor: Compressor::with_options(&opts.compression_opts)
+                .with_statistics(opts.statistics.clone()),
+            compressed_block: Vec::new(),
+            compression_pipeline: None,
+            in_flight_keys: VecDeque::new(),
+            compression_stats: CompressionStats::default(),
         }
     }
 
@@ -63,12 +137,27 @@ impl SstFileWriter {
             return Err(Error::InvalidArgument("File already open".to_string()));
         }
 
-        let file = File::create(path)?;
-        self.writer = Some(BufWriter::new(file));
+        let writer = if self.options.use_direct_writes {
+            WritableFile::Direct(DirectFileWriter::create(path)?)
+        } else {
+            WritableFile::Buffered(BufWriter::new(File::create(path)?))
+        };
+        self.writer = Some(writer);
         self.offset = 0;
         self.num_entries = 0;
         self.last_key.clear();
         self.finished = false;
+        self.buffering = self.data_block_codecs().contains(&CompressionType::ZSTD)
+            && self.options.compression_opts.max_dict_bytes > 0;
+        self.buffered_blocks.clear();
+        self.buffered_bytes = 0;
+        self.compression_dict = None;
+        self.compression_pipeline = None;
+        self.in_flight_keys.clear();
+        self.compression_stats = CompressionStats::default();
+        if !self.buffering {
+            self.start_compression_pipeline();
+        }
 
         Ok(())
     }
@@ -110,25 +199,74 @@ impl SstFileWriter {
         if !self.data_block_builder.empty() {
             self.flush_data_block()?;
         }
+        if self.buffering {
+            self.enter_unbuffered()?;
+        }
+        if self.compression_pipeline.is_some() {
+            self.write_compressed_blocks(true)?;
+            self.compression_pipeline = None;
+        }
+
+        // The last data block has no successor to trigger its index entry
+        if let Some((last_key, last_handle)) = self.pending_index_entry.take() {
+            self.index_block_builder
+                .add_index_entry(&last_key, &last_handle);
+        }
 
-        // Prepare all data to write
-        let index_block_data = self.index_block_builder.finish(
+        // The index, dictionary and metaindex blocks are finished into one buffer
+        let mut block = Vec::new();
+        self.index_block_builder.finish_into(
             CompressionType::None,
             self.options.checksum_type,
             Some(self.offset),
             self.base_context_checksum,
+            &mut block,
         )?;
-        let index_handle = BlockHandle {
-            offset: self.offset,
-            size: index_block_data.len() as u64,
-        };
+        let index_handle = self.write_raw_block(&block)?;
+
+        // Meta blocks, listed in the metaindex by name in sorted order
+        let mut meta_blocks = Vec::new();
+        if let Some(dict) = &self.compression_dict {
+            block.clear();
+            block.extend_from_slice(dict.raw());
+            let trailer = block_trailer(
+                &block,
+                CompressionType::None,
+                self.options.checksum_type,
+                Some(self.offset),
+                self.base_context_checksum,
+            );
+            block.extend_from_slice(&trailer);
+            let dict_handle = self.write_raw_block(&block)?;
+            // Meta block handles leave the trailer out, as RocksDB writes them
+            meta_blocks.push((
+                COMPRESSION_DICT_BLOCK_NAME,
+                BlockHandle::new(
+                    dict_handle.offset,
+                    dict_handle.size - BLOCK_TRAILER_SIZE as u64,
+                ),
+            ));
+        }
 
-        let metaindex_offset = self.offset + index_block_data.len() as u64;
-        let metaindex_data = self.create_empty_metaindex_block(metaindex_offset)?;
-        let metaindex_handle = BlockHandle {
-            offset: metaindex_offset,
-            size: metaindex_data.len() as u64,
-        };
+        // RocksDB writes the metaindex with a restart point at every entry
+        let mut metaindex_builder =
+            DataBlockBuilder::new(DataBlockBuilderOptions::default().with_restart_interval(1));
+        for (name, handle) in &meta_blocks {
+            metaindex_builder.add(name.as_bytes(), &handle.encode_to_bytes()?);
+        }
+        metaindex_builder.finish_into(
+            CompressionType::None,
+            self.options.checksum_type,
+            Some(self.offset),
+            self.base_context_checksum,
+            &mut block,
+        )?;
+        let mut metaindex_handle = self.write_raw_block(&block)?;
+        // From format_version 6 the footer records only the metaindex size, without
+        // the trailer, and readers locate the block from the footer's offset
+        if self.options.format_version >= FormatVersion::V6 {
+            metaindex_handle.size -= BLOCK_TRAILER_SIZE as u64;
+        }
 
         let footer = Footer {
             checksum_type: self.options.checksum_type,
@@ -137,22 +275,10 @@ impl SstFileWriter {
             format_version: self.options.format_version as u32,
             base_context_checksum: self.base_context_checksum,
         };
-        // Calculate where the footer will be written (after index and metaindex blocks)
-        let footer_offset =
-            self.offset + index_block_data.len() as u64 + metaindex_data.len() as u64;
-        let footer_data = footer.encode_to_bytes(footer_offset)?;
-
-        // Now write everything
-        let writer = self.writer.as_mut().unwrap();
-        writer.write_all(&index_block_data)?;
-        self.offset += index_block_data.len() as u64;
+        let footer_data = footer.encode_to_bytes(self.offset)?;
+        self.write_raw_block(&footer_data)?;
 
-        writer.write_all(&metaindex_data)?;
-        self.offset += metaindex_data.len() as u64;
-
-        writer.write_all(&footer_data)?;
-
-        writer.flush()?;
+        self.writer.as_mut().unwrap().close()?;
         self.finished = true;
 
         Ok(())
@@ -163,6 +289,12 @@ impl SstFileWriter {
         self.offset
     }
 
+    /// How many data blocks of the current file were stored compressed, and how
+    /// many were stored raw because compression did not pay off
+    pub fn compression_stats(&self) -> &CompressionStats {
+        &self.compression_stats
+    }
+
     fn add_entry(&mut self, key: &[u8], value: &[u8], entry_type: EntryType) -> Result<()> {
         if self.finished {
             return Err(Error::InvalidArgument("Writer is finished".to_string()));
@@ -204,25 +336,203 @@ impl SstFileWriter {
             return Ok(());
         }
 
-        let writer = self.writer.as_mut().unwrap();
+        if self.buffering {
+            let contents = self.data_block_builder.take_contents();
+            self.buffered_bytes += contents.len();
+            self.buffered_blocks.push((contents, self.last_key.clone()));
+            self.data_block_builder.reset();
+
+            let buffer_limit = match self.options.compression_opts.zstd_max_train_bytes {
+                0 => self.options.compression_opts.max_dict_bytes,
+                train_bytes => train_bytes,
+            };
+            if self.buffered_bytes >= buffer_limit {
+                self.enter_unbuffered()?;
+            }
+            return Ok(());
+        }
+
+        if let Some(pipeline) = &mut self.compression_pipeline {
+            pipeline.submit(self.data_block_builder.take_contents())?;
+            self.in_flight_keys.push_back(self.last_key.clone());
+            self.data_block_builder.reset();
+            return self.write_compressed_blocks(false);
+        }
 
-        // Finish the current data block
-        let block_data = self.data_block_builder.finish(
-            self.options.compression,
+        // The builder's buffer is borrowed out while the block is written, then
+        // handed back for the next block
+        let contents = self.data_block_builder.take_contents();
+        // The index entry uses the last key of this block
+        let result = self.compress_and_write_block(&contents, self.last_key.clone());
+        self.data_block_builder.reset_with_buffer(contents);
+        result
+    }
+
+    /// Build the compression dictionary from the buffered blocks, then compress and
+    /// write them. Blocks flushed afterwards are compressed as they are finished.
+    fn enter_unbuffered(&mut self) -> Result<()> {
+        self.buffering = false;
+        let blocks = std::mem::take(&mut self.buffered_blocks);
+        self.buffered_bytes = 0;
+
+        let opts = &self.options.compression_opts;
+        self.compression_dict = if blocks.is_empty() {
+            None
+        } else if opts.zstd_max_train_bytes > 0 {
+            let mut sample_bytes = 0;
+            let samples: Vec<&[u8]> = blocks
+                .iter()
+                .map(|(contents, _)| contents.as_slice())
+                .take_while(|contents| {
+                    let take = sample_bytes < opts.zstd_max_train_bytes;
+                    sample_bytes += contents.len();
+                    take
+                })
+                .collect();
+            // Training fails on too little or too uniform data, in which case the
+            // file is written without a dictionary and the failure is recorded
+            match CompressionDict::train(&samples, opts.max_dict_bytes, opts.level) {
+                Ok(dict) => Some(dict),
+                Err(_) => {
+                    self.compression_stats.dictionary_training_failed = true;
+                    None
+                }
+            }
+        } else {
+            let mut raw: Vec<u8> = blocks
+                .iter()
+                .flat_map(|(contents, _)| contents.iter().copied())
+                .take(opts.max_dict_bytes)
+                .collect();
+            raw.shrink_to_fit();
+            Some(CompressionDict::new(raw, opts.level))
+        }
+        .map(Arc::new);
+        self.start_compression_pipeline();
+
+        for (contents, last_key) in blocks {
+            if let Some(pipeline) = &mut self.compression_pipeline {
+                pipeline.submit(contents)?;
+                self.in_flight_keys.push_back(last_key);
+                self.write_compressed_blocks(false)?;
+            } else {
+                self.compress_and_write_block(&contents, last_key)?;
+            }
+        }
+        Ok(())
+    }
+
+    /// Codecs data blocks may be compressed with
+    fn data_block_codecs(&self) -> &[CompressionType] {
+        match self.options.compression_opts.candidate_codecs.as_slice() {
+            [] => std::slice::from_ref(&self.options.compression),
+            candidates => candidates,
+        }
+    }
+
+    fn compresses_data_blocks(&self) -> bool {
+        self.data_block_codecs()
+            .iter()
+            .any(|codec| *codec != CompressionType::None)
+    }
+
+    fn start_compression_pipeline(&mut self) {
+        let threads = self.options.compression_opts.parallel_threads;
+        if threads > 1 && self.compresses_data_blocks() {
+            self.compression_pipeline = Some(CompressionPipeline::new(
+                threads,
+                self.options.compression,
+                self.compression_dict.clone(),
+                &self.options.compression_opts,
+                self.options.statistics.clone(),
+            ));
+        }
+    }
+
+    /// Write the blocks the pipeline has finished, in order. With `drain`, wait for
+    /// every submitted block; otherwise wait only while too many are in flight.
+    fn write_compressed_blocks(&mut self, drain: bool) -> Result<()> {
+        let max_in_flight = 2 * self.options.compression_opts.parallel_threads;
+        loop {
+            let Some(pipeline) = &mut self.compression_pipeline else {
+                return Ok(());
+            };
+            let wait = drain || pipeline.in_flight() > max_in_flight;
+            let Some(block) = pipeline.next_block(wait) else {
+                return Ok(());
+            };
+
+            let block = block?;
+            let last_key = self.in_flight_keys.pop_front().unwrap();
+            self.write_data_block(
+                &block.data,
+                block.compression_type,
+                block.uncompressed_len,
+                last_key,
+            )?;
+        }
+    }
+
+    /// Compress and write the data block `contents`. A block stored uncompressed
+    /// is written straight from `contents`.
+    fn compress_and_write_block(&mut self, contents: &[u8], last_key: Vec<u8>) -> Result<()> {
+        let mut compressed = std::mem::take(&mut self.compressed_block);
+        let result = self
+            .compressor
+            .compress_block_into(
+                contents,
+                self.options.compression,
+                self.compression_dict.as_deref(),
+                self.options.compression_opts.max_compressed_bytes_per_kb,
+                &mut compressed,
+            )
+            .and_then(|compression_type| {
+                let data = if compression_type == CompressionType::None {
+                    contents
+                } else {
+                    &compressed
+                };
+                self.write_data_block(data, compression_type, contents.len(), last_key)
+            });
+        self.compressed_block = compressed;
+        result
+    }
+
+    /// Write a data block stored as `data` with `compression_type`, followed by its
+    /// trailer, and queue its index entry keyed by `last_key`
+    fn write_data_block(
+        &mut self,
+        data: &[u8],
+        compression_type: CompressionType,
+        uncompressed_len: usize,
+        last_key: Vec<u8>,
+    ) -> Result<()> {
+        if self.compresses_data_blocks() {
+            self.compression_stats
+                .record(compression_type, uncompressed_len, data.len());
+            if let Some(statistics) = self.options.statistics.as_deref() {
+                if compression_type == CompressionType::None {
+                    statistics.record_tick(Ticker::NumberBlockCompressionRejected, 1);
+                    statistics
+                        .record_tick(Ticker::BytesCompressionRejected, uncompressed_len as u64);
+                } else {
+                    statistics.record_tick(Ticker::NumberBlockCompressed, 1);
+                    statistics.record_tick(Ticker::BytesCompressedFrom, uncompressed_len as u64);
+                    statistics.record_tick(Ticker::BytesCompressedTo, data.len() as u64);
+                }
+            }
+        }
+
+        let trailer = block_trailer(
+            data,
+            compression_type,
             self.options.checksum_type,
             Some(self.offset),
             self.base_context_checksum,
-        )?;
-
-        // Create block handle
-        let block_handle = BlockHandle {
-            offset: self.offset,
-            size: block_data.len() as u64,
-        };
-
-        // Write data block
-        writer.write_all(&block_data)?;
-        self.offset += block_data.len() as u64;
+        );
+        let mut block_handle = self.write_raw_block(data)?;
+        self.write_raw_block(&trailer)?;
+        block_handle.size += BLOCK_TRAILER_SIZE as u64;
 
         // Add to pending index entry (we'll use the last key of this block)
         if let Some((prev_key, prev_handle)) = self.pending_index_entry.take() {
@@ -231,14 +541,26 @@ impl SstFileWriter {
         }
 
         // Store this block's info for the next index entry
-        self.pending_index_entry = Some((self.last_key.clone(), block_handle));
-
-        // Reset data block builder
-        self.data_block_builder.reset();
-
+        self.pending_index_entry = Some((last_key, block_handle));
         Ok(())
     }
 
+    /// Append `data` to the file, returning where it was written
+    fn write_raw_block(&mut self, data: &[u8]) -> Result<BlockHandle> {
+        let handle = BlockHandle {
+            offset: self.offset,
+            size: data.len() as u64,
+        };
+        self.writer.as_mut().unwrap().write_all(data)?;
+        self.offset += data.len() as u64;
+        record_tick(
+            self.options.statistics.as_deref(),
+            Ticker::SstWriteBytes,
+            data.len() as u64,
+        );
+        Ok(handle)
+    }
+
     fn encode_entry_value(&self, value: &[u8], entry_type: EntryType) -> Vec<u8> {
         // For simplicity, we'll encode the entry type as a prefix byte
         // In a real implementation, you might want to follow RocksDB's internal key format more closely
@@ -247,32 +569,6 @@ impl SstFileWriter {
         encoded.extend_from_slice(value);
         encoded
     }
-
-    fn create_empty_metaindex_block(&self, file_offset: u64) -> Result<Vec<u8>> {
-        // Create an empty metaindex block
-        let mut block_data = Vec::new();
-
-        // Empty block with just restart info
-        block_data.write_u32::<LittleEndian>(0)?; // restart point at 0
-        block_data.write_u32::<LittleEndian>(1)?; // one restart point
-
-        // Calculate checksum over block data + compression type
-        let mut checksum_data = block_data.clone();
-        checksum_data.push(CompressionType::None as u8);
-        let mut checksum = self.options.checksum_type.calculate(&checksum_data);
-
-        // Apply context-based checksum modification if needed
-        if let Some(base_checksum) = self.base_context_checksum {
-            let modifier = crate::types::checksum_modifier_for_context(base_checksum, file_offset);
-            checksum = checksum.wrapping_add(modifier);
-        }
-
-        // Add block trailer: compression type (1 byte) + checksum (4 bytes)
-        block_data.push(CompressionType::None as u8);
-        block_data.write_u32::<LittleEndian>(checksum)?;
-
-        Ok(block_data)
-    }
 }
 
 impl Drop for SstFileWriter {
@@ -289,7 +585,7 @@ mod tests {
     use super::*;
     use crate::error::Error;
     use crate::sst_reader::SstReader;
-    use crate::types::{ChecksumType, CompressionType, FormatVersion};
+    use crate::types::{ChecksumType, CompressionOptions, CompressionType, FormatVersion};
     use tempfile::tempdir;
 
     #[test]
@@ -312,6 +608,9 @@ mod tests {
             block_restart_interval: 16,
             format_version: FormatVersion::V5,
             checksum_type: ChecksumType::CRC32c,
+            use_direct_writes: false,
+            compression_opts: CompressionOptions::default(),
+            statistics: None,
         };
 
         // Write data
@@ -383,6 +682,9 @@ mod tests {
             block_restart_interval: 16,
             format_version: FormatVersion::V5,
             checksum_type: ChecksumType::CRC32c,
+            use_direct_writes: false,
+            compression_opts: CompressionOptions::default(),
+            statistics: None,
         };
 
         let mut writer = SstFileWriter::create(&opts);
@@ -461,6 +763,9 @@ mod tests {
             block_restart_interval: 16,
             format_version: FormatVersion::V5,
             checksum_type: ChecksumType::XXH3,
+            use_direct_writes: false,
+            compression_opts: CompressionOptions::default(),
+            statistics: None,
         };
 
         // Write data
@@ -492,6 +797,9 @@ mod tests {
             block_restart_interval: 16,
             format_version: FormatVersion::V6,
             checksum_type: ChecksumType::XXH3,
+            use_direct_writes: false,
+            compression_opts: CompressionOptions::default(),
+            statistics: None,
         };
 
         // Write data
@@ -523,6 +831,9 @@ mod tests {
             block_restart_interval: 16,
             format_version: FormatVersion::V7,
             checksum_type: ChecksumType::XXH3,
+            use_direct_writes: false,
+            compression_opts: CompressionOptions::default(),
+            statistics: None,
         };
 
         // Write data
@@ -540,4 +851,293 @@ mod tests {
         assert_eq!(footer.checksum_type, ChecksumType::XXH3);
         Ok(())
     }
+
+    #[test]
+    fn test_direct_io_roundtrip() -> Result<()> {
+        use crate::iterator::SstEntryIterator;
+        use crate::types::ReadOptions;
+
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("direct.sst");
+
+        let opts = WriteOptions {
+            block_size: 1024,
+            use_direct_writes: true,
+            ..WriteOptions::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        match writer.open(&path) {
+            // Some filesystems (e.g. tmpfs) reject direct I/O
+            Err(Error::Io(e)) if e.kind() == std::io::ErrorKind::InvalidInput => return Ok(()),
+            result => result?,
+        }
+        for i in 0..2000 {
+            writer.put(format!("key{:05}", i), format!("value{}", i))?;
+        }
+        writer.finish()?;
+        assert_eq!(std::fs::metadata(&path)?.len(), writer.file_size());
+
+        let read_opts = ReadOptions {
+            use_direct_reads: true,
+            ..ReadOptions::default()
+        };
+        let reader = SstReader::open_with_options(&path, &read_opts)?;
+        let mut iter = SstEntryIterator::with_options(reader, CompressionType::None, &read_opts)?;
+        let entries = iter.collect_all()?;
+        assert_eq!(entries.len(), 2000);
+        assert_eq!(entries[1234].0, b"key01234");
+        Ok(())
+    }
+
+    #[test]
+    fn test_zstd_dictionary_compression() -> Result<()> {
+        use crate::iterator::SstEntryIterator;
+
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+
+        let value_for = |i: u32| {
+            format!(
+                "{{\"id\":{},\"name\":\"user-{}\",\"email\":\"user{}@example.com\",\"score\":{}}}",
+                i,
+                i.wrapping_mul(2654435761),
+                i % 977,
+                i.wrapping_mul(40503) % 10000
+            )
+        };
+        let write_table = |name: &str, compression_opts: CompressionOptions| -> Result<_> {
+            let path = dir.path().join(name);
+            let opts = WriteOptions {
+                compression: CompressionType::ZSTD,
+                block_size: 1024,
+                compression_opts,
+                ..WriteOptions::default()
+            };
+            let mut writer = SstFileWriter::create(&opts);
+            writer.open(&path)?;
+            for i in 0..5000u32 {
+                writer.put(format!("user{:08}", i), value_for(i))?;
+            }
+            writer.finish()?;
+            Ok((path, writer.file_size()))
+        };
+
+        let (_, plain_size) = write_table("plain.sst", CompressionOptions::default())?;
+        let (dict_path, dict_size) = write_table(
+            "dict.sst",
+            CompressionOptions {
+                max_dict_bytes: 16 * 1024,
+                zstd_max_train_bytes: 100 * 16 * 1024,
+                ..CompressionOptions::default()
+            },
+        )?;
+        assert!(dict_size < plain_size, "{} >= {}", dict_size, plain_size);
+
+        let reader = SstReader::open(&dict_path)?;
+        assert!(reader.compression_dict().is_some());
+        let entries = SstEntryIterator::new(reader, CompressionType::ZSTD)?.collect_all()?;
+        assert_eq!(entries.len(), 5000);
+        assert_eq!(entries[4321].0, b"user00004321");
+        assert!(entries[4321].1.ends_with(value_for(4321).as_bytes()));
+
+        // The footer of format_version 6 and later locates the metaindex by size only
+        let path = dir.path().join("dict_v6.sst");
+        let mut writer = SstFileWriter::create(&WriteOptions {
+            compression: CompressionType::ZSTD,
+            format_version: FormatVersion::V6,
+            compression_opts: CompressionOptions {
+                max_dict_bytes: 16 * 1024,
+                ..CompressionOptions::default()
+            },
+            ..WriteOptions::default()
+        });
+        writer.open(&path)?;
+        for i in 0..5000u32 {
+            writer.put(format!("user{:08}", i), value_for(i))?;
+        }
+        writer.finish()?;
+        assert!(SstReader::open(&path)?.compression_dict().is_some());
+
+        // Too few samples to train on: written without a dictionary, and reported
+        let path = dir.path().join("untrained.sst");
+        let mut writer = SstFileWriter::create(&WriteOptions {
+            compression: CompressionType::ZSTD,
+            compression_opts: CompressionOptions {
+                max_dict_bytes: 16 * 1024,
+                zstd_max_train_bytes: 100 * 16 * 1024,
+                ..CompressionOptions::default()
+            },
+            ..WriteOptions::default()
+        });
+        writer.open(&path)?;
+        writer.put(b"key", b"value")?;
+        writer.finish()?;
+        assert!(writer.compression_stats().dictionary_training_failed);
+        assert!(SstReader::open(&path)?.compression_dict().is_none());
+        Ok(())
+    }
+
+    #[test]
+    fn test_parallel_compression_matches_serial() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+
+        let write_table = |name: &str, compression_opts: CompressionOptions| -> Result<Vec<u8>> {
+            let path = dir.path().join(name);
+            let opts = WriteOptions {
+                compression: CompressionType::ZSTD,
+                block_size: 1024,
+                compression_opts,
+                ..WriteOptions::default()
+            };
+            let mut writer = SstFileWriter::create(&opts);
+            writer.open(&path)?;
+            for i in 0..20000 {
+                writer.put(format!("key{:06}", i), format!("value{}", i * 31))?;
+            }
+            writer.finish()?;
+            assert_eq!(std::fs::metadata(&path)?.len(), writer.file_size());
+            Ok(std::fs::read(&path)?)
+        };
+
+        for max_dict_bytes in [0, 4096] {
+            let serial = write_table(
+                "serial.sst",
+                CompressionOptions {
+                    max_dict_bytes,
+                    ..CompressionOptions::default()
+                },
+            )?;
+            let parallel = write_table(
+                "parallel.sst",
+                CompressionOptions {
+                    max_dict_bytes,
+                    parallel_threads: 4,
+                    ..CompressionOptions::default()
+                },
+            )?;
+            assert!(serial == parallel, "max_dict_bytes {}", max_dict_bytes);
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn test_incompressible_blocks_stored_raw() -> Result<()> {
+        use crate::iterator::SstEntryIterator;
+
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("mixed.sst");
+
+        let opts = WriteOptions {
+            compression: CompressionType::ZSTD,
+            block_size: 4096,
+            ..WriteOptions::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+
+        // Pseudo-random values, like already compressed images, then text
+        let mut state = 0x2545f4914f6cdd1du64;
+        let mut values = Vec::new();
+        for i in 0..400 {
+            let value: Vec<u8> = if i < 200 {
+                (0..256)
+                    .map(|_| {
+                        state ^= state << 13;
+                        state ^= state >> 7;
+                        state ^= state << 17;
+                        state as u8
+                    })
+                    .collect()
+            } else {
+                format!("text value {} ", i).repeat(16).into_bytes()
+            };
+            writer.put(format!("key{:04}", i), &value)?;
+            values.push(value);
+        }
+        writer.finish()?;
+
+        let stats = writer.compression_stats().clone();
+        assert!(stats.blocks_compression_rejected > 0);
+        assert!(stats.blocks_compressed > 0);
+        assert!(stats.bytes_compressed_to < stats.bytes_compressed_from);
+
+        let reader = SstReader::open(&path)?;
+        let entries = SstEntryIterator::new(reader, CompressionType::ZSTD)?.collect_all()?;
+        assert_eq!(entries.len(), values.len());
+        for ((_, stored), value) in entries.iter().zip(&values) {
+            assert_eq!(&stored[1..], &value[..]);
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn test_per_block_codec_selection() -> Result<()> {
+        use crate::iterator::SstEntryIterator;
+
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("mixed_codecs.sst");
+
+        let opts = WriteOptions {
+            block_size: 4096,
+            compression_opts: CompressionOptions {
+                candidate_codecs: vec![CompressionType::LZ4, CompressionType::ZSTD],
+                ..CompressionOptions::default()
+            },
+            ..WriteOptions::default()
+        };
+        // Runs of repeated text compress about as well with either codec, so the
+        // cheaper LZ4 decode wins. Random hex digits have almost no repeats for LZ4
+        // to find, while zstd's entropy coding still halves them.
+        let mut seed = 0x9e37_79b9_7f4a_7c15u64;
+        let mut expected = Vec::new();
+        for i in 0..2000u32 {
+            let value = if i < 1000 {
+                format!("value{} ", i % 7).repeat(8)
+            } else {
+                (0..64)
+                    .map(|_| {
+                        seed ^= seed << 13;
+                        seed ^= seed >> 7;
+                        seed ^= seed << 17;
+                        char::from_digit((seed % 16) as u32, 16).unwrap()
+                    })
+                    .collect()
+            };
+            expected.push((format!("key{:05}", i), value));
+        }
+
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+        for (key, value) in &expected {
+            writer.put(key, value)?;
+        }
+        writer.finish()?;
+
+        let mut reader = SstReader::open(&path)?;
+        let mut codecs = Vec::new();
+        for handle in reader.read_index_block()?.get_all_block_handles()? {
+            let block = reader.read_range(&handle)?;
+            codecs.push(CompressionType::try_from(block[block.len() - 5])?);
+        }
+        assert!(codecs.contains(&CompressionType::LZ4));
+        assert!(codecs.contains(&CompressionType::ZSTD));
+        assert!(
+            codecs
+                .iter()
+                .all(|codec| matches!(codec, CompressionType::LZ4 | CompressionType::ZSTD))
+        );
+
+        // The table-wide compression type passed to the reader does not matter
+        let entries = SstEntryIterator::new(reader, CompressionType::None)?.collect_all()?;
+        assert_eq!(entries.len(), expected.len());
+        for ((key, value), (expected_key, expected_value)) in entries.iter().zip(&expected) {
+            assert_eq!(key, expected_key.as_bytes());
+            assert_eq!(&value[1..], expected_value.as_bytes());
+        }
+        Ok(())
+    }
 }
@@ -1,35 +1,275 @@
+use crate::block_cache_tracer::{BlockCacheTracer, TableReaderCaller, TraceBlockType};
 use crate::block_handle::BlockHandle;
+use crate::compression::DecompressionDict;
 use crate::data_block::{DataBlock, DataBlockReader};
+use crate::direct_io;
 use crate::error::{Error, Result};
 use crate::footer::Footer;
-use crate::types::CompressionType;
+use crate::index_block::IndexBlock;
+use crate::perf_context::{PerfTimer, perf_count};
+use crate::statistics::{Histogram, Statistics, Ticker, record_tick};
+use crate::tail_prefetch::TailPrefetchStats;
+use crate::types::{
+    BLOCK_TRAILER_SIZE, COMPRESSION_DICT_BLOCK_NAME, CompressionType, LEGACY_FOOTER_SIZE,
+    ROCKSDB_FOOTER_SIZE, ReadOptions,
+};
 use std::fs::File;
-use std::io::{BufReader, Read, Seek, SeekFrom};
-use std::path::Path;
+use std::ops::Deref;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
 
 pub struct SstReader {
-    reader: BufReader<File>,
+    /// Shared with clones of this reader. All reads are positional, so clones
+    /// never disturb each other.
+    file: Arc<File>,
     footer: Footer,
     file_size: u64,
+    path: PathBuf,
+    /// The last bytes of the file, read in one I/O at open. Reads that fall
+    /// inside it (footer, metaindex, dictionary) are served without touching the
+    /// file. It is released once open has parsed the metadata.
+    tail: Vec<u8>,
+    tail_offset: u64,
+    /// The index block as read from the tail at open, handed to the first
+    /// [`read_index_block`](Self::read_index_block) so that it needs no I/O
+    prefetched_index: Option<Vec<u8>>,
+    use_direct_reads: bool,
+    /// Dictionary from the `rocksdb.compression_dict` meta block, loaded once at open
+    compression_dict: Option<Arc<DecompressionDict>>,
+    statistics: Option<Arc<Statistics>>,
+    block_cache_tracer: Option<Arc<BlockCacheTracer>>,
+}
+
+/// Fill `buffer` from `offset`, through aligned buffers when the file was opened for direct I/O
+fn read_file_at(file: &File, use_direct_reads: bool, offset: u64, buffer: &mut [u8]) -> Result<()> {
+    let timer = PerfTimer::start();
+    if use_direct_reads {
+        direct_io::read_exact_at(file, buffer, offset)?;
+    } else {
+        direct_io::pread_exact(file, buffer, offset)?;
+    }
+    timer.stop(|context| &mut context.block_read_nanos);
+    Ok(())
+}
+
+/// Read `len` bytes at `offset` of a file opened for direct I/O, viewed in place in
+/// the aligned buffer they were read into
+fn read_file_direct(file: &File, offset: u64, len: usize) -> Result<direct_io::AlignedRead> {
+    let timer = PerfTimer::start();
+    let contents = direct_io::read_at(file, offset, len)?;
+    timer.stop(|context| &mut context.block_read_nanos);
+    Ok(contents)
+}
+
+/// Raw bytes of a block or range read from the file. Direct reads keep the bytes in
+/// the aligned buffer they were read into rather than copying them out.
+pub(crate) enum BlockContents {
+    Owned(Vec<u8>),
+    Aligned(direct_io::AlignedRead),
+}
+
+impl BlockContents {
+    /// The owned buffer, replacing an aligned view with an empty one
+    fn make_owned(&mut self) -> &mut Vec<u8> {
+        if let BlockContents::Aligned(_) = self {
+            *self = BlockContents::Owned(Vec::new());
+        }
+        match self {
+            BlockContents::Owned(data) => data,
+            BlockContents::Aligned(_) => unreachable!(),
+        }
+    }
+}
+
+impl Default for BlockContents {
+    fn default() -> Self {
+        BlockContents::Owned(Vec::new())
+    }
+}
+
+impl Deref for BlockContents {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match self {
+            BlockContents::Owned(data) => data,
+            BlockContents::Aligned(data) => data,
+        }
+    }
+}
+
+fn open_file(path: &Path, use_direct_reads: bool) -> Result<File> {
+    if use_direct_reads {
+        Ok(direct_io::open_direct(path)?)
+    } else {
+        Ok(File::open(path)?)
+    }
 }
 
 impl SstReader {
     pub fn open<P: AsRef<Path>>(path: P) -> Result<Self> {
-        let file = File::open(path)?;
-        let mut reader = BufReader::new(file);
+        Self::open_with_options(path, &ReadOptions::default())
+    }
+
+    pub fn open_with_options<P: AsRef<Path>>(path: P, options: &ReadOptions) -> Result<Self> {
+        Self::open_impl(path.as_ref(), options, TailPrefetchStats::global())
+    }
 
-        let file_size = reader.seek(std::io::SeekFrom::End(0))?;
-        reader.seek(std::io::SeekFrom::Start(0))?;
+    /// Open the file with a single tail read sized from `stats`, and record how much
+    /// of the tail this table's metadata needed.
+    pub fn open_with_tail_stats<P: AsRef<Path>>(
+        path: P,
+        stats: &TailPrefetchStats,
+    ) -> Result<Self> {
+        Self::open_impl(path.as_ref(), &ReadOptions::default(), stats)
+    }
 
-        let footer = Footer::read_from(&mut reader)?;
+    fn open_impl(path: &Path, options: &ReadOptions, stats: &TailPrefetchStats) -> Result<Self> {
+        let path = path.to_path_buf();
+        let file = open_file(&path, options.use_direct_reads)?;
+        let file_size = file.metadata()?.len();
 
-        Ok(SstReader {
-            reader,
+        // Minimum file size is 48 bytes (legacy footer)
+        if file_size < LEGACY_FOOTER_SIZE as u64 {
+            return Err(Error::FileTooSmall);
+        }
+
+        let tail_len = (stats.suggested_size() as u64)
+            .max(ROCKSDB_FOOTER_SIZE as u64)
+            .min(file_size);
+        let tail_offset = file_size - tail_len;
+
+        let mut tail = vec![0u8; tail_len as usize];
+        read_file_at(&file, options.use_direct_reads, tail_offset, &mut tail)?;
+
+        record_tick(options.statistics.as_deref(), Ticker::NoFileOpens, 1);
+        record_tick(
+            options.statistics.as_deref(),
+            Ticker::SstReadBytes,
+            tail_len,
+        );
+
+        let footer = Footer::decode_from_tail(&tail, file_size)?;
+        // From format_version 6 the footer may carry a null index handle, located
+        // through the metaindex instead, which must not count as offset 0
+        let metadata_offset = [&footer.index_handle, &footer.metaindex_handle]
+            .into_iter()
+            .filter(|handle| !handle.is_null())
+            .map(|handle| handle.offset)
+            .min()
+            .unwrap_or(0);
+        stats.record_effective_size(file_size.saturating_sub(metadata_offset) as usize);
+
+        let mut sst_reader = SstReader {
+            file: Arc::new(file),
             file_size,
             footer,
+            path,
+            tail,
+            tail_offset,
+            prefetched_index: None,
+            use_direct_reads: options.use_direct_reads,
+            compression_dict: None,
+            statistics: options.statistics.clone(),
+            block_cache_tracer: options.block_cache_tracer.clone(),
+        };
+        sst_reader.compression_dict = sst_reader.read_compression_dict()?.map(Arc::new);
+
+        // Only the index block is still to be read, so keep just its bytes and release
+        // the prefetch buffer, as RocksDB does once a table is open
+        let index_handle = &sst_reader.footer.index_handle;
+        sst_reader.prefetched_index = sst_reader
+            .tail_slice(index_handle.offset, index_handle.size as usize)
+            .filter(|index_data| !index_data.is_empty())
+            .map(<[u8]>::to_vec);
+        sst_reader.tail = Vec::new();
+        sst_reader.tail_offset = file_size;
+        Ok(sst_reader)
+    }
+
+    /// Names and handles of the meta blocks listed in the metaindex. As in RocksDB,
+    /// the handles leave out the block trailer.
+    fn read_metaindex(&mut self) -> Result<Vec<(Vec<u8>, BlockHandle)>> {
+        // The metaindex is the last block before the footer. Its handle in the footer
+        // leaves the trailer out in RocksDB's files but counts it in this writer's
+        // format_version < 6 files, so the block is read up to the footer instead.
+        let footer_size = if self.footer.format_version == 0 {
+            LEGACY_FOOTER_SIZE
+        } else {
+            ROCKSDB_FOOTER_SIZE
+        };
+        let footer_offset = self.file_size.saturating_sub(footer_size as u64);
+        let offset = self.footer.metaindex_handle.offset;
+        if offset >= footer_offset {
+            return Err(Error::InvalidBlockHandle(format!(
+                "Metaindex block at {} overlaps the footer at {}",
+                offset, footer_offset
+            )));
+        }
+
+        let metaindex_data = self.read_block(
+            BlockHandle::new(offset, footer_offset - offset),
+            TraceBlockType::MetaIndex,
+            TableReaderCaller::Prefetch,
+        )?;
+        let metaindex = DataBlock::new(&metaindex_data, CompressionType::None).map_err(|e| {
+            Error::InvalidBlockFormat(format!("Metaindex block does not parse: {}", e))
+        })?;
+        let mut entries = Vec::new();
+        metaindex.for_each_entry(|key, value| {
+            entries.push((key.to_vec(), BlockHandle::decode_from_bytes(value)?.0));
+            Ok(())
+        })?;
+        Ok(entries)
+    }
+
+    /// Look up the compression dictionary meta block through the metaindex
+    fn read_compression_dict(&mut self) -> Result<Option<DecompressionDict>> {
+        let dict_handle = self
+            .read_metaindex()?
+            .into_iter()
+            .find(|(name, _)| name == COMPRESSION_DICT_BLOCK_NAME.as_bytes())
+            .map(|(_, handle)| handle);
+        let Some(dict_handle) = dict_handle else {
+            return Ok(None);
+        };
+
+        // The dictionary is stored uncompressed, followed by the block trailer
+        let dict_size = dict_handle.size as usize;
+        let dict_block = self.read_block(
+            BlockHandle::new(
+                dict_handle.offset,
+                dict_handle.size + BLOCK_TRAILER_SIZE as u64,
+            ),
+            TraceBlockType::CompressionDictionary,
+            TableReaderCaller::Prefetch,
+        )?;
+        Ok(Some(DecompressionDict::new(&dict_block[..dict_size])))
+    }
+
+    /// Another reader on the same table, reusing the already parsed footer. Clones
+    /// share the open file, which they read with positional reads, so they can be
+    /// used from different threads without opening the file again.
+    pub fn try_clone(&self) -> Result<Self> {
+        Ok(SstReader {
+            file: self.file.clone(),
+            footer: self.footer.clone(),
+            file_size: self.file_size,
+            path: self.path.clone(),
+            tail: Vec::new(),
+            tail_offset: self.file_size,
+            prefetched_index: None,
+            use_direct_reads: self.use_direct_reads,
+            compression_dict: self.compression_dict.clone(),
+            statistics: self.statistics.clone(),
+            block_cache_tracer: self.block_cache_tracer.clone(),
         })
     }
 
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
     pub fn get_footer(&self) -> &Footer {
         &self.footer
     }
@@ -38,17 +278,174 @@ impl SstReader {
         self.file_size
     }
 
-    pub(crate) fn read_block(&mut self, handle: BlockHandle) -> Result<Vec<u8>> {
+    /// Memory held by the reader: the index block prefetched at open until it is
+    /// read, and the compression dictionary. The dictionary is shared with clones
+    /// of this reader and counted by each of them.
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>()
+            + self.prefetched_index.as_ref().map_or(0, Vec::capacity)
+            + self.path.capacity()
+            + self
+                .compression_dict
+                .as_ref()
+                .map_or(0, |dict| dict.approximate_memory_usage())
+    }
+
+    /// The table's zstd compression dictionary, if it was written with one
+    pub fn compression_dict(&self) -> Option<&Arc<DecompressionDict>> {
+        self.compression_dict.as_ref()
+    }
+
+    /// Read the block at `handle` on behalf of `caller`, tracing the access when a
+    /// tracer is attached
+    pub(crate) fn read_block(
+        &mut self,
+        handle: BlockHandle,
+        block_type: TraceBlockType,
+        caller: TableReaderCaller,
+    ) -> Result<BlockContents> {
+        let hit = self
+            .tail_slice(handle.offset, handle.size as usize)
+            .is_some();
+        let buffer = self.read_range(&handle)?;
+        self.trace_block_access(&handle, block_type, caller, hit);
+        Ok(buffer)
+    }
+
+    /// Read the raw bytes of `handle`, which may span several blocks
+    pub(crate) fn read_range(&mut self, handle: &BlockHandle) -> Result<BlockContents> {
         if handle.offset + handle.size > self.file_size {
             return Err(Error::InvalidBlockHandle(
                 "Block extends beyond file size".to_string(),
             ));
         }
 
-        self.reader.seek(SeekFrom::Start(handle.offset))?;
-        let mut buffer = vec![0u8; handle.size as usize];
-        self.reader.read_exact(&mut buffer)?;
-        Ok(buffer)
+        let mut contents = BlockContents::default();
+        self.read_into(handle.offset, handle.size as usize, &mut contents)?;
+        self.record_block_read(handle.size);
+        Ok(contents)
+    }
+
+    /// Replace `contents` with the `len` bytes at `offset`. Buffered reads reuse its
+    /// owned buffer; direct reads leave the bytes in the aligned buffer they were
+    /// read into.
+    pub(crate) fn read_into(
+        &mut self,
+        offset: u64,
+        len: usize,
+        contents: &mut BlockContents,
+    ) -> Result<()> {
+        if self.use_direct_reads && self.tail_slice(offset, len).is_none() {
+            *contents = BlockContents::Aligned(read_file_direct(&self.file, offset, len)?);
+            record_tick(self.statistics(), Ticker::SstReadBytes, len as u64);
+            return Ok(());
+        }
+
+        let buffer = contents.make_owned();
+        buffer.resize(len, 0);
+        self.read_at(offset, buffer)
+    }
+
+    /// Count a block of `size` bytes read by this table, from the file or a buffer
+    pub(crate) fn record_block_read(&self, size: u64) {
+        perf_count(|context| {
+            context.block_read_count += 1;
+            context.block_read_byte += size;
+        });
+        if let Some(statistics) = self.statistics() {
+            statistics.record_in_histogram(Histogram::BlockReadSize, size);
+        }
+    }
+
+    /// Append an access to the block at `handle` to the trace, if one is attached
+    pub(crate) fn trace_block_access(
+        &self,
+        handle: &BlockHandle,
+        block_type: TraceBlockType,
+        caller: TableReaderCaller,
+        hit: bool,
+    ) {
+        if let Some(tracer) = &self.block_cache_tracer {
+            tracer.record(
+                &self.path,
+                handle.offset,
+                handle.size,
+                block_type,
+                caller,
+                hit,
+            );
+        }
+    }
+
+    /// Statistics this table records into, from [`ReadOptions::statistics`]
+    pub(crate) fn statistics(&self) -> Option<&Statistics> {
+        self.statistics.as_deref()
+    }
+
+    /// Owned handle to [`SstReader::statistics`], for timing work that needs the
+    /// reader mutably
+    pub(crate) fn shared_statistics(&self) -> Option<Arc<Statistics>> {
+        self.statistics.clone()
+    }
+
+    /// Fill `buffer` with the bytes starting at `offset`
+    pub(crate) fn read_at(&mut self, offset: u64, buffer: &mut [u8]) -> Result<()> {
+        if let Some(cached) = self.tail_slice(offset, buffer.len()) {
+            buffer.copy_from_slice(cached);
+            return Ok(());
+        }
+
+        read_file_at(&self.file, self.use_direct_reads, offset, buffer)?;
+        record_tick(self.statistics(), Ticker::SstReadBytes, buffer.len() as u64);
+        Ok(())
+    }
+
+    /// The prefetched tail bytes for `len` bytes at `offset`, if the tail covers them
+    fn tail_slice(&self, offset: u64, len: usize) -> Option<&[u8]> {
+        let start = offset.checked_sub(self.tail_offset)? as usize;
+        self.tail.get(start..start.checked_add(len)?)
+    }
+
+    /// Hint the OS to start reading `len` bytes at `offset` into the page cache in the
+    /// background. This is advisory only and a no-op where it is not supported.
+    pub(crate) fn advise_willneed(&self, offset: u64, len: u64) {
+        // Direct reads bypass the page cache, so there is nothing to warm
+        #[cfg(target_os = "linux")]
+        if !self.use_direct_reads {
+            use std::os::fd::AsRawFd;
+            unsafe {
+                libc::posix_fadvise(
+                    self.file.as_raw_fd(),
+                    offset as libc::off_t,
+                    len as libc::off_t,
+                    libc::POSIX_FADV_WILLNEED,
+                );
+            }
+        }
+        #[cfg(not(target_os = "linux"))]
+        let _ = (offset, len);
+    }
+
+    pub fn read_index_block(&mut self) -> Result<IndexBlock> {
+        let index_handle = self.footer.index_handle.clone();
+        let index_data = match self.prefetched_index.take() {
+            Some(index_data) => {
+                self.record_block_read(index_handle.size);
+                self.trace_block_access(
+                    &index_handle,
+                    TraceBlockType::Index,
+                    TableReaderCaller::Prefetch,
+                    true,
+                );
+                BlockContents::Owned(index_data)
+            }
+            None => self.read_block(
+                index_handle,
+                TraceBlockType::Index,
+                TableReaderCaller::Prefetch,
+            )?,
+        };
+        IndexBlock::new(&index_data, CompressionType::None)
     }
 
     pub fn read_data_block(
@@ -56,8 +453,37 @@ impl SstReader {
         handle: BlockHandle,
         compression_type: CompressionType,
     ) -> Result<DataBlock> {
-        let block_data = self.read_block(handle)?;
-        DataBlock::new(&block_data, compression_type)
+        let block_data = self.read_block(
+            handle,
+            TraceBlockType::Data,
+            TableReaderCaller::UserIterator,
+        )?;
+        self.decode_data_block(&block_data, compression_type)
+    }
+
+    /// Decode a data block of this table read through some other path
+    pub(crate) fn decode_data_block(
+        &self,
+        block_data: &[u8],
+        compression_type: CompressionType,
+    ) -> Result<DataBlock> {
+        self.decode_data_block_into(block_data, compression_type, Vec::new())
+    }
+
+    /// Like [`SstReader::decode_data_block`], reusing `buffer` for the contents
+    pub(crate) fn decode_data_block_into(
+        &self,
+        block_data: &[u8],
+        compression_type: CompressionType,
+        buffer: Vec<u8>,
+    ) -> Result<DataBlock> {
+        DataBlock::decode_into(
+            block_data,
+            compression_type,
+            self.compression_dict.as_deref(),
+            self.statistics(),
+            buffer,
+        )
     }
 
     pub fn read_data_block_reader(
@@ -65,8 +491,12 @@ impl SstReader {
         handle: BlockHandle,
         compression_type: CompressionType,
     ) -> Result<DataBlockReader> {
-        let block_data = self.read_block(handle)?;
-        DataBlockReader::new(&block_data, compression_type)
+        let block_data = self.read_block(
+            handle,
+            TraceBlockType::Data,
+            TableReaderCaller::UserIterator,
+        )?;
+        DataBlockReader::from_block(self.decode_data_block(&block_data, compression_type)?)
     }
 }
 
@@ -92,6 +522,85 @@ mod tests {
         assert!(result.is_err());
     }
 
+    #[test]
+    fn test_tail_prefetch_learns_metadata_size() -> Result<()> {
+        use crate::sst_file_writer::SstFileWriter;
+        use crate::types::WriteOptions;
+
+        let dir = tempfile::tempdir()
+            .map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("tail.sst");
+
+        let opts = WriteOptions {
+            block_size: 256,
+            ..WriteOptions::default()
+        };
+        let mut writer = SstFileWriter::create(&opts);
+        writer.open(&path)?;
+        for i in 0..20000 {
+            writer.put(format!("key{:06}", i), format!("value{:06}", i))?;
+        }
+        writer.finish()?;
+
+        let stats = TailPrefetchStats::new();
+
+        // The default tail is too small for this index, which is then read separately
+        let mut first = SstReader::open_with_tail_stats(&path, &stats)?;
+        let index_handle = first.get_footer().index_handle.clone();
+        assert!(index_handle.size as usize > crate::tail_prefetch::DEFAULT_TAIL_PREFETCH_SIZE);
+        assert!(first.prefetched_index.is_none());
+        let expected_entries = first.read_index_block()?.get_entries()?.len();
+
+        // The next open has learned the size and serves the index from its tail read
+        let mut second = SstReader::open_with_tail_stats(&path, &stats)?;
+        assert!(second.prefetched_index.is_some());
+        // Nothing but the index block outlives the open
+        assert!(second.tail.is_empty());
+        assert_eq!(
+            second.read_index_block()?.get_entries()?.len(),
+            expected_entries
+        );
+        assert!(second.prefetched_index.is_none());
+        assert_eq!(second.get_footer(), first.get_footer());
+
+        // A null index handle in the footer does not make the whole file metadata
+        for version in [6, 7] {
+            let path = fixture_path(version, "crc32c", "snappy");
+            let stats = TailPrefetchStats::new();
+            let reader = SstReader::open_with_tail_stats(&path, &stats)?;
+            let footer = reader.get_footer();
+            assert!(footer.index_handle.is_null());
+            assert_eq!(
+                stats.suggested_size() as u64,
+                reader.file_size() - footer.metaindex_handle.offset
+            );
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn test_rocksdb_metaindex() -> Result<()> {
+        for version in [5, 6, 7] {
+            for compression in ["none", "snappy", "zstd"] {
+                let mut reader = SstReader::open(fixture_path(version, "crc32c", compression))?;
+                let names: Vec<Vec<u8>> = reader
+                    .read_metaindex()?
+                    .into_iter()
+                    .map(|(name, _)| name)
+                    .collect();
+                assert!(
+                    names.contains(&b"rocksdb.properties".to_vec()),
+                    "v{} {}: {:?}",
+                    version,
+                    compression,
+                    names
+                );
+                assert!(reader.compression_dict().is_none());
+            }
+        }
+        Ok(())
+    }
+
     #[test]
     fn test_format_v5_crc32_snappy() -> Result<()> {
         let path = fixture_path(5, "crc32c", "snappy");
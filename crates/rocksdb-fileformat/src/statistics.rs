@@ -0,0 +1,450 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Process wide tickers and latency histograms, modelled on RocksDB's
+//! `Statistics`.
+//!
+//! A [`Statistics`] object is shared by every writer and reader it is attached to
+//! through [`WriteOptions::statistics`](crate::types::WriteOptions::statistics) or
+//! [`ReadOptions::statistics`](crate::types::ReadOptions::statistics). Unlike
+//! [`PerfContext`](crate::perf_context::PerfContext) it aggregates across threads.
+//! Updates go to a per-core shard of relaxed atomics so concurrent threads do not
+//! contend on one cache line; reads merge the shards.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/include/rocksdb/statistics.h
+
+use std::fmt;
+use std::sync::LazyLock;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::time::Instant;
+
+macro_rules! define_metrics {
+    ($(#[$meta:meta])* pub enum $name:ident { $($(#[$doc:meta])* $variant:ident => $str:literal,)* }) => {
+        $(#[$meta])*
+        #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+        pub enum $name {
+            $($(#[$doc])* $variant,)*
+        }
+
+        impl $name {
+            pub const ALL: &'static [$name] = &[$($name::$variant,)*];
+            const COUNT: usize = $name::ALL.len();
+
+            /// The RocksDB style name used when exporting
+            pub fn name(self) -> &'static str {
+                match self {
+                    $($name::$variant => $str,)*
+                }
+            }
+        }
+    };
+}
+
+define_metrics! {
+    pub enum Ticker {
+        /// Bytes written to SST files, including trailers and metadata blocks
+        SstWriteBytes => "rocksdb.sst.write.bytes",
+        /// Data blocks stored compressed
+        NumberBlockCompressed => "rocksdb.number.block.compressed",
+        /// Data blocks stored uncompressed because compression did not save enough
+        NumberBlockCompressionRejected => "rocksdb.number.block.compression_rejected",
+        /// Uncompressed and stored sizes of the blocks stored compressed
+        BytesCompressedFrom => "rocksdb.bytes.compressed.from",
+        BytesCompressedTo => "rocksdb.bytes.compressed.to",
+        /// Uncompressed size of the blocks whose compression was rejected
+        BytesCompressionRejected => "rocksdb.bytes.compression.rejected",
+        /// Bytes read from SST files. Reads served from the prefetched tail or a
+        /// readahead buffer are not counted.
+        SstReadBytes => "rocksdb.sst.read.bytes",
+        /// Blocks served from an iterator's readahead buffer without a file read
+        PrefetchHits => "rocksdb.prefetch.hits",
+        /// Blocks that had to be decompressed, and their stored and decompressed sizes
+        NumberBlockDecompressed => "rocksdb.number.block.decompressed",
+        BytesDecompressedFrom => "rocksdb.bytes.decompressed.from",
+        BytesDecompressedTo => "rocksdb.bytes.decompressed.to",
+        /// SST files opened for reading
+        NoFileOpens => "rocksdb.no.file.opens",
+        /// Table cache lookups that found the table already open, and that opened it
+        TableCacheHit => "rocksdb.table.cache.hit",
+        TableCacheMiss => "rocksdb.table.cache.miss",
+    }
+}
+
+define_metrics! {
+    pub enum Histogram {
+        /// Size of each block read, including its trailer
+        BlockReadSize => "rocksdb.block.read.size",
+        /// Time to compress a data block, including rejected attempts
+        CompressionTimesNanos => "rocksdb.compression.times.nanos",
+        /// Time to decompress a block
+        DecompressionTimesNanos => "rocksdb.decompression.times.nanos",
+        /// Latency of point lookups
+        TableGetNanos => "rocksdb.table.get.nanos",
+    }
+}
+
+/// Upper bounds of the histogram buckets. As in RocksDB's `HistogramBucketMapper`,
+/// each is about 1.5 times the previous one, rounded down to two significant digits.
+static BUCKET_LIMITS: LazyLock<Vec<u64>> = LazyLock::new(|| {
+    let mut limits = vec![1u64, 2];
+    let mut last = 2u64;
+    while last < u64::MAX / 3 * 2 {
+        let mut next = last + last / 2;
+        let mut pow = 1u64;
+        while next / pow >= 100 {
+            pow *= 10;
+        }
+        next = next / pow * pow;
+        limits.push(next);
+        last = next;
+    }
+    limits.push(u64::MAX);
+    limits
+});
+
+fn bucket_index(value: u64) -> usize {
+    BUCKET_LIMITS.partition_point(|&limit| limit < value)
+}
+
+struct HistogramShard {
+    count: AtomicU64,
+    sum: AtomicU64,
+    min: AtomicU64,
+    max: AtomicU64,
+    buckets: Box<[AtomicU64]>,
+}
+
+impl HistogramShard {
+    fn new() -> Self {
+        HistogramShard {
+            count: AtomicU64::new(0),
+            sum: AtomicU64::new(0),
+            min: AtomicU64::new(u64::MAX),
+            max: AtomicU64::new(0),
+            buckets: BUCKET_LIMITS.iter().map(|_| AtomicU64::new(0)).collect(),
+        }
+    }
+
+    fn add(&self, value: u64) {
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.sum.fetch_add(value, Ordering::Relaxed);
+        self.min.fetch_min(value, Ordering::Relaxed);
+        self.max.fetch_max(value, Ordering::Relaxed);
+        self.buckets[bucket_index(value)].fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn clear(&self) {
+        self.count.store(0, Ordering::Relaxed);
+        self.sum.store(0, Ordering::Relaxed);
+        self.min.store(u64::MAX, Ordering::Relaxed);
+        self.max.store(0, Ordering::Relaxed);
+        for bucket in &self.buckets {
+            bucket.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
+/// One core's counters, aligned so that shards never share a cache line
+#[repr(align(64))]
+struct Shard {
+    tickers: [AtomicU64; Ticker::COUNT],
+    histograms: [HistogramShard; Histogram::COUNT],
+}
+
+impl Shard {
+    fn new() -> Self {
+        Shard {
+            tickers: std::array::from_fn(|_| AtomicU64::new(0)),
+            histograms: std::array::from_fn(|_| HistogramShard::new()),
+        }
+    }
+}
+
+/// Merged view of a histogram
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct HistogramData {
+    pub count: u64,
+    pub sum: u64,
+    pub min: u64,
+    pub max: u64,
+    pub average: f64,
+    pub median: f64,
+    pub percentile95: f64,
+    pub percentile99: f64,
+}
+
+pub struct Statistics {
+    shards: Box<[Shard]>,
+}
+
+impl Statistics {
+    /// Create statistics with one shard per available core
+    pub fn new() -> Self {
+        let num_shards = std::thread::available_parallelism().map_or(1, |n| n.get());
+        Statistics {
+            shards: (0..num_shards).map(|_| Shard::new()).collect(),
+        }
+    }
+
+    fn shard(&self) -> &Shard {
+        &self.shards[current_core() % self.shards.len()]
+    }
+
+    pub fn record_tick(&self, ticker: Ticker, count: u64) {
+        self.shard().tickers[ticker as usize].fetch_add(count, Ordering::Relaxed);
+    }
+
+    pub fn record_in_histogram(&self, histogram: Histogram, value: u64) {
+        self.shard().histograms[histogram as usize].add(value);
+    }
+
+    pub fn ticker_count(&self, ticker: Ticker) -> u64 {
+        self.shards
+            .iter()
+            .map(|shard| shard.tickers[ticker as usize].load(Ordering::Relaxed))
+            .sum()
+    }
+
+    pub fn histogram_data(&self, histogram: Histogram) -> HistogramData {
+        let mut count = 0;
+        let mut sum = 0u64;
+        let mut min = u64::MAX;
+        let mut max = 0;
+        let mut buckets = vec![0u64; BUCKET_LIMITS.len()];
+        for shard in self.shards.iter() {
+            let stat = &shard.histograms[histogram as usize];
+            count += stat.count.load(Ordering::Relaxed);
+            sum = sum.wrapping_add(stat.sum.load(Ordering::Relaxed));
+            min = min.min(stat.min.load(Ordering::Relaxed));
+            max = max.max(stat.max.load(Ordering::Relaxed));
+            for (total, bucket) in buckets.iter_mut().zip(stat.buckets.iter()) {
+                *total += bucket.load(Ordering::Relaxed);
+            }
+        }
+        if count == 0 {
+            return HistogramData::default();
+        }
+
+        let percentile = |p: f64| percentile(&buckets, count, min, max, p);
+        HistogramData {
+            count,
+            sum,
+            min,
+            max,
+            average: sum as f64 / count as f64,
+            median: percentile(50.0),
+            percentile95: percentile(95.0),
+            percentile99: percentile(99.0),
+        }
+    }
+
+    /// Zero every ticker and histogram
+    pub fn reset(&self) {
+        for shard in self.shards.iter() {
+            for ticker in &shard.tickers {
+                ticker.store(0, Ordering::Relaxed);
+            }
+            for histogram in &shard.histograms {
+                histogram.clear();
+            }
+        }
+    }
+}
+
+impl Default for Statistics {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl fmt::Debug for Statistics {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("Statistics")
+            .field("shards", &self.shards.len())
+            .finish()
+    }
+}
+
+/// Every ticker and histogram, one per line, in the format of RocksDB's
+/// `Statistics::ToString`
+impl fmt::Display for Statistics {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        for &ticker in Ticker::ALL {
+            writeln!(f, "{} COUNT : {}", ticker.name(), self.ticker_count(ticker))?;
+        }
+        for &histogram in Histogram::ALL {
+            let data = self.histogram_data(histogram);
+            writeln!(
+                f,
+                "{} P50 : {:.6} P95 : {:.6} P99 : {:.6} P100 : {:.6} COUNT : {} SUM : {}",
+                histogram.name(),
+                data.median,
+                data.percentile95,
+                data.percentile99,
+                data.max as f64,
+                data.count,
+                data.sum
+            )?;
+        }
+        Ok(())
+    }
+}
+
+/// Interpolate the `p`th percentile within the bucket it falls in, as RocksDB's
+/// `HistogramStat::Percentile` does
+fn percentile(buckets: &[u64], count: u64, min: u64, max: u64, p: f64) -> f64 {
+    let threshold = count as f64 * p / 100.0;
+    let mut cumulative = 0u64;
+    for (index, &bucket) in buckets.iter().enumerate() {
+        cumulative += bucket;
+        if cumulative as f64 >= threshold {
+            let left = if index == 0 {
+                0
+            } else {
+                BUCKET_LIMITS[index - 1]
+            } as f64;
+            let right = BUCKET_LIMITS[index] as f64;
+            let left_count = (cumulative - bucket) as f64;
+            let position = if bucket == 0 {
+                0.0
+            } else {
+                (threshold - left_count) / bucket as f64
+            };
+            let value = left + (right - left) * position;
+            return value.clamp(min as f64, max as f64);
+        }
+    }
+    max as f64
+}
+
+/// Index of the core the calling thread runs on, or a stable per-thread index where
+/// that is not available
+fn current_core() -> usize {
+    #[cfg(target_os = "linux")]
+    {
+        let cpu = unsafe { libc::sched_getcpu() };
+        if cpu >= 0 {
+            return cpu as usize;
+        }
+    }
+    thread_index()
+}
+
+fn thread_index() -> usize {
+    static NEXT_INDEX: AtomicUsize = AtomicUsize::new(0);
+    thread_local! {
+        static INDEX: usize = NEXT_INDEX.fetch_add(1, Ordering::Relaxed);
+    }
+    INDEX.with(|index| *index)
+}
+
+/// Add `count` to `ticker` if statistics are attached
+pub(crate) fn record_tick(statistics: Option<&Statistics>, ticker: Ticker, count: u64) {
+    if let Some(statistics) = statistics {
+        statistics.record_tick(ticker, count);
+    }
+}
+
+/// Times a section into a histogram, recorded when the stop watch is stopped or
+/// dropped, so an early return still records the time. The clock is only read
+/// when statistics are attached.
+pub(crate) struct StopWatch<'a> {
+    statistics: Option<&'a Statistics>,
+    histogram: Histogram,
+    start: Option<Instant>,
+}
+
+impl<'a> StopWatch<'a> {
+    pub fn start(statistics: Option<&'a Statistics>, histogram: Histogram) -> Self {
+        StopWatch {
+            statistics,
+            histogram,
+            start: statistics.map(|_| Instant::now()),
+        }
+    }
+
+    /// Record the elapsed time now rather than at the end of the scope
+    pub fn stop(self) {}
+}
+
+impl Drop for StopWatch<'_> {
+    fn drop(&mut self) {
+        if let (Some(statistics), Some(start)) = (self.statistics, self.start) {
+            statistics.record_in_histogram(self.histogram, start.elapsed().as_nanos() as u64);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::{Error, Result};
+    use crate::iterator::SstEntryIterator;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::sst_reader::SstReader;
+    use crate::types::{CompressionType, ReadOptions, WriteOptions};
+    use std::sync::Arc;
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_statistics_record_writer_and_reader() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let path = dir.path().join("stats.sst");
+        let statistics = Arc::new(Statistics::new());
+
+        let mut writer = SstFileWriter::create(&WriteOptions {
+            compression: CompressionType::Snappy,
+            block_size: 1024,
+            statistics: Some(statistics.clone()),
+            ..WriteOptions::default()
+        });
+        writer.open(&path)?;
+        for i in 0..1000 {
+            writer.put(format!("key{:05}", i), "value".repeat(10))?;
+        }
+        writer.finish()?;
+
+        assert_eq!(
+            statistics.ticker_count(Ticker::SstWriteBytes),
+            writer.file_size()
+        );
+        let compressed = statistics.ticker_count(Ticker::NumberBlockCompressed);
+        assert_eq!(compressed, writer.compression_stats().blocks_compressed);
+        assert!(compressed > 0);
+        assert_eq!(
+            statistics
+                .histogram_data(Histogram::CompressionTimesNanos)
+                .count,
+            compressed
+        );
+
+        let read_options = ReadOptions {
+            statistics: Some(statistics.clone()),
+            ..ReadOptions::default()
+        };
+        let reader = SstReader::open_with_options(&path, &read_options)?;
+        let mut iter =
+            SstEntryIterator::with_options(reader, CompressionType::Snappy, &read_options)?;
+        assert!(iter.find(b"key00500")?.is_some());
+        assert!(iter.find(b"key99999")?.is_none());
+
+        assert_eq!(statistics.ticker_count(Ticker::NoFileOpens), 1);
+        assert!(statistics.ticker_count(Ticker::NumberBlockDecompressed) > 0);
+        assert_eq!(statistics.histogram_data(Histogram::TableGetNanos).count, 2);
+        let block_sizes = statistics.histogram_data(Histogram::BlockReadSize);
+        assert!(block_sizes.count > 0);
+        assert!(block_sizes.min as f64 <= block_sizes.median);
+        assert!(block_sizes.median <= block_sizes.max as f64);
+        assert!(
+            statistics
+                .to_string()
+                .contains("rocksdb.no.file.opens COUNT : 1")
+        );
+
+        statistics.reset();
+        assert_eq!(statistics.ticker_count(Ticker::SstWriteBytes), 0);
+        assert_eq!(statistics.histogram_data(Histogram::BlockReadSize).count, 0);
+        Ok(())
+    }
+}
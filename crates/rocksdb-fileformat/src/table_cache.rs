@@ -0,0 +1,411 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Cache of opened tables keyed by file number, modelled on RocksDB's
+//! `TableCache`.
+//!
+//! Opening a table opens its file, reads and validates the footer, loads the
+//! compression dictionary and decodes the index block. The cache keeps that work
+//! for up to `max_open_files` tables, evicting the least recently used one when a
+//! new table is opened beyond the limit. Threads missing on the same table wait
+//! for one of them to open it rather than each opening the file. With a
+//! [`MemoryBudget`](crate::memory_budget::MemoryBudget) in the options, tables are
+//! also evicted while the budget is exceeded. A table still in use when evicted
+//! stays open until its last user drops it.
+//!
+//! Table files live in one directory and are named from their number as RocksDB
+//! names them, e.g. `000042.sst` (see [`table_file_name`]).
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/db/table_cache.h
+
+use crate::block_cache_tracer::{TableReaderCaller, TraceBlockType};
+use crate::data_block::DataBlock;
+use crate::error::Result;
+use crate::index_block::DecodedIndex;
+use crate::iterator::{SstTableIterator, lookup_in_block};
+use crate::memory_budget::MemoryReservation;
+use crate::sst_reader::SstReader;
+use crate::statistics::{Statistics, Ticker, record_tick};
+use crate::types::{CompressionType, ReadOptions};
+use std::collections::{BTreeMap, HashMap, HashSet};
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Condvar, Mutex};
+
+/// Path of the table with number `file_number` in `dir`
+pub fn table_file_name(dir: &Path, file_number: u64) -> PathBuf {
+    dir.join(format!("{:06}.sst", file_number))
+}
+
+/// An opened table: its file handle, footer and index block, whose separators and
+/// handles are decoded once and binary searched by every lookup
+pub struct CachedTable {
+    file_number: u64,
+    reader: Mutex<SstReader>,
+    index: Arc<DecodedIndex>,
+    statistics: Option<Arc<Statistics>>,
+    _memory_reservation: Option<MemoryReservation>,
+}
+
+impl CachedTable {
+    fn open(path: &Path, file_number: u64, options: &ReadOptions) -> Result<Self> {
+        let mut reader = SstReader::open_with_options(path, options)?;
+        let index = reader.read_index_block()?.decode_entries()?;
+        let memory_reservation = options
+            .memory_budget
+            .as_ref()
+            .map(|budget| budget.reserve(index.approximate_memory_usage()));
+
+        Ok(CachedTable {
+            file_number,
+            reader: Mutex::new(reader),
+            index: Arc::new(index),
+            statistics: options.statistics.clone(),
+            _memory_reservation: memory_reservation,
+        })
+    }
+
+    pub fn file_number(&self) -> u64 {
+        self.file_number
+    }
+
+    /// Point lookup through the cached index. Lookups on the same table share its
+    /// file handle and are serialized only for the block read itself.
+    pub fn get(&self, key: &[u8]) -> Result<Option<Vec<u8>>> {
+        // Past the last separator no block can hold the key
+        let block_index = self.index.block_index_for_key(key);
+        let Some(handle) = self.index.handles().get(block_index).cloned() else {
+            return Ok(None);
+        };
+
+        let (block_data, dict) = {
+            let mut reader = self.reader.lock().unwrap();
+            let block_data =
+                reader.read_block(handle, TraceBlockType::Data, TableReaderCaller::UserGet)?;
+            (block_data, reader.compression_dict().cloned())
+        };
+        let data_block = DataBlock::decode(
+            &block_data,
+            CompressionType::None,
+            dict.as_deref(),
+            self.statistics.as_deref(),
+        )?;
+
+        let mut results = [None];
+        lookup_in_block(data_block, &[key], &[0], &mut results)?;
+        let [result] = results;
+        Ok(result)
+    }
+
+    /// Memory held by the reader and the decoded index
+    pub fn approximate_memory_usage(&self) -> usize {
+        size_of::<Self>()
+            + self.reader.lock().unwrap().approximate_memory_usage()
+            + self.index.approximate_memory_usage()
+    }
+}
+
+struct LruState {
+    /// Cached tables with the sequence number of their last use
+    tables: HashMap<u64, (Arc<CachedTable>, u64)>,
+    /// File numbers by last use, oldest first
+    lru: BTreeMap<u64, u64>,
+    /// Tables being opened by some thread, which others wait for
+    opening: HashSet<u64>,
+    sequence: u64,
+}
+
+impl LruState {
+    /// The cached table `file_number`, marked as most recently used
+    fn touch(&mut self, file_number: u64) -> Option<Arc<CachedTable>> {
+        self.sequence += 1;
+        let sequence = self.sequence;
+        let (table, last_use) = self.tables.get_mut(&file_number)?;
+        let table = table.clone();
+        let previous_use = std::mem::replace(last_use, sequence);
+        self.lru.remove(&previous_use);
+        self.lru.insert(sequence, file_number);
+        Some(table)
+    }
+}
+
+pub struct TableCache {
+    dir: PathBuf,
+    max_open_files: usize,
+    options: ReadOptions,
+    state: Mutex<LruState>,
+    /// Signalled whenever an open finishes, successfully or not
+    opened: Condvar,
+}
+
+impl TableCache {
+    /// Cache up to `max_open_files` tables from `dir`, opened with `options`
+    pub fn new<P: AsRef<Path>>(dir: P, max_open_files: usize, options: ReadOptions) -> Self {
+        TableCache {
+            dir: dir.as_ref().to_path_buf(),
+            max_open_files: max_open_files.max(1),
+            options,
+            state: Mutex::new(LruState {
+                tables: HashMap::new(),
+                lru: BTreeMap::new(),
+                opening: HashSet::new(),
+                sequence: 0,
+            }),
+            opened: Condvar::new(),
+        }
+    }
+
+    /// The opened table with number `file_number`, opening it on a miss
+    pub fn find_table(&self, file_number: u64) -> Result<Arc<CachedTable>> {
+        let mut state = self.state.lock().unwrap();
+        loop {
+            if let Some(table) = state.touch(file_number) {
+                record_tick(self.options.statistics.as_deref(), Ticker::TableCacheHit, 1);
+                return Ok(table);
+            }
+            // Wait for another thread opening the same table, then look again. If
+            // its open failed, this thread tries in turn.
+            if !state.opening.insert(file_number) {
+                state = self.opened.wait(state).unwrap();
+                continue;
+            }
+            break;
+        }
+        drop(state);
+        record_tick(
+            self.options.statistics.as_deref(),
+            Ticker::TableCacheMiss,
+            1,
+        );
+
+        // Open without holding the lock so other tables stay available meanwhile
+        let path = table_file_name(&self.dir, file_number);
+        let table = CachedTable::open(&path, file_number, &self.options).map(Arc::new);
+
+        let mut state = self.state.lock().unwrap();
+        state.opening.remove(&file_number);
+        self.opened.notify_all();
+        let table = table?;
+        while state.tables.len() >= self.max_open_files || self.over_budget() {
+            let Some((_, evicted)) = state.lru.pop_first() else {
+                break;
+            };
+            state.tables.remove(&evicted);
+        }
+        state.sequence += 1;
+        let sequence = state.sequence;
+        state.tables.insert(file_number, (table.clone(), sequence));
+        state.lru.insert(sequence, file_number);
+        Ok(table)
+    }
+
+    fn over_budget(&self) -> bool {
+        self.options
+            .memory_budget
+            .as_ref()
+            .is_some_and(|budget| budget.usage() > budget.limit())
+    }
+
+    /// Look `key` up in table `file_number`
+    pub fn get(&self, file_number: u64, key: &[u8]) -> Result<Option<Vec<u8>>> {
+        self.find_table(file_number)?.get(key)
+    }
+
+    /// Iterate table `file_number`. The iterator has its own reader on the cached
+    /// table's open file and shares its footer and decoded index.
+    pub fn new_iterator(&self, file_number: u64) -> Result<SstTableIterator> {
+        let table = self.find_table(file_number)?;
+        let reader = table.reader.lock().unwrap().try_clone()?;
+        Ok(SstTableIterator::with_shared_index(
+            reader,
+            table.index.clone(),
+            CompressionType::None,
+            &self.options,
+        ))
+    }
+
+    /// Drop table `file_number` from the cache, e.g. once its file is deleted
+    pub fn evict(&self, file_number: u64) {
+        let mut state = self.state.lock().unwrap();
+        if let Some((_, last_use)) = state.tables.remove(&file_number) {
+            state.lru.remove(&last_use);
+        }
+    }
+
+    /// Number of tables currently cached
+    pub fn len(&self) -> usize {
+        self.state.lock().unwrap().tables.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Memory held by the cached tables
+    pub fn approximate_memory_usage(&self) -> usize {
+        let tables: Vec<Arc<CachedTable>> = self
+            .state
+            .lock()
+            .unwrap()
+            .tables
+            .values()
+            .map(|(table, _)| table.clone())
+            .collect();
+        tables
+            .iter()
+            .map(|table| table.approximate_memory_usage())
+            .sum()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::error::Error;
+    use crate::iterator::SstIterator;
+    use crate::memory_budget::MemoryBudget;
+    use crate::sst_file_writer::SstFileWriter;
+    use crate::types::WriteOptions;
+    use tempfile::tempdir;
+
+    #[test]
+    fn test_table_cache_bounds_open_tables() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        for file_number in 1..=3u64 {
+            let mut writer = SstFileWriter::create(&WriteOptions {
+                block_size: 512,
+                ..WriteOptions::default()
+            });
+            writer.open(table_file_name(dir.path(), file_number))?;
+            for i in 0..500 {
+                writer.put(format!("key{:05}", i), format!("{}:{}", file_number, i))?;
+            }
+            writer.finish()?;
+        }
+
+        let statistics = Arc::new(Statistics::new());
+        let options = ReadOptions {
+            statistics: Some(statistics.clone()),
+            ..ReadOptions::default()
+        };
+        let cache = TableCache::new(dir.path(), 2, options);
+
+        let first = cache.find_table(1)?;
+        assert!(Arc::ptr_eq(&first, &cache.find_table(1)?));
+        assert_eq!(cache.get(2, b"key00100")?, Some(b"\x002:100".to_vec()));
+        // Opening a third table evicts the least recently used, table 1
+        assert_eq!(cache.get(3, b"key00499")?, Some(b"\x003:499".to_vec()));
+        assert_eq!(cache.get(3, b"key99999")?, None);
+        assert_eq!(cache.len(), 2);
+        assert!(!Arc::ptr_eq(&first, &cache.find_table(1)?));
+        // Evicted tables stay usable by their holders
+        assert_eq!(first.get(b"key00007")?, Some(b"\x001:7".to_vec()));
+        assert_eq!(statistics.ticker_count(Ticker::NoFileOpens), 4);
+        assert_eq!(statistics.ticker_count(Ticker::TableCacheMiss), 4);
+
+        std::thread::scope(|scope| {
+            let workers: Vec<_> = (1..=3u64)
+                .map(|file_number| {
+                    let cache = &cache;
+                    scope.spawn(move || -> Result<()> {
+                        for i in (0..500).step_by(7) {
+                            let value =
+                                cache.get(file_number, format!("key{:05}", i).as_bytes())?;
+                            let expected = format!("\x00{}:{}", file_number, i);
+                            assert_eq!(value, Some(expected.into_bytes()));
+                        }
+                        Ok(())
+                    })
+                })
+                .collect();
+            workers
+                .into_iter()
+                .try_for_each(|worker| worker.join().unwrap())
+        })?;
+        assert!(cache.len() <= 2);
+
+        let mut iter = cache.new_iterator(2)?;
+        iter.seek(b"key00250")?;
+        assert_eq!(iter.value(), Some(b"\x002:250".as_slice()));
+        let mut count = 1;
+        while iter.next()? {
+            count += 1;
+        }
+        assert_eq!(count, 250);
+
+        cache.evict(2);
+        assert!(cache.approximate_memory_usage() > 0);
+        Ok(())
+    }
+
+    #[test]
+    fn test_table_cache_opens_each_table_once() -> Result<()> {
+        let dir =
+            tempdir().map_err(|e| Error::InvalidArgument(format!("Temp dir failed: {}", e)))?;
+        let mut writer = SstFileWriter::create(&WriteOptions {
+            block_size: 256,
+            ..WriteOptions::default()
+        });
+        writer.open(table_file_name(dir.path(), 7))?;
+        for i in 0..1000 {
+            writer.put(format!("key{:05}", i), format!("value{}", i))?;
+        }
+        writer.finish()?;
+
+        let statistics = Arc::new(Statistics::new());
+        let budget = MemoryBudget::new(usize::MAX);
+        let cache = TableCache::new(
+            dir.path(),
+            10,
+            ReadOptions {
+                statistics: Some(statistics.clone()),
+                memory_budget: Some(budget.clone()),
+                ..ReadOptions::default()
+            },
+        );
+
+        // Threads missing on the same table at once share a single open
+        let barrier = std::sync::Barrier::new(8);
+        let tables = std::thread::scope(|scope| {
+            let workers: Vec<_> = (0..8)
+                .map(|_| {
+                    scope.spawn(|| {
+                        barrier.wait();
+                        cache.find_table(7)
+                    })
+                })
+                .collect();
+            workers
+                .into_iter()
+                .map(|worker| worker.join().unwrap())
+                .collect::<Result<Vec<_>>>()
+        })?;
+        assert!(tables.iter().all(|table| Arc::ptr_eq(table, &tables[0])));
+        assert_eq!(statistics.ticker_count(Ticker::NoFileOpens), 1);
+        assert_eq!(statistics.ticker_count(Ticker::TableCacheMiss), 1);
+        assert_eq!(statistics.ticker_count(Ticker::TableCacheHit), 7);
+
+        for i in [0, 499, 999] {
+            let key = format!("key{:05}", i);
+            let expected = format!("\x00value{}", i).into_bytes();
+            assert_eq!(cache.get(7, key.as_bytes())?, Some(expected));
+        }
+        assert_eq!(cache.get(7, b"key99999")?, None);
+
+        // Iterators read through the cached table's file without reopening it, and
+        // share its index without charging the budget for it again
+        let usage = budget.usage();
+        assert!(usage > 0);
+        let mut iter = cache.new_iterator(7)?;
+        assert_eq!(budget.usage(), usage);
+        iter.seek(b"key00990")?;
+        assert_eq!(iter.key(), Some(b"key00990".as_slice()));
+        assert_eq!(statistics.ticker_count(Ticker::NoFileOpens), 1);
+
+        // A failed open is not cached and does not block the next attempt
+        assert!(cache.find_table(8).is_err());
+        assert!(cache.find_table(8).is_err());
+        assert_eq!(cache.len(), 1);
+        Ok(())
+    }
+}
@@ -0,0 +1,108 @@
+// Copyright 2024 YaleDB Contributors
+// SPDX-License-Identifier: Apache-2.0
+
+//! Adaptive sizing of the tail read issued when a table is opened.
+//!
+//! Each open records how many bytes at the end of the file the table's metadata
+//! (index and metaindex blocks plus the footer) actually occupied. The suggested
+//! prefetch size is the largest recent size whose over-read stays within 1/8 of the
+//! total bytes read, so a few unusually large tables don't inflate every open.
+//!
+//! https://github.com/facebook/rocksdb/blob/v10.5.1/table/block_based/block_based_table_factory.cc
+
+use std::collections::VecDeque;
+use std::sync::Mutex;
+
+/// Tail read used before any open has been recorded
+pub const DEFAULT_TAIL_PREFETCH_SIZE: usize = 4 * 1024;
+/// Upper bound for the suggested tail read
+pub const MAX_TAIL_PREFETCH_SIZE: usize = 512 * 1024;
+/// Number of recent opens the suggestion is based on
+const NUM_TRACKED_OPENS: usize = 32;
+
+pub struct TailPrefetchStats {
+    records: Mutex<VecDeque<usize>>,
+}
+
+static GLOBAL_TAIL_PREFETCH_STATS: TailPrefetchStats = TailPrefetchStats::new();
+
+impl TailPrefetchStats {
+    pub const fn new() -> Self {
+        TailPrefetchStats {
+            records: Mutex::new(VecDeque::new()),
+        }
+    }
+
+    /// Stats shared by every [`crate::SstReader::open`] in the process
+    pub fn global() -> &'static TailPrefetchStats {
+        &GLOBAL_TAIL_PREFETCH_STATS
+    }
+
+    /// Record the number of tail bytes an open actually needed
+    pub fn record_effective_size(&self, size: usize) {
+        let mut records = self.records.lock().unwrap();
+        if records.len() == NUM_TRACKED_OPENS {
+            records.pop_front();
+        }
+        records.push_back(size);
+    }
+
+    pub fn suggested_size(&self) -> usize {
+        let mut sorted: Vec<usize> = self.records.lock().unwrap().iter().copied().collect();
+        if sorted.is_empty() {
+            return DEFAULT_TAIL_PREFETCH_SIZE;
+        }
+        sorted.sort_unstable();
+
+        // Raising the prefetch size to sorted[i] over-reads (sorted[i] - prev) bytes
+        // for each of the i smaller records
+        let mut max_qualified_size = sorted[0];
+        let mut wasted = 0;
+        for i in 1..sorted.len() {
+            let read = sorted[i] * sorted.len();
+            wasted += (sorted[i] - sorted[i - 1]) * i;
+            if wasted <= read / 8 {
+                max_qualified_size = sorted[i];
+            }
+        }
+
+        max_qualified_size.min(MAX_TAIL_PREFETCH_SIZE)
+    }
+}
+
+impl Default for TailPrefetchStats {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_suggested_size_ignores_outliers() {
+        let stats = TailPrefetchStats::new();
+        assert_eq!(stats.suggested_size(), DEFAULT_TAIL_PREFETCH_SIZE);
+
+        for _ in 0..10 {
+            stats.record_effective_size(1000);
+        }
+        assert_eq!(stats.suggested_size(), 1000);
+
+        stats.record_effective_size(100_000);
+        assert_eq!(stats.suggested_size(), 1000);
+
+        for _ in 0..NUM_TRACKED_OPENS {
+            stats.record_effective_size(2000);
+        }
+        assert_eq!(stats.suggested_size(), 2000);
+
+        stats.record_effective_size(usize::MAX / 64);
+        assert_eq!(stats.suggested_size(), 2000);
+        for _ in 0..NUM_TRACKED_OPENS {
+            stats.record_effective_size(1 << 30);
+        }
+        assert_eq!(stats.suggested_size(), MAX_TAIL_PREFETCH_SIZE);
+    }
+}
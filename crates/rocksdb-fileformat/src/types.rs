@@ -1,6 +1,11 @@
 // Copyright 2024 YaleDB Contributors
 // SPDX-License-Identifier: Apache-2.0
 
+use crate::block_cache_tracer::BlockCacheTracer;
+use crate::memory_budget::MemoryBudget;
+use crate::statistics::Statistics;
+use std::sync::Arc;
+
 pub const ROCKSDB_MAGIC_NUMBER: u64 = 0x88e241b785f4cff7;
 pub const ROCKSDB_FOOTER_SIZE: usize = 53;
 
@@ -8,9 +13,22 @@ pub const LEGACY_MAGIC_NUMBER: u64 = 0xdb4775248b80fb57;
 pub const LEGACY_FOOTER_SIZE: usize = 48;
 
 pub const MAX_BLOCK_HANDLE_ENCODED_LENGTH: usize = 20;
+/// Compression type byte plus 32-bit checksum following every block
+pub const BLOCK_TRAILER_SIZE: usize = 5;
 
 pub const DEFAULT_BLOCK_SIZE: usize = 4096;
 pub const DEFAULT_BLOCK_RESTART_INTERVAL: usize = 16;
+pub const DEFAULT_INITIAL_AUTO_READAHEAD_SIZE: usize = 8 * 1024;
+pub const DEFAULT_MAX_AUTO_READAHEAD_SIZE: usize = 256 * 1024;
+pub const DEFAULT_MAX_COMPRESSED_BYTES_PER_KB: usize = 1024 * 7 / 8;
+/// With the default, ZSTD is picked over LZ4 when it saves at least 10% more of
+/// the block
+pub const DEFAULT_DECODE_COST_WEIGHT: f64 = 0.05;
+/// Compression level meaning "the codec's own default", RocksDB's `kDefaultCompressionLevel`
+pub const DEFAULT_COMPRESSION_LEVEL: i32 = 32767;
+
+/// Metaindex key of the meta block holding the zstd compression dictionary
+pub const COMPRESSION_DICT_BLOCK_NAME: &str = "rocksdb.compression_dict";
 
 /// https://github.com/facebook/rocksdb/blob/v10.5.1/include/rocksdb/table.h#L55
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -74,6 +92,39 @@ impl ChecksumType {
             }
         }
     }
+
+    /// Checksum of `data` followed by `last_byte`, equal to [`ChecksumType::calculate`]
+    /// over the concatenation but without building it. Block trailers checksum the
+    /// block contents plus the compression type byte this way.
+    pub fn calculate_with_last_byte(self, data: &[u8], last_byte: u8) -> u32 {
+        match self {
+            ChecksumType::None => 0,
+            ChecksumType::CRC32c => {
+                const MASK_DELTA: u32 = 0xa282ead8;
+                let crc = crc32c::crc32c_append(crc32c::crc32c(data), &[last_byte]);
+                ((crc >> 15) | (crc << 17)).wrapping_add(MASK_DELTA)
+            }
+            ChecksumType::Hash => {
+                let mut hasher = xxhash_rust::xxh32::Xxh32::new(0);
+                hasher.update(data);
+                hasher.update(&[last_byte]);
+                hasher.digest()
+            }
+            ChecksumType::Hash64 => {
+                let mut hasher = xxhash_rust::xxh64::Xxh64::new(0);
+                hasher.update(data);
+                hasher.update(&[last_byte]);
+                (hasher.digest() & 0xFFFFFFFF) as u32
+            }
+            ChecksumType::XXH3 => {
+                // XXH3 checksums are defined over all but the last byte already
+                use xxhash_rust::xxh3::xxh3_64;
+                const RANDOM_PRIME: u32 = 0x6b9083d9;
+                let v = (xxh3_64(data) & 0xFFFFFFFF) as u32;
+                v ^ (last_byte as u32).wrapping_mul(RANDOM_PRIME)
+            }
+        }
+    }
 }
 
 /// Helper function to split a 64-bit value into lower 32 bits
@@ -146,6 +197,58 @@ impl TryFrom<u32> for FormatVersion {
     }
 }
 
+/// Tuning for block compression, mirroring RocksDB's `CompressionOptions`
+#[derive(Debug, Clone)]
+pub struct CompressionOptions {
+    /// Codec specific level: 0-9 for zlib, 1-12 for LZ4HC, and zstd's levels
+    /// (negative for its fast modes). For LZ4 a negative level is the acceleration
+    /// factor. `DEFAULT_COMPRESSION_LEVEL` uses each codec's default.
+    pub level: i32,
+    /// Log2 of the zstd window size, from 10 to 27, or 0 for the level's default.
+    /// Larger windows would produce frames that decoders reject unless they raise
+    /// their window limit. Unlike RocksDB's `window_bits`, this does not apply to zlib.
+    pub zstd_window_log: u32,
+    /// zstd strategy, from 1 (`ZSTD_fast`) to 9 (`ZSTD_btultra2`), or 0 for the
+    /// level's default. Unlike RocksDB's `strategy`, this does not apply to zlib.
+    pub zstd_strategy: i32,
+    /// Maximum size of the zstd dictionary trained per file. Zero disables
+    /// dictionary compression.
+    pub max_dict_bytes: usize,
+    /// Bytes of data block contents sampled to train the dictionary. Zero uses the
+    /// first `max_dict_bytes` of data as the dictionary without training.
+    pub zstd_max_train_bytes: usize,
+    /// Threads compressing data blocks. Above 1, blocks are compressed on a worker
+    /// pool while the writer keeps building the next ones.
+    pub parallel_threads: usize,
+    /// A compressed block is kept only if it is at most this many bytes per KiB of
+    /// input; otherwise the block is stored uncompressed. The default of 896
+    /// requires compression to save at least 1/8 of the block.
+    pub max_compressed_bytes_per_kb: usize,
+    /// Codecs to choose from for every data block. When non-empty, each block is
+    /// compressed with every candidate and stored with the one giving the best
+    /// tradeoff of size and decode cost, overriding `WriteOptions::compression`.
+    pub candidate_codecs: Vec<CompressionType>,
+    /// Bytes of compressed size worth one unit of decode cost, where decoding a
+    /// byte with LZ4 costs 1. Higher values favor cheaper codecs over smaller output.
+    pub decode_cost_weight: f64,
+}
+
+impl Default for CompressionOptions {
+    fn default() -> Self {
+        CompressionOptions {
+            level: DEFAULT_COMPRESSION_LEVEL,
+            zstd_window_log: 0,
+            zstd_strategy: 0,
+            max_dict_bytes: 0,
+            zstd_max_train_bytes: 0,
+            parallel_threads: 1,
+            max_compressed_bytes_per_kb: DEFAULT_MAX_COMPRESSED_BYTES_PER_KB,
+            candidate_codecs: Vec::new(),
+            decode_cost_weight: DEFAULT_DECODE_COST_WEIGHT,
+        }
+    }
+}
+
 /// Configuration options for SstFileWriter
 #[derive(Debug, Clone)]
 pub struct WriteOptions {
@@ -154,6 +257,11 @@ pub struct WriteOptions {
     pub block_restart_interval: usize,
     pub format_version: FormatVersion,
     pub checksum_type: ChecksumType,
+    /// Write the file with direct I/O, bypassing the OS page cache
+    pub use_direct_writes: bool,
+    pub compression_opts: CompressionOptions,
+    /// Shared tickers and histograms to record into, if any
+    pub statistics: Option<Arc<Statistics>>,
 }
 
 impl Default for WriteOptions {
@@ -164,6 +272,9 @@ impl Default for WriteOptions {
             block_restart_interval: DEFAULT_BLOCK_RESTART_INTERVAL,
             format_version: FormatVersion::V5,
             checksum_type: ChecksumType::CRC32c,
+            use_direct_writes: false,
+            compression_opts: CompressionOptions::default(),
+            statistics: None,
         }
     }
 }
@@ -174,12 +285,36 @@ pub struct ReadOptions {
     /// Whether to verify checksums when reading the file.
     /// Enabled by default for data integrity protection across all format versions.
     pub verify_checksums: bool,
+    /// Fixed readahead applied to every data block read of an iterator.
+    /// Zero (the default) selects automatic readahead instead.
+    pub readahead_size: usize,
+    /// Readahead used once automatic readahead detects a sequential scan.
+    /// It doubles on every further sequential refill.
+    pub initial_auto_readahead_size: usize,
+    /// Upper bound for automatic readahead. Zero disables it.
+    pub max_auto_readahead_size: usize,
+    /// Read the file with direct I/O, bypassing the OS page cache. Useful when
+    /// blocks are cached by the caller and the page cache would hold them twice.
+    pub use_direct_reads: bool,
+    /// Shared tickers and histograms to record into, if any
+    pub statistics: Option<Arc<Statistics>>,
+    /// Trace of every block read, for offline cache simulation
+    pub block_cache_tracer: Option<Arc<BlockCacheTracer>>,
+    /// Budget the decoded indexes of iterators and cached tables are charged to
+    pub memory_budget: Option<Arc<MemoryBudget>>,
 }
 
 impl Default for ReadOptions {
     fn default() -> Self {
         ReadOptions {
             verify_checksums: true,
+            readahead_size: 0,
+            initial_auto_readahead_size: DEFAULT_INITIAL_AUTO_READAHEAD_SIZE,
+            max_auto_readahead_size: DEFAULT_MAX_AUTO_READAHEAD_SIZE,
+            use_direct_reads: false,
+            statistics: None,
+            block_cache_tracer: None,
+            memory_budget: None,
         }
     }
 }
@@ -537,6 +672,16 @@ mod tests {
                 "Failed for test case '{}' with checksum type {:?}. Expected 0x{:08x}, got 0x{:08x}",
                 name, checksum_type, expected, result
             );
+
+            if let Some((last_byte, rest)) = data.split_last() {
+                assert_eq!(
+                    checksum_type.calculate_with_last_byte(rest, *last_byte),
+                    *expected,
+                    "Streaming checksum differs for test case '{}' with checksum type {:?}",
+                    name,
+                    checksum_type
+                );
+            }
         }
     }
 }